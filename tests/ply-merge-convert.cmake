@@ -0,0 +1,64 @@
+# Checks that ply-merge reads and writes ascii and binary ply files
+# consistently.
+#
+# An ascii source is converted to ascii directly, and via a binary
+# intermediate.  Both conversions must produce identical files.
+#
+# Usage: cmake -DPLY_MERGE=<path> -DWORKDIR=<dir> -P ply-merge-convert.cmake
+
+if(NOT PLY_MERGE OR NOT WORKDIR)
+  message(FATAL_ERROR "PLY_MERGE and WORKDIR must be defined")
+endif()
+
+file(MAKE_DIRECTORY ${WORKDIR})
+
+# A source with negative co-ordinates and distinct colours
+set(numPoints 4096)
+set(points "")
+math(EXPR last "${numPoints} - 1")
+foreach(i RANGE ${last})
+  math(EXPR x "${i} % 16")
+  math(EXPR y "(${i} / 16) % 16")
+  math(EXPR z "${i} / 256 - 8")
+  math(EXPR r "(${i} * 7) % 256")
+  math(EXPR g "(${i} * 13) % 256")
+  math(EXPR b "(${i} * 29) % 256")
+  set(points "${points}${x} ${y} ${z} ${r} ${g} ${b}\n")
+endforeach()
+
+set(header "ply\nformat ascii 1.0\nelement vertex ${numPoints}\n")
+set(header "${header}property float x\nproperty float y\nproperty float z\n")
+set(header "${header}property uchar red\nproperty uchar green\n")
+set(header "${header}property uchar blue\nend_header\n")
+file(WRITE ${WORKDIR}/src.ply "${header}${points}")
+
+# Runs ply-merge to convert src to out
+function(convert src out)
+  execute_process(
+    COMMAND ${PLY_MERGE} --mode=convert --frameCount=1
+      --srcPath=${src} --outPath=${out} ${ARGN}
+    WORKING_DIRECTORY ${WORKDIR}
+    RESULT_VARIABLE status
+    OUTPUT_VARIABLE log
+    ERROR_VARIABLE log
+  )
+  if(NOT status EQUAL 0)
+    message(FATAL_ERROR "ply-merge failed:\n${log}")
+  endif()
+endfunction()
+
+convert(src.ply direct.ply)
+convert(src.ply binary.ply --outputBinaryPly=1)
+convert(binary.ply indirect.ply)
+
+file(READ ${WORKDIR}/direct.ply direct)
+file(READ ${WORKDIR}/indirect.ply indirect)
+if(NOT direct STREQUAL indirect)
+  message(FATAL_ERROR "ascii and binary conversions differ")
+endif()
+
+# NB: colour components are written in GBR order
+string(FIND "${direct}" "\n15.00000 15.00000 7.00000 243 227 249\n" lastPoint)
+if(lastPoint EQUAL -1)
+  message(FATAL_ERROR "last point not found in output")
+endif()
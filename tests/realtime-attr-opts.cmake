@@ -0,0 +1,105 @@
+# Checks that the attribute encoder options chosen by the real-time
+# controller for a frame are those used to code the frame.
+#
+# Two identical frames are encoded with an unattainable latency target,
+# such that the second frame is coded at complexity level 2.  The coded
+# attribute size of the second frame must match that of a standalone
+# encode using the equivalent options, and differ from that of the first.
+#
+# Usage: cmake -DTMC3=<path> -DWORKDIR=<dir> -P realtime-attr-opts.cmake
+
+if(NOT TMC3 OR NOT WORKDIR)
+  message(FATAL_ERROR "TMC3 and WORKDIR must be defined")
+endif()
+
+file(MAKE_DIRECTORY ${WORKDIR})
+
+# A pseudo-random point cloud with noisy colours, such that the choice of
+# prediction mode affects the coded size.
+set(numPoints 4096)
+set(seed 1)
+set(points "")
+math(EXPR last "${numPoints} - 1")
+foreach(i RANGE ${last})
+  math(EXPR x "${i} % 16")
+  math(EXPR y "(${i} / 16) % 16")
+  math(EXPR z "${i} / 256")
+  set(rgb "")
+  foreach(c RANGE 2)
+    math(EXPR seed "(${seed} * 1103515245 + 12345) % 2147483648")
+    math(EXPR v "(${x} * 8 + ${c} * ${y} * 4 + (${seed} / 65536) % 48) % 256")
+    set(rgb "${rgb} ${v}")
+  endforeach()
+  set(points "${points}${x} ${y} ${z}${rgb}\n")
+endforeach()
+
+set(header "ply\nformat ascii 1.0\nelement vertex ${numPoints}\n")
+set(header "${header}property float x\nproperty float y\nproperty float z\n")
+set(header "${header}property uchar red\nproperty uchar green\n")
+set(header "${header}property uchar blue\nend_header\n")
+file(WRITE ${WORKDIR}/frame1.ply "${header}${points}")
+file(WRITE ${WORKDIR}/frame2.ply "${header}${points}")
+
+set(common
+  --mode=0
+  --positionQuantizationScale=1
+  --mergeDuplicatedPoints=0
+  --convertPlyColourspace=1
+  --transformType=0
+  --levelOfDetailCount=4
+  --dist2=2
+)
+
+# Runs the encoder and sets out to the list of coded colour sizes
+function(encode out)
+  execute_process(
+    COMMAND ${TMC3} ${common} ${ARGN}
+    WORKING_DIRECTORY ${WORKDIR}
+    RESULT_VARIABLE status
+    OUTPUT_VARIABLE log
+    ERROR_VARIABLE log
+  )
+  if(NOT status EQUAL 0)
+    message(FATAL_ERROR "encoder failed:\n${log}")
+  endif()
+
+  string(REGEX MATCHALL "colors bitstream size [0-9]+" sizes "${log}")
+  string(REGEX REPLACE "colors bitstream size " "" sizes "${sizes}")
+  set(${out} "${sizes}" PARENT_SCOPE)
+endfunction()
+
+encode(realtime
+  --attribute=color
+  --uncompressedDataPath=frame%d.ply
+  --firstFrameNum=1
+  --frameCount=2
+  --compressedStreamPath=realtime.bin
+  --realtimeFrameLatency=0.000001
+)
+
+# Complexity level 2 is equivalent to speed preset 2 with a halved
+# attribute search range.
+encode(level2
+  --attributeSearchRange=64
+  --attribute=color
+  --uncompressedDataPath=frame2.ply
+  --compressedStreamPath=level2.bin
+  --speedPreset=2
+)
+
+list(LENGTH realtime numFrames)
+if(NOT numFrames EQUAL 2)
+  message(FATAL_ERROR "expected two coded frames, got: ${realtime}")
+endif()
+
+list(GET realtime 0 frame1Size)
+list(GET realtime 1 frame2Size)
+
+if(frame1Size EQUAL frame2Size)
+  message(FATAL_ERROR "level change did not alter attribute coding")
+endif()
+
+if(NOT frame2Size EQUAL level2)
+  message(FATAL_ERROR
+    "level 2 frame coded in ${frame2Size} B, expected ${level2} B")
+endif()
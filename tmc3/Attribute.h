@@ -36,6 +36,7 @@
 #pragma once
 
 #include <memory>
+#include <vector>
 
 #include "hls.h"
 #include "PayloadBuffer.h"
@@ -43,6 +44,28 @@
 
 namespace pcc {
 
+//============================================================================
+// An attribute brick that is coded jointly with the bricks of other
+// attributes of the same slice.
+
+struct JointAttributeBrick {
+  const AttributeDescription* desc;
+  const AttributeParameterSet* aps;
+
+  // Encoder: the attribute brick header, and the payload to which the
+  // coded attribute is appended.
+  AttributeBrickHeader abh;
+  PayloadBuffer* payload;
+
+  // Decoder: the coded brick, beginning with the attribute brick header.
+  const PayloadBuffer* buf;
+};
+
+// Indicates if attributes coded using the given parameter sets may be
+// coded using a single RAHT tree traversal.
+bool isRahtJointCodable(
+  const AttributeParameterSet& aps0, const AttributeParameterSet& aps1);
+
 //============================================================================
 
 class AttributeDecoderIntf {
@@ -58,8 +81,28 @@ public:
     const PayloadBuffer&,
     PCCPointSet3& pointCloud) = 0;
 
+  // Generates any state that is shared by all attributes decoded using
+  // the given aps (eg, LoDs).  Once prepared, decode() may be invoked
+  // concurrently for attributes that modify distinct point cloud fields.
+  virtual void prepare(
+    const AttributeParameterSet& aps,
+    int minGeomNodeSizeLog2,
+    const PCCPointSet3& pointCloud) = 0;
+
+  // Decodes a set of RAHT coded attribute bricks using a single traversal
+  // of the transform tree.  Each brick must code a distinct attribute and
+  // all bricks must be jointly codable.
+  virtual void decodeRahtJoint(
+    const SequenceParameterSet& sps,
+    const std::vector<JointAttributeBrick>& bricks,
+    PCCPointSet3& pointCloud) = 0;
+
   // Indicates if the attribute decoder can decode the given aps
   virtual bool isReusable(const AttributeParameterSet& aps) const = 0;
+
+  // Discards any state derived from a previously decoded point cloud,
+  // retaining working memory for reuse with the next point cloud.
+  virtual void reset() = 0;
 };
 
 //----------------------------------------------------------------------------
@@ -67,21 +110,46 @@ public:
 std::unique_ptr<AttributeDecoderIntf> makeAttributeDecoder();
 
 //============================================================================
+// Encoder-only options for attribute coding.  These trade coding efficiency
+// for encoder speed and have no effect on the syntax.
+
+struct AttributeEncOpts {
+  // The maximum number of direct prediction modes evaluated for each point
+  // by the predicting transform.  Negative values evaluate all modes.
+  int predModeMaxCandidates;
+};
+
+//----------------------------------------------------------------------------
 
 class AttributeEncoderIntf {
 public:
   virtual ~AttributeEncoderIntf();
 
+  // The encoder options may differ between invocations.
   virtual void encode(
     const SequenceParameterSet& sps,
+    const AttributeEncOpts& opt,
     const AttributeDescription& desc,
     const AttributeParameterSet& attr_aps,
     const AttributeBrickHeader& abh,
     PCCPointSet3& pointCloud,
     PayloadBuffer* payload) = 0;
 
+  // Encodes a set of RAHT coded attributes using a single traversal of the
+  // transform tree.  Each attribute is appended to the payload of its
+  // brick.  Each brick must code a distinct attribute and all bricks must
+  // be jointly codable.
+  virtual void encodeRahtJoint(
+    const SequenceParameterSet& sps,
+    const std::vector<JointAttributeBrick>& bricks,
+    PCCPointSet3& pointCloud) = 0;
+
   // Indicates if the attribute decoder can decode the given aps
   virtual bool isReusable(const AttributeParameterSet& aps) const = 0;
+
+  // Discards any state derived from a previously encoded point cloud,
+  // retaining working memory for reuse with the next point cloud.
+  virtual void reset() = 0;
 };
 
 //----------------------------------------------------------------------------
@@ -35,6 +35,7 @@
 
 #include "AttributeCommon.h"
 
+#include "Attribute.h"
 #include "PCCTMC3Common.h"
 
 namespace pcc {
@@ -57,8 +58,17 @@ AttributeLods::generate(
     aps, cloud, minGeomNodeSizeLog2, predictors, numPointsInLod, indexes);
 
   assert(predictors.size() == cloud.getPointCount());
-  for (auto& predictor : predictors)
-    predictor.computeWeights();
+}
+
+//----------------------------------------------------------------------------
+
+void
+AttributeLods::clear()
+{
+  // NB: predictors are cleared so as to be value-initialised on reuse
+  predictors.clear();
+  numPointsInLod.clear();
+  indexes.clear();
 }
 
 //----------------------------------------------------------------------------
@@ -110,4 +120,22 @@ AttributeLods::isReusable(const AttributeParameterSet& aps) const
 
 //============================================================================
 
+bool
+isRahtJointCodable(
+  const AttributeParameterSet& aps0, const AttributeParameterSet& aps1)
+{
+  if (aps0.attr_encoding != AttributeEncoding::kRAHTransform)
+    return false;
+
+  if (aps1.attr_encoding != AttributeEncoding::kRAHTransform)
+    return false;
+
+  // The transform tree is common to all attributes, with the exception of
+  // the inter-level prediction.
+  return aps0.raht_prediction_enabled_flag
+    == aps1.raht_prediction_enabled_flag;
+}
+
+//============================================================================
+
 }  // namespace pcc
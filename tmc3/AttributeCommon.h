@@ -51,6 +51,9 @@ struct AttributeLods {
 
   bool empty() const { return numPointsInLod.empty(); };
 
+  // Discards the generated LoDs
+  void clear();
+
   void generate(
     const AttributeParameterSet& aps,
     int minGeomNodeSizeLog2,
@@ -38,6 +38,8 @@
 #include "DualLutCoder.h"
 #include "constants.h"
 #include "entropy.h"
+#include "lifting.h"
+#include "parallel.h"
 #include "io_hls.h"
 #include "RAHT.h"
 #include "FixedPoint.h"
@@ -200,6 +202,16 @@ AttributeDecoder::decode(
   const PayloadBuffer& payload,
   PCCPointSet3& pointCloud)
 {
+  // RAHT decoding of a single attribute is a special case of joint decoding
+  if (attr_aps.attr_encoding == AttributeEncoding::kRAHTransform) {
+    std::vector<JointAttributeBrick> bricks(1);
+    bricks[0].desc = &attr_desc;
+    bricks[0].aps = &attr_aps;
+    bricks[0].buf = &payload;
+    decodeRahtJoint(sps, bricks, pointCloud);
+    return;
+  }
+
   int abhSize;
   AttributeBrickHeader abh = parseAbh(attr_aps, payload, &abhSize);
 
@@ -209,13 +221,12 @@ AttributeDecoder::decode(
   decoder.start(sps, payload.data() + abhSize, payload.size() - abhSize);
 
   // generate LoDs if necessary
-  if (attr_aps.lodParametersPresent() && _lods.empty())
-    _lods.generate(attr_aps, minGeomNodeSizeLog2, pointCloud);
+  prepare(attr_aps, minGeomNodeSizeLog2, pointCloud);
 
   if (attr_desc.attr_num_dimensions == 1) {
     switch (attr_aps.attr_encoding) {
     case AttributeEncoding::kRAHTransform:
-      decodeReflectancesRaht(attr_desc, attr_aps, qpSet, decoder, pointCloud);
+      // decoded by decodeRahtJoint()
       break;
 
     case AttributeEncoding::kPredictingTransform:
@@ -231,7 +242,7 @@ AttributeDecoder::decode(
   } else if (attr_desc.attr_num_dimensions == 3) {
     switch (attr_aps.attr_encoding) {
     case AttributeEncoding::kRAHTransform:
-      decodeColorsRaht(attr_desc, attr_aps, qpSet, decoder, pointCloud);
+      // decoded by decodeRahtJoint()
       break;
 
     case AttributeEncoding::kPredictingTransform:
@@ -255,6 +266,18 @@ AttributeDecoder::decode(
 
 //----------------------------------------------------------------------------
 
+void
+AttributeDecoder::prepare(
+  const AttributeParameterSet& aps,
+  int minGeomNodeSizeLog2,
+  const PCCPointSet3& pointCloud)
+{
+  if (aps.lodParametersPresent() && _lods.empty())
+    _lods.generate(aps, minGeomNodeSizeLog2, pointCloud);
+}
+
+//----------------------------------------------------------------------------
+
 bool
 AttributeDecoder::isReusable(const AttributeParameterSet& aps) const
 {
@@ -263,6 +286,38 @@ AttributeDecoder::isReusable(const AttributeParameterSet& aps) const
 
 //----------------------------------------------------------------------------
 
+void
+AttributeDecoder::reset()
+{
+  _lods.clear();
+}
+
+//----------------------------------------------------------------------------
+
+std::unique_ptr<RahtWorkspace>
+AttributeDecoder::acquireRahtWorkspace()
+{
+  std::lock_guard<std::mutex> lock(_rahtWorkspacesMutex);
+  if (_rahtWorkspaces.empty())
+    return std::unique_ptr<RahtWorkspace>(new RahtWorkspace);
+
+  auto workspace = std::move(_rahtWorkspaces.back());
+  _rahtWorkspaces.pop_back();
+  return workspace;
+}
+
+//----------------------------------------------------------------------------
+
+void
+AttributeDecoder::releaseRahtWorkspace(
+  std::unique_ptr<RahtWorkspace> workspace)
+{
+  std::lock_guard<std::mutex> lock(_rahtWorkspacesMutex);
+  _rahtWorkspaces.push_back(std::move(workspace));
+}
+
+//----------------------------------------------------------------------------
+
 void
 AttributeDecoder::computeReflectancePredictionWeights(
   const AttributeParameterSet& aps,
@@ -279,7 +334,7 @@ AttributeDecoder::computeReflectancePredictionWeights(
     int64_t maxValue = 0;
     for (int i = 0; i < predictor.neighborCount; ++i) {
       const attr_t reflectanceNeighbor = pointCloud.getReflectance(
-        indexes[predictor.neighbors[i].predictorIndex]);
+        indexes[predictor.neighborIndex[i]]);
       if (i == 0 || reflectanceNeighbor < minValue) {
         minValue = reflectanceNeighbor;
       }
@@ -295,6 +350,48 @@ AttributeDecoder::computeReflectancePredictionWeights(
   }
 }
 
+//----------------------------------------------------------------------------
+// Decode the predictors [startIndex, endIndex) of a level of detail.
+//
+// If no predictor refers to another predictor of the same level of detail,
+// all residuals are parsed prior to reconstructing the predictors in
+// parallel.  Otherwise, each predictor is parsed and reconstructed in turn.
+
+template<typename ParseFn, typename ReconstructFn>
+static void
+decodeLod(
+  const std::vector<PCCPredictor>& predictors,
+  size_t startIndex,
+  size_t endIndex,
+  ParseFn& parse,
+  ReconstructFn& reconstruct)
+{
+  bool intraLodReferences = false;
+  for (size_t i = startIndex; i < endIndex && !intraLodReferences; ++i) {
+    const auto& predictor = predictors[i];
+    for (int k = 0; k < predictor.neighborCount; ++k) {
+      const size_t neighborPredIndex = predictor.neighborIndex[k];
+      intraLodReferences |= neighborPredIndex >= startIndex;
+    }
+  }
+
+  if (intraLodReferences) {
+    for (size_t i = startIndex; i < endIndex; ++i) {
+      parse(i);
+      reconstruct(i);
+    }
+    return;
+  }
+
+  for (size_t i = startIndex; i < endIndex; ++i)
+    parse(i);
+
+  parallelFor(startIndex, endIndex, 2048, [&](size_t begin, size_t end) {
+    for (size_t i = begin; i < end; ++i)
+      reconstruct(i);
+  });
+}
+
 //----------------------------------------------------------------------------
 
 void
@@ -307,27 +404,30 @@ AttributeDecoder::decodeReflectancesPred(
 {
   const size_t pointCount = pointCloud.getPointCount();
   const int64_t maxReflectance = (1ll << desc.attr_bitdepth) - 1;
+  std::vector<uint32_t> residuals(pointCount);
   int zero_cnt = decoder.decodeZeroCnt(pointCount);
   int quantLayer = 0;
-  for (size_t predictorIndex = 0; predictorIndex < pointCount;
-       ++predictorIndex) {
-    if (predictorIndex == _lods.numPointsInLod[quantLayer]) {
-      quantLayer = std::min(int(qpSet.layers.size()) - 1, quantLayer + 1);
-    }
-    const uint32_t pointIndex = _lods.indexes[predictorIndex];
-    auto quant = qpSet.quantizers(pointCloud[pointIndex], quantLayer);
-    auto& predictor = _lods.predictors[predictorIndex];
 
+  auto parse = [&](size_t predictorIndex) {
+    auto& predictor = _lods.predictors[predictorIndex];
     computeReflectancePredictionWeights(
       aps, pointCloud, _lods.indexes, predictor, decoder);
-    attr_t& reflectance = pointCloud.getReflectance(pointIndex);
-    uint32_t attValue0 = 0;
+    uint32_t& attValue0 = residuals[predictorIndex];
+    attValue0 = 0;
     if (zero_cnt > 0) {
       zero_cnt--;
     } else {
       attValue0 = decoder.decode();
       zero_cnt = decoder.decodeZeroCnt(pointCount);
     }
+  };
+
+  auto reconstruct = [&](size_t predictorIndex) {
+    const uint32_t pointIndex = _lods.indexes[predictorIndex];
+    auto quant = qpSet.quantizers(pointCloud[pointIndex], quantLayer);
+    const auto& predictor = _lods.predictors[predictorIndex];
+    attr_t& reflectance = pointCloud.getReflectance(pointIndex);
+    const uint32_t attValue0 = residuals[predictorIndex];
     const int64_t quantPredAttValue =
       predictor.predictReflectance(pointCloud, _lods.indexes);
     const int64_t delta = divExp2RoundHalfUp(
@@ -335,6 +435,19 @@ AttributeDecoder::decodeReflectancesPred(
     const int64_t reconstructedQuantAttValue = quantPredAttValue + delta;
     reflectance =
       attr_t(PCCClip(reconstructedQuantAttValue, int64_t(0), maxReflectance));
+  };
+
+  for (size_t lodIndex = 0, startIndex = 0; startIndex < pointCount;
+       ++lodIndex) {
+    const size_t endIndex = _lods.numPointsInLod[lodIndex];
+    if (startIndex == endIndex)
+      continue;
+
+    if (startIndex == _lods.numPointsInLod[quantLayer]) {
+      quantLayer = std::min(int(qpSet.layers.size()) - 1, quantLayer + 1);
+    }
+    decodeLod(_lods.predictors, startIndex, endIndex, parse, reconstruct);
+    startIndex = endIndex;
   }
 }
 
@@ -355,7 +468,7 @@ AttributeDecoder::computeColorPredictionWeights(
     int64_t maxValue[3] = {0, 0, 0};
     for (int i = 0; i < predictor.neighborCount; ++i) {
       const Vec3<attr_t> colorNeighbor =
-        pointCloud.getColor(indexes[predictor.neighbors[i].predictorIndex]);
+        pointCloud.getColor(indexes[predictor.neighborIndex[i]]);
       for (size_t k = 0; k < 3; ++k) {
         if (i == 0 || colorNeighbor[k] < minValue[k]) {
           minValue[k] = colorNeighbor[k];
@@ -391,27 +504,29 @@ AttributeDecoder::decodeColorsPred(
                         (1 << desc.attr_bitdepth_secondary) - 1,
                         (1 << desc.attr_bitdepth_secondary) - 1};
 
-  uint32_t values[3];
+  std::vector<Vec3<uint32_t>> residuals(pointCount);
   int zero_cnt = decoder.decodeZeroCnt(pointCount);
   int quantLayer = 0;
-  for (size_t predictorIndex = 0; predictorIndex < pointCount;
-       ++predictorIndex) {
-    if (predictorIndex == _lods.numPointsInLod[quantLayer]) {
-      quantLayer = std::min(int(qpSet.layers.size()) - 1, quantLayer + 1);
-    }
-    const uint32_t pointIndex = _lods.indexes[predictorIndex];
-    auto quant = qpSet.quantizers(pointCloud[pointIndex], quantLayer);
-    auto& predictor = _lods.predictors[predictorIndex];
 
+  auto parse = [&](size_t predictorIndex) {
+    auto& predictor = _lods.predictors[predictorIndex];
     computeColorPredictionWeights(
       aps, pointCloud, _lods.indexes, predictor, decoder);
+    auto& values = residuals[predictorIndex];
     if (zero_cnt > 0) {
       values[0] = values[1] = values[2] = 0;
       zero_cnt--;
     } else {
-      decoder.decode(values);
+      decoder.decode(values.begin());
       zero_cnt = decoder.decodeZeroCnt(pointCount);
     }
+  };
+
+  auto reconstruct = [&](size_t predictorIndex) {
+    const uint32_t pointIndex = _lods.indexes[predictorIndex];
+    auto quant = qpSet.quantizers(pointCloud[pointIndex], quantLayer);
+    const auto& predictor = _lods.predictors[predictorIndex];
+    const auto& values = residuals[predictorIndex];
     Vec3<attr_t>& color = pointCloud.getColor(pointIndex);
     const Vec3<attr_t> predictedColor =
       predictor.predictColor(pointCloud, _lods.indexes);
@@ -427,81 +542,68 @@ AttributeDecoder::decodeColorsPred(
       if (!k && aps.inter_component_prediction_enabled_flag)
         residual0 = residual;
     }
+  };
+
+  for (size_t lodIndex = 0, startIndex = 0; startIndex < pointCount;
+       ++lodIndex) {
+    const size_t endIndex = _lods.numPointsInLod[lodIndex];
+    if (startIndex == endIndex)
+      continue;
+
+    if (startIndex == _lods.numPointsInLod[quantLayer]) {
+      quantLayer = std::min(int(qpSet.layers.size()) - 1, quantLayer + 1);
+    }
+    decodeLod(_lods.predictors, startIndex, endIndex, parse, reconstruct);
+    startIndex = endIndex;
   }
 }
 
 //----------------------------------------------------------------------------
 
-void
-AttributeDecoder::decodeReflectancesRaht(
-  const AttributeDescription& desc,
-  const AttributeParameterSet& aps,
-  const QpSet& qpSet,
-  PCCResidualsDecoder& decoder,
-  PCCPointSet3& pointCloud)
-{
-  const int voxelCount = int(pointCloud.getPointCount());
-  std::vector<MortonCodeWithIndex> packedVoxel(voxelCount);
-  for (int n = 0; n < voxelCount; n++) {
-    packedVoxel[n].mortonCode = mortonAddr(pointCloud[n]);
-    packedVoxel[n].index = n;
-  }
-  sort(packedVoxel.begin(), packedVoxel.end());
-
-  // Morton codes
-  int64_t* mortonCode = new int64_t[voxelCount];
-  for (int n = 0; n < voxelCount; n++) {
-    mortonCode[n] = packedVoxel[n].mortonCode;
-  }
+// Entropy decodes the coefficients of a single RAHT coded attribute.
+// The coefficients of each of the @numDims attribute dimensions are stored
+// in planar arrays of @voxelCount coefficients.
 
-  // Entropy decode
-  const int attribCount = 1;
-  int* coefficients = new int[attribCount * voxelCount];
+static void
+decodeRahtCoefficients(
+  int numDims, int voxelCount, PCCResidualsDecoder& decoder, int* coefficients)
+{
   int zero_cnt = decoder.decodeZeroCnt(voxelCount);
   for (int n = 0; n < voxelCount; ++n) {
-    uint32_t value = 0;
+    uint32_t values[3];
     if (zero_cnt > 0) {
+      values[0] = values[1] = values[2] = 0;
       zero_cnt--;
     } else {
-      value = decoder.decode();
+      if (numDims == 1)
+        values[0] = decoder.decode();
+      else
+        decoder.decode(values);
       zero_cnt = decoder.decodeZeroCnt(voxelCount);
     }
-    coefficients[n] = UIntToInt(value);
-  }
-
-  int* attributes = new int[attribCount * voxelCount];
-  auto quantLayers = qpSet.quantizerLayers();
-  regionAdaptiveHierarchicalInverseTransform(
-    aps.raht_prediction_enabled_flag, quantLayers, mortonCode, attributes,
-    attribCount, voxelCount, coefficients);
-
-  const int64_t maxReflectance = (1 << desc.attr_bitdepth) - 1;
-  const int64_t minReflectance = 0;
-  for (int n = 0; n < voxelCount; n++) {
-    int64_t val = attributes[attribCount * n];
-    const attr_t reflectance =
-      attr_t(PCCClip(val, minReflectance, maxReflectance));
-    pointCloud.setReflectance(packedVoxel[n].index, reflectance);
+    for (int d = 0; d < numDims; ++d) {
+      coefficients[voxelCount * d + n] = UIntToInt(values[d]);
+    }
   }
-
-  // De-allocate arrays.
-  delete[] mortonCode;
-  delete[] attributes;
-  delete[] coefficients;
 }
 
 //----------------------------------------------------------------------------
 
 void
-AttributeDecoder::decodeColorsRaht(
-  const AttributeDescription& desc,
-  const AttributeParameterSet& aps,
-  const QpSet& qpSet,
-  PCCResidualsDecoder& decoder,
+AttributeDecoder::decodeRahtJoint(
+  const SequenceParameterSet& sps,
+  const std::vector<JointAttributeBrick>& bricks,
   PCCPointSet3& pointCloud)
 {
+  assert(!bricks.empty());
+  const auto& aps = *bricks.front().aps;
+
+  // NB: bricks may be decoded concurrently, each with its own workspace
+  auto workspace = acquireRahtWorkspace();
+
   const int voxelCount = int(pointCloud.getPointCount());
-  std::vector<MortonCodeWithIndex> packedVoxel(voxelCount);
+  auto& packedVoxel = workspace->packedVoxel;
+  packedVoxel.resize(voxelCount);
   for (int n = 0; n < voxelCount; n++) {
     packedVoxel[n].mortonCode = mortonAddr(pointCloud[n]);
     packedVoxel[n].index = n;
@@ -509,55 +611,80 @@ AttributeDecoder::decodeColorsRaht(
   sort(packedVoxel.begin(), packedVoxel.end());
 
   // Morton codes
-  int64_t* mortonCode = new int64_t[voxelCount];
+  auto& mortonCode = workspace->mortonCode;
+  mortonCode.resize(voxelCount);
   for (int n = 0; n < voxelCount; n++) {
     mortonCode[n] = packedVoxel[n].mortonCode;
   }
 
-  // Entropy decode
-  const int attribCount = 3;
-  int zero_cnt = decoder.decodeZeroCnt(voxelCount);
-  int* coefficients = new int[attribCount * voxelCount];
-
-  for (int n = 0; n < voxelCount; ++n) {
-    uint32_t values[3];
-    if (zero_cnt > 0) {
-      values[0] = values[1] = values[2] = 0;
-      zero_cnt--;
-    } else {
-      decoder.decode(values);
-      zero_cnt = decoder.decodeZeroCnt(voxelCount);
-    }
-    for (int d = 0; d < attribCount; ++d) {
-      coefficients[voxelCount * d + n] = UIntToInt(values[d]);
-    }
+  // Each attribute occupies a contiguous set of transform channels
+  int attribCount = 0;
+  for (const auto& brick : bricks)
+    attribCount += brick.desc->attr_num_dimensions;
+
+  // Entropy decode each brick
+  std::vector<RahtQuantLayers> quantLayers;
+  auto& coefficients = workspace->coefficients;
+  coefficients.resize(attribCount * voxelCount);
+  for (const auto& brick : bricks) {
+    assert(isRahtJointCodable(aps, *brick.aps));
+    const auto& payload = *brick.buf;
+    const int numDims = brick.desc->attr_num_dimensions;
+    assert(numDims == 1 || numDims == 3);
+
+    int abhSize;
+    AttributeBrickHeader abh = parseAbh(*brick.aps, payload, &abhSize);
+    int channel = int(quantLayers.size());
+    appendRahtQuantLayers(deriveQpSet(*brick.aps, abh), numDims, &quantLayers);
+
+    PCCResidualsDecoder decoder;
+    decoder.start(sps, payload.data() + abhSize, payload.size() - abhSize);
+    decodeRahtCoefficients(
+      numDims, voxelCount, decoder, &coefficients[voxelCount * channel]);
+    decoder.stop();
   }
 
-  int* attributes = new int[attribCount * voxelCount];
-  auto quantLayers = qpSet.quantizerLayers();
+  auto& attributes = workspace->attributes;
+  attributes.resize(attribCount * voxelCount);
   regionAdaptiveHierarchicalInverseTransform(
-    aps.raht_prediction_enabled_flag, quantLayers, mortonCode, attributes,
-    attribCount, voxelCount, coefficients);
+    aps.raht_prediction_enabled_flag, quantLayers, mortonCode.data(),
+    attributes.data(), attribCount, voxelCount, coefficients.data(),
+    workspace.get());
+
+  int channel = 0;
+  for (const auto& brick : bricks) {
+    const auto& desc = *brick.desc;
+
+    if (desc.attr_num_dimensions == 1) {
+      const int64_t maxReflectance = (1 << desc.attr_bitdepth) - 1;
+      const int64_t minReflectance = 0;
+      for (int n = 0; n < voxelCount; n++) {
+        int64_t val = attributes[attribCount * n + channel];
+        const attr_t reflectance =
+          attr_t(PCCClip(val, minReflectance, maxReflectance));
+        pointCloud.setReflectance(packedVoxel[n].index, reflectance);
+      }
+    } else {
+      Vec3<int> clipMax{(1 << desc.attr_bitdepth) - 1,
+                        (1 << desc.attr_bitdepth_secondary) - 1,
+                        (1 << desc.attr_bitdepth_secondary) - 1};
 
-  Vec3<int> clipMax{(1 << desc.attr_bitdepth) - 1,
-                    (1 << desc.attr_bitdepth_secondary) - 1,
-                    (1 << desc.attr_bitdepth_secondary) - 1};
+      for (int n = 0; n < voxelCount; n++) {
+        const int r = attributes[attribCount * n + channel];
+        const int g = attributes[attribCount * n + channel + 1];
+        const int b = attributes[attribCount * n + channel + 2];
+        Vec3<attr_t> color;
+        color[0] = attr_t(PCCClip(r, 0, clipMax[0]));
+        color[1] = attr_t(PCCClip(g, 0, clipMax[1]));
+        color[2] = attr_t(PCCClip(b, 0, clipMax[2]));
+        pointCloud.setColor(packedVoxel[n].index, color);
+      }
+    }
 
-  for (int n = 0; n < voxelCount; n++) {
-    const int r = attributes[attribCount * n];
-    const int g = attributes[attribCount * n + 1];
-    const int b = attributes[attribCount * n + 2];
-    Vec3<attr_t> color;
-    color[0] = attr_t(PCCClip(r, 0, clipMax[0]));
-    color[1] = attr_t(PCCClip(g, 0, clipMax[1]));
-    color[2] = attr_t(PCCClip(b, 0, clipMax[2]));
-    pointCloud.setColor(packedVoxel[n].index, color);
+    channel += desc.attr_num_dimensions;
   }
 
-  // De-allocate arrays.
-  delete[] mortonCode;
-  delete[] attributes;
-  delete[] coefficients;
+  releaseRahtWorkspace(std::move(workspace));
 }
 
 //----------------------------------------------------------------------------
@@ -584,8 +711,9 @@ AttributeDecoder::decodeColorsLift(
   }
 
   const size_t lodCount = _lods.numPointsInLod.size();
-  std::vector<Vec3<int64_t>> colors;
-  colors.resize(pointCount);
+  std::vector<int64_t> colors[3];
+  for (auto& component : colors)
+    component.resize(pointCount);
 
   // NB: when partially decoding, the truncated unary limit for zero_run
   // must be the original value.  geom_num_points may be the case.  However,
@@ -613,24 +741,23 @@ AttributeDecoder::decodeColorsLift(
     }
 
     const int64_t quantWeight = weights[predictorIndex];
-    auto& color = colors[predictorIndex];
     const int64_t delta = UIntToInt(values[0]);
     const int64_t reconstructedDelta = quant[0].scale(delta);
-    color[0] = reconstructedDelta / quantWeight;
+    colors[0][predictorIndex] = reconstructedDelta / quantWeight;
     for (size_t d = 1; d < 3; ++d) {
       const int64_t delta = UIntToInt(values[d]);
       const int64_t reconstructedDelta = quant[1].scale(delta);
-      color[d] = reconstructedDelta / quantWeight;
+      colors[d][predictorIndex] = reconstructedDelta / quantWeight;
     }
   }
 
   // reconstruct
+  LiftingNeighbours neighbours(_lods.predictors);
   for (size_t lodIndex = 1; lodIndex < lodCount; ++lodIndex) {
     const size_t startIndex = _lods.numPointsInLod[lodIndex - 1];
     const size_t endIndex = _lods.numPointsInLod[lodIndex];
-    PCCLiftUpdate(
-      _lods.predictors, weights, startIndex, endIndex, false, colors);
-    PCCLiftPredict(_lods.predictors, startIndex, endIndex, false, colors);
+    PCCLiftUpdate(neighbours, weights, startIndex, endIndex, false, 3, colors);
+    PCCLiftPredict(neighbours, startIndex, endIndex, false, 3, colors);
   }
 
   Vec3<int64_t> clipMax{(1 << desc.attr_bitdepth) - 1,
@@ -638,11 +765,11 @@ AttributeDecoder::decodeColorsLift(
                         (1 << desc.attr_bitdepth_secondary) - 1};
 
   for (size_t f = 0; f < pointCount; ++f) {
-    const auto color0 =
-      divExp2RoundHalfInf(colors[f], kFixedPointAttributeShift);
     Vec3<attr_t> color;
     for (size_t d = 0; d < 3; ++d) {
-      color[d] = attr_t(PCCClip(color0[d], int64_t(0), clipMax[d]));
+      const int64_t color0 =
+        divExp2RoundHalfInf(colors[d][f], kFixedPointAttributeShift);
+      color[d] = attr_t(PCCClip(color0, int64_t(0), clipMax[d]));
     }
     pointCloud.setColor(_lods.indexes[f], color);
   }
@@ -706,13 +833,13 @@ AttributeDecoder::decodeReflectancesLift(
   }
 
   // reconstruct
+  LiftingNeighbours neighbours(_lods.predictors);
   for (size_t lodIndex = 1; lodIndex < lodCount; ++lodIndex) {
     const size_t startIndex = _lods.numPointsInLod[lodIndex - 1];
     const size_t endIndex = _lods.numPointsInLod[lodIndex];
     PCCLiftUpdate(
-      _lods.predictors, weights, startIndex, endIndex, false, reflectances);
-    PCCLiftPredict(
-      _lods.predictors, startIndex, endIndex, false, reflectances);
+      neighbours, weights, startIndex, endIndex, false, 1, &reflectances);
+    PCCLiftPredict(neighbours, startIndex, endIndex, false, 1, &reflectances);
   }
   const int64_t maxReflectance = (1 << desc.attr_bitdepth) - 1;
   for (size_t f = 0; f < pointCount; ++f) {
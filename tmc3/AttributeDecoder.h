@@ -35,13 +35,17 @@
 
 #pragma once
 
+#include <memory>
+#include <mutex>
 #include <stdint.h>
+#include <vector>
 
 #include "Attribute.h"
 #include "AttributeCommon.h"
 #include "PayloadBuffer.h"
 #include "PCCTMC3Common.h"
 #include "quantization.h"
+#include "RAHT.h"
 
 namespace pcc {
 
@@ -63,8 +67,20 @@ public:
     const PayloadBuffer&,
     PCCPointSet3& pointCloud) override;
 
+  void prepare(
+    const AttributeParameterSet& aps,
+    int minGeomNodeSizeLog2,
+    const PCCPointSet3& pointCloud) override;
+
+  void decodeRahtJoint(
+    const SequenceParameterSet& sps,
+    const std::vector<JointAttributeBrick>& bricks,
+    PCCPointSet3& pointCloud) override;
+
   bool isReusable(const AttributeParameterSet& aps) const override;
 
+  void reset() override;
+
 protected:
   // todo(df): consider alternative encapsulation
 
@@ -100,20 +116,6 @@ protected:
     PCCResidualsDecoder& decoder,
     PCCPointSet3& pointCloud);
 
-  void decodeReflectancesRaht(
-    const AttributeDescription& desc,
-    const AttributeParameterSet& aps,
-    const QpSet& qpSet,
-    PCCResidualsDecoder& decoder,
-    PCCPointSet3& pointCloud);
-
-  void decodeColorsRaht(
-    const AttributeDescription& desc,
-    const AttributeParameterSet& aps,
-    const QpSet& qpSet,
-    PCCResidualsDecoder& decoder,
-    PCCPointSet3& pointCloud);
-
   static void computeColorPredictionWeights(
     const AttributeParameterSet& aps,
     const PCCPointSet3& pointCloud,
@@ -128,8 +130,16 @@ protected:
     PCCPredictor& predictor,
     PCCResidualsDecoder& decoder);
 
+  std::unique_ptr<RahtWorkspace> acquireRahtWorkspace();
+  void releaseRahtWorkspace(std::unique_ptr<RahtWorkspace> workspace);
+
 private:
   AttributeLods _lods;
+
+  // Working memory for RAHT, retained between point clouds.  Workspaces
+  // not in use by a (possibly concurrent) transform are pooled.
+  std::mutex _rahtWorkspacesMutex;
+  std::vector<std::unique_ptr<RahtWorkspace>> _rahtWorkspaces;
 };
 
 //============================================================================
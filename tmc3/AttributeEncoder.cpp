@@ -39,13 +39,16 @@
 #include "DualLutCoder.h"
 #include "constants.h"
 #include "entropy.h"
+#include "lifting.h"
 #include "quantization.h"
 #include "RAHT.h"
 #include "FixedPoint.h"
 
 // todo(df): promote to per-attribute encoder parameter
-static const double kAttrPredLambdaR = 0.01;
-static const double kAttrPredLambdaC = 0.01;
+// NB: the multipliers are expressed as reciprocals (1/lambda) so that the
+//     prediction mode cost may be evaluated exactly using integers.
+static const int64_t kAttrPredLambdaRecipR = 100;
+static const int64_t kAttrPredLambdaRecipC = 100;
 
 namespace pcc {
 //============================================================================
@@ -186,145 +189,6 @@ PCCResidualsEncoder::encode(uint32_t value)
   encodeSymbol(value - 1, 0, 0, 0);
 }
 
-//============================================================================
-// An encapsulation of the entropy coding methods used in attribute coding
-
-struct PCCResidualsEntropyEstimator {
-  size_t freq0[kAttributeResidualAlphabetSize + 1];
-  size_t freq1[kAttributeResidualAlphabetSize + 1];
-  size_t symbolCount0;
-  size_t symbolCount1;
-  size_t isZero0Count;
-  size_t isZero1Count;
-  PCCResidualsEntropyEstimator() { init(); }
-  void init();
-  double bitsDetail(
-    const uint32_t detail,
-    const size_t symbolCount,
-    const size_t* const freq) const;
-  double bits(const uint32_t value0) const;
-  void update(const uint32_t value0);
-  double bits(
-    const uint32_t value0, const uint32_t value1, const uint32_t value2) const;
-  void
-  update(const uint32_t value0, const uint32_t value1, const uint32_t value2);
-};
-
-//----------------------------------------------------------------------------
-
-void
-PCCResidualsEntropyEstimator::init()
-{
-  for (size_t i = 0; i <= kAttributeResidualAlphabetSize; ++i) {
-    freq0[i] = 1;
-    freq1[i] = 1;
-  }
-  symbolCount0 = kAttributeResidualAlphabetSize + 1;
-  symbolCount1 = kAttributeResidualAlphabetSize + 1;
-  isZero1Count = isZero0Count = symbolCount0 / 2;
-}
-
-//----------------------------------------------------------------------------
-
-double
-PCCResidualsEntropyEstimator::bitsDetail(
-  const uint32_t detail,
-  const size_t symbolCount,
-  const size_t* const freq) const
-{
-  const uint32_t detailClipped =
-    std::min(detail, uint32_t(kAttributeResidualAlphabetSize));
-  const double pDetail =
-    PCCClip(double(freq[detailClipped]) / symbolCount, 0.001, 0.999);
-  double bits = -log2(pDetail);
-  if (detail >= kAttributeResidualAlphabetSize) {
-    const double x = double(detail) - double(kAttributeResidualAlphabetSize);
-    bits += 2.0 * std::floor(log2(x + 1.0)) + 1.0;
-  }
-  return bits;
-}
-
-//----------------------------------------------------------------------------
-
-double
-PCCResidualsEntropyEstimator::bits(const uint32_t value0) const
-{
-  const bool isZero0 = value0 == 0;
-  const double pIsZero0 = isZero0
-    ? double(isZero0Count) / symbolCount0
-    : double(symbolCount0 - isZero0Count) / symbolCount0;
-  double bits = -log2(PCCClip(pIsZero0, 0.001, 0.999));
-  if (!isZero0) {
-    bits += bitsDetail(value0 - 1, symbolCount0, freq0);
-  }
-  return bits;
-}
-
-//----------------------------------------------------------------------------
-
-void
-PCCResidualsEntropyEstimator::update(const uint32_t value0)
-{
-  const bool isZero0 = value0 == 0;
-  ++symbolCount0;
-  if (!isZero0) {
-    ++freq0[std::min(value0 - 1, uint32_t(kAttributeResidualAlphabetSize))];
-  } else {
-    ++isZero0Count;
-  }
-}
-
-//----------------------------------------------------------------------------
-
-double
-PCCResidualsEntropyEstimator::bits(
-  const uint32_t value0, const uint32_t value1, const uint32_t value2) const
-{
-  const bool isZero0 = value0 == 0;
-  const double pIsZero0 = isZero0
-    ? double(isZero0Count) / symbolCount0
-    : double(symbolCount0 - isZero0Count) / symbolCount0;
-  double bits = -log2(PCCClip(pIsZero0, 0.001, 0.999));
-  if (!isZero0) {
-    bits += bitsDetail(value0 - 1, symbolCount0, freq0);
-  }
-
-  const bool isZero1 = value1 == 0 && value2 == 0;
-  const double pIsZero1 = isZero1
-    ? double(isZero1Count) / symbolCount0
-    : double(symbolCount0 - isZero1Count) / symbolCount0;
-  bits -= log2(PCCClip(pIsZero1, 0.001, 0.999));
-  if (!isZero1) {
-    bits += bitsDetail(value1, symbolCount1, freq1);
-    bits += bitsDetail(value2, symbolCount1, freq1);
-  }
-  return bits;
-}
-
-//----------------------------------------------------------------------------
-
-void
-PCCResidualsEntropyEstimator::update(
-  const uint32_t value0, const uint32_t value1, const uint32_t value2)
-{
-  const bool isZero0 = value0 == 0;
-  ++symbolCount0;
-  if (!isZero0) {
-    ++freq0[std::min(value0 - 1, uint32_t(kAttributeResidualAlphabetSize))];
-  } else {
-    ++isZero0Count;
-  }
-
-  const bool isZero1 = value1 == 0 && value2 == 0;
-  symbolCount1 += 2;
-  if (!isZero1) {
-    ++freq1[std::min(value1, uint32_t(kAttributeResidualAlphabetSize))];
-    ++freq1[std::min(value2, uint32_t(kAttributeResidualAlphabetSize))];
-  } else {
-    ++isZero1Count;
-  }
-}
-
 //============================================================================
 // AttributeEncoderIntf
 
@@ -345,12 +209,26 @@ makeAttributeEncoder()
 void
 AttributeEncoder::encode(
   const SequenceParameterSet& sps,
+  const AttributeEncOpts& opt,
   const AttributeDescription& desc,
   const AttributeParameterSet& attr_aps,
   const AttributeBrickHeader& abh,
   PCCPointSet3& pointCloud,
   PayloadBuffer* payload)
 {
+  // RAHT coding of a single attribute is a special case of joint coding
+  if (attr_aps.attr_encoding == AttributeEncoding::kRAHTransform) {
+    std::vector<JointAttributeBrick> bricks(1);
+    bricks[0].desc = &desc;
+    bricks[0].aps = &attr_aps;
+    bricks[0].abh = abh;
+    bricks[0].payload = payload;
+    encodeRahtJoint(sps, bricks, pointCloud);
+    return;
+  }
+
+  _opt = opt;
+
   QpSet qpSet = deriveQpSet(attr_aps, abh);
 
   PCCResidualsEncoder encoder;
@@ -363,8 +241,7 @@ AttributeEncoder::encode(
   if (desc.attr_num_dimensions == 1) {
     switch (attr_aps.attr_encoding) {
     case AttributeEncoding::kRAHTransform:
-      encodeReflectancesTransformRaht(
-        desc, attr_aps, qpSet, pointCloud, encoder);
+      // coded by encodeRahtJoint()
       break;
 
     case AttributeEncoding::kPredictingTransform:
@@ -378,7 +255,7 @@ AttributeEncoder::encode(
   } else if (desc.attr_num_dimensions == 3) {
     switch (attr_aps.attr_encoding) {
     case AttributeEncoding::kRAHTransform:
-      encodeColorsTransformRaht(desc, attr_aps, qpSet, pointCloud, encoder);
+      // coded by encodeRahtJoint()
       break;
 
     case AttributeEncoding::kPredictingTransform:
@@ -409,6 +286,14 @@ AttributeEncoder::isReusable(const AttributeParameterSet& aps) const
 
 //----------------------------------------------------------------------------
 
+void
+AttributeEncoder::reset()
+{
+  _lods.clear();
+}
+
+//----------------------------------------------------------------------------
+
 int64_t
 AttributeEncoder::computeReflectanceResidual(
   const uint64_t reflectance,
@@ -425,7 +310,7 @@ AttributeEncoder::computeReflectanceResidual(
 
 //----------------------------------------------------------------------------
 
-void
+int64_t
 AttributeEncoder::computeReflectancePredictionWeights(
   const AttributeParameterSet& aps,
   const PCCPointSet3& pointCloud,
@@ -433,17 +318,16 @@ AttributeEncoder::computeReflectancePredictionWeights(
   const uint32_t predictorIndex,
   PCCPredictor& predictor,
   PCCResidualsEncoder& encoder,
-  PCCResidualsEntropyEstimator& context,
-  const Quantizer& quant)
+  const Quantizer& quant) const
 {
   predictor.predMode = 0;
-  predictor.maxDiff = 0;
+  int64_t maxDiff = 0;
   if (predictor.neighborCount > 1) {
     int64_t minValue = 0;
     int64_t maxValue = 0;
     for (size_t i = 0; i < predictor.neighborCount; ++i) {
       const uint64_t reflectanceNeighbor = pointCloud.getReflectance(
-        indexesLOD[predictor.neighbors[i].predictorIndex]);
+        indexesLOD[predictor.neighborIndex[i]]);
       if (i == 0 || reflectanceNeighbor < minValue) {
         minValue = reflectanceNeighbor;
       }
@@ -451,8 +335,7 @@ AttributeEncoder::computeReflectancePredictionWeights(
         maxValue = reflectanceNeighbor;
       }
     }
-    const int64_t maxDiff = maxValue - minValue;
-    predictor.maxDiff = maxDiff;
+    maxDiff = maxValue - minValue;
     if (maxDiff >= aps.adaptive_prediction_threshold) {
       uint64_t attrValue =
         pointCloud.getReflectance(indexesLOD[predictorIndex]);
@@ -463,32 +346,41 @@ AttributeEncoder::computeReflectancePredictionWeights(
       int64_t attrResidualQuant =
         computeReflectanceResidual(attrValue, attrPred, quant);
 
-      double best_score = attrResidualQuant
-        + kAttrPredLambdaR * (quant.stepSize() >> kFixedPointAttributeShift);
+      // the cost of each mode, scaled by 1/lambda
+      const int64_t idxCost = quant.stepSize() >> kFixedPointAttributeShift;
+      int64_t best_score = attrResidualQuant * kAttrPredLambdaRecipR + idxCost;
 
-      for (int i = 0; i < predictor.neighborCount; i++) {
+      // NB: since each subsequent mode costs more to signal, no mode can
+      //     improve upon a zero residual.
+      bool isBestExact = attrResidualQuant == 0;
+
+      for (int i = 0; i < predictor.neighborCount && !isBestExact; i++) {
         if (i == aps.max_num_direct_predictors)
           break;
 
+        if (i == _opt.predModeMaxCandidates)
+          break;
+
         attrPred = pointCloud.getReflectance(
-          indexesLOD[predictor.neighbors[i].predictorIndex]);
+          indexesLOD[predictor.neighborIndex[i]]);
         attrResidualQuant =
           computeReflectanceResidual(attrValue, attrPred, quant);
 
-        double idxBits = i + (i == aps.max_num_direct_predictors - 1 ? 1 : 2);
-        double score = attrResidualQuant
-          + idxBits * kAttrPredLambdaR
-            * (quant.stepSize() >> kFixedPointAttributeShift);
+        int idxBits = i + (i == aps.max_num_direct_predictors - 1 ? 1 : 2);
+        int64_t score =
+          attrResidualQuant * kAttrPredLambdaRecipR + idxBits * idxCost;
 
         if (score < best_score) {
           best_score = score;
           predictor.predMode = i + 1;
+          isBestExact = attrResidualQuant == 0;
           // NB: setting predictor.neighborCount = 1 will cause issues
           // with reconstruction.
         }
       }
     }
   }
+  return maxDiff;
 }
 
 //----------------------------------------------------------------------------
@@ -503,12 +395,12 @@ AttributeEncoder::encodeReflectancesPred(
 {
   const uint32_t pointCount = pointCloud.getPointCount();
   const int64_t clipMax = (1ll << desc.attr_bitdepth) - 1;
-  PCCResidualsEntropyEstimator context;
   int zero_cnt = 0;
   std::vector<int> zerorun;
   zerorun.reserve(pointCount);
   std::vector<uint32_t> residual;
   residual.resize(pointCount);
+  std::vector<bool> isPredModeCoded(pointCount);
 
   int quantLayer = 0;
   for (size_t predictorIndex = 0; predictorIndex < pointCount;
@@ -520,9 +412,11 @@ AttributeEncoder::encodeReflectancesPred(
     auto quant = qpSet.quantizers(pointCloud[pointIndex], quantLayer);
     auto& predictor = _lods.predictors[predictorIndex];
 
-    computeReflectancePredictionWeights(
+    int64_t maxDiff = computeReflectancePredictionWeights(
       aps, pointCloud, _lods.indexes, predictorIndex, predictor, encoder,
-      context, quant[0]);
+      quant[0]);
+    isPredModeCoded[predictorIndex] =
+      maxDiff >= aps.adaptive_prediction_threshold;
 
     const uint64_t reflectance = pointCloud.getReflectance(pointIndex);
     const attr_t predictedReflectance =
@@ -557,7 +451,7 @@ AttributeEncoder::encodeReflectancesPred(
   for (size_t predictorIndex = 0; predictorIndex < pointCount;
        ++predictorIndex) {
     auto& predictor = _lods.predictors[predictorIndex];
-    if (predictor.maxDiff >= aps.adaptive_prediction_threshold) {
+    if (isPredModeCoded[predictorIndex]) {
       encoder.encodePredMode(
         predictor.predMode, aps.max_num_direct_predictors);
     }
@@ -598,7 +492,7 @@ AttributeEncoder::computeColorResiduals(
 
 //----------------------------------------------------------------------------
 
-void
+int64_t
 AttributeEncoder::computeColorPredictionWeights(
   const AttributeParameterSet& aps,
   const PCCPointSet3& pointCloud,
@@ -606,16 +500,15 @@ AttributeEncoder::computeColorPredictionWeights(
   const uint32_t predictorIndex,
   PCCPredictor& predictor,
   PCCResidualsEncoder& encoder,
-  PCCResidualsEntropyEstimator& context,
-  const Quantizers& quant)
+  const Quantizers& quant) const
 {
-  predictor.maxDiff = 0;
+  int64_t maxDiff = 0;
   if (predictor.neighborCount > 1) {
     int64_t minValue[3] = {0, 0, 0};
     int64_t maxValue[3] = {0, 0, 0};
     for (int i = 0; i < predictor.neighborCount; ++i) {
       const Vec3<attr_t> colorNeighbor =
-        pointCloud.getColor(indexesLOD[predictor.neighbors[i].predictorIndex]);
+        pointCloud.getColor(indexesLOD[predictor.neighborIndex[i]]);
       for (size_t k = 0; k < 3; ++k) {
         if (i == 0 || colorNeighbor[k] < minValue[k]) {
           minValue[k] = colorNeighbor[k];
@@ -625,10 +518,9 @@ AttributeEncoder::computeColorPredictionWeights(
         }
       }
     }
-    const int64_t maxDiff = (std::max)(
+    maxDiff = (std::max)(
       maxValue[2] - minValue[2],
       (std::max)(maxValue[0] - minValue[0], maxValue[1] - minValue[1]));
-    predictor.maxDiff = maxDiff;
 
     if (maxDiff >= aps.adaptive_prediction_threshold) {
       Vec3<attr_t> attrValue = pointCloud.getColor(indexesLOD[predictorIndex]);
@@ -639,34 +531,45 @@ AttributeEncoder::computeColorPredictionWeights(
       Vec3<int64_t> attrResidualQuant =
         computeColorResiduals(attrValue, attrPred, quant);
 
-      double best_score = attrResidualQuant[0] + attrResidualQuant[1]
-        + attrResidualQuant[2]
-        + kAttrPredLambdaC
-          * (double)(quant[0].stepSize() >> kFixedPointAttributeShift);
+      // the cost of each mode, scaled by 1/lambda
+      const int64_t idxCost = quant[0].stepSize() >> kFixedPointAttributeShift;
+      int64_t best_score = kAttrPredLambdaRecipC
+          * (attrResidualQuant[0] + attrResidualQuant[1]
+             + attrResidualQuant[2])
+        + idxCost;
+
+      // NB: since each subsequent mode costs more to signal, no mode can
+      //     improve upon a zero residual.
+      bool isBestExact = attrResidualQuant == 0;
 
-      for (int i = 0; i < predictor.neighborCount; i++) {
+      for (int i = 0; i < predictor.neighborCount && !isBestExact; i++) {
         if (i == aps.max_num_direct_predictors)
           break;
 
+        if (i == _opt.predModeMaxCandidates)
+          break;
+
         attrPred = pointCloud.getColor(
-          indexesLOD[predictor.neighbors[i].predictorIndex]);
+          indexesLOD[predictor.neighborIndex[i]]);
         attrResidualQuant = computeColorResiduals(attrValue, attrPred, quant);
 
-        double idxBits = i + (i == aps.max_num_direct_predictors - 1 ? 1 : 2);
-        double score = attrResidualQuant[0] + attrResidualQuant[1]
-          + attrResidualQuant[2]
-          + idxBits * kAttrPredLambdaC
-            * (quant[0].stepSize() >> kFixedPointAttributeShift);
+        int idxBits = i + (i == aps.max_num_direct_predictors - 1 ? 1 : 2);
+        int64_t score = kAttrPredLambdaRecipC
+            * (attrResidualQuant[0] + attrResidualQuant[1]
+               + attrResidualQuant[2])
+          + idxBits * idxCost;
 
         if (score < best_score) {
           best_score = score;
           predictor.predMode = i + 1;
+          isBestExact = attrResidualQuant == 0;
           // NB: setting predictor.neighborCount = 1 will cause issues
           // with reconstruction.
         }
       }
     }
   }
+  return maxDiff;
 }
 
 //----------------------------------------------------------------------------
@@ -686,13 +589,13 @@ AttributeEncoder::encodeColorsPred(
                         (1 << desc.attr_bitdepth_secondary) - 1};
 
   uint32_t values[3];
-  PCCResidualsEntropyEstimator context;
   int zero_cnt = 0;
   std::vector<int> zerorun;
   std::vector<uint32_t> residual[3];
   for (int i = 0; i < 3; i++) {
     residual[i].resize(pointCount);
   }
+  std::vector<bool> isPredModeCoded(pointCount);
   int quantLayer = 0;
   for (size_t predictorIndex = 0; predictorIndex < pointCount;
        ++predictorIndex) {
@@ -703,9 +606,11 @@ AttributeEncoder::encodeColorsPred(
     auto quant = qpSet.quantizers(pointCloud[pointIndex], quantLayer);
     auto& predictor = _lods.predictors[predictorIndex];
 
-    computeColorPredictionWeights(
+    int64_t maxDiff = computeColorPredictionWeights(
       aps, pointCloud, _lods.indexes, predictorIndex, predictor, encoder,
-      context, quant);
+      quant);
+    isPredModeCoded[predictorIndex] =
+      maxDiff >= aps.adaptive_prediction_threshold;
     const Vec3<attr_t> color = pointCloud.getColor(pointIndex);
     const Vec3<attr_t> predictedColor =
       predictor.predictColor(pointCloud, _lods.indexes);
@@ -756,7 +661,7 @@ AttributeEncoder::encodeColorsPred(
   for (size_t predictorIndex = 0; predictorIndex < pointCount;
        ++predictorIndex) {
     auto& predictor = _lods.predictors[predictorIndex];
-    if (predictor.maxDiff >= aps.adaptive_prediction_threshold) {
+    if (isPredModeCoded[predictorIndex]) {
       encoder.encodePredMode(
         predictor.predMode, aps.max_num_direct_predictors);
     }
@@ -776,151 +681,152 @@ AttributeEncoder::encodeColorsPred(
 
 //----------------------------------------------------------------------------
 
-void
-AttributeEncoder::encodeReflectancesTransformRaht(
-  const AttributeDescription& desc,
-  const AttributeParameterSet& aps,
-  const QpSet& qpSet,
-  PCCPointSet3& pointCloud,
+// Entropy codes the coefficients of a single RAHT coded attribute.
+// The coefficients of each of the @numDims attribute dimensions are stored
+// in planar arrays of @voxelCount coefficients.
+
+static void
+encodeRahtCoefficients(
+  int numDims,
+  int voxelCount,
+  const int* coefficients,
   PCCResidualsEncoder& encoder)
 {
-  const int voxelCount = int(pointCloud.getPointCount());
-  std::vector<MortonCodeWithIndex> packedVoxel(voxelCount);
-  for (int n = 0; n < voxelCount; n++) {
-    packedVoxel[n].mortonCode = mortonAddr(pointCloud[n]);
-    packedVoxel[n].index = n;
-  }
-  sort(packedVoxel.begin(), packedVoxel.end());
-
-  // Allocate arrays.
-  int64_t* mortonCode = new int64_t[voxelCount];
-  const int attribCount = 1;
-  int* attributes = new int[attribCount * voxelCount];
-  int* coefficients = new int[attribCount * voxelCount];
-
-  // Populate input arrays.
-  for (int n = 0; n < voxelCount; n++) {
-    mortonCode[n] = packedVoxel[n].mortonCode;
-    const auto reflectance = pointCloud.getReflectance(packedVoxel[n].index);
-    attributes[attribCount * n] = reflectance;
-  }
-
-  auto quantLayers = qpSet.quantizerLayers();
-  // Transform.
-  regionAdaptiveHierarchicalTransform(
-    aps.raht_prediction_enabled_flag, quantLayers, mortonCode, attributes,
-    attribCount, voxelCount, coefficients);
-
-  // Entropy encode.
+  uint32_t values[3];
   int zero_cnt = 0;
-  uint32_t value;
   for (int n = 0; n < voxelCount; ++n) {
-    const int64_t detail = IntToUInt(coefficients[n]);
-    assert(detail < std::numeric_limits<uint32_t>::max());
-    value = uint32_t(detail);
-    if (!value)
+    for (int d = 0; d < numDims; ++d) {
+      const int64_t detail = IntToUInt(coefficients[voxelCount * d + n]);
+      assert(detail < std::numeric_limits<uint32_t>::max());
+      values[d] = uint32_t(detail);
+    }
+
+    bool isZero = !values[0];
+    if (numDims == 3)
+      isZero = isZero && !values[1] && !values[2];
+
+    if (isZero)
       ++zero_cnt;
     else {
       encoder.encodeZeroCnt(zero_cnt, voxelCount);
-      encoder.encode(value);
+      if (numDims == 1)
+        encoder.encode(values[0]);
+      else
+        encoder.encode(values[0], values[1], values[2]);
       zero_cnt = 0;
     }
   }
   encoder.encodeZeroCnt(zero_cnt, voxelCount);
-
-  const int64_t maxReflectance = (1 << desc.attr_bitdepth) - 1;
-  const int64_t minReflectance = 0;
-  for (int n = 0; n < voxelCount; n++) {
-    int64_t val = attributes[attribCount * n];
-    const attr_t reflectance =
-      attr_t(PCCClip(val, minReflectance, maxReflectance));
-    pointCloud.setReflectance(packedVoxel[n].index, reflectance);
-  }
-
-  // De-allocate arrays.
-  delete[] mortonCode;
-  delete[] attributes;
-  delete[] coefficients;
 }
 
 //----------------------------------------------------------------------------
 
 void
-AttributeEncoder::encodeColorsTransformRaht(
-  const AttributeDescription& desc,
-  const AttributeParameterSet& aps,
-  const QpSet& qpSet,
-  PCCPointSet3& pointCloud,
-  PCCResidualsEncoder& encoder)
+AttributeEncoder::encodeRahtJoint(
+  const SequenceParameterSet& sps,
+  const std::vector<JointAttributeBrick>& bricks,
+  PCCPointSet3& pointCloud)
 {
+  assert(!bricks.empty());
+  const auto& aps = *bricks.front().aps;
+
   const int voxelCount = int(pointCloud.getPointCount());
-  std::vector<MortonCodeWithIndex> packedVoxel(voxelCount);
+  auto& packedVoxel = _rahtWorkspace.packedVoxel;
+  packedVoxel.resize(voxelCount);
   for (int n = 0; n < voxelCount; n++) {
     packedVoxel[n].mortonCode = mortonAddr(pointCloud[n]);
     packedVoxel[n].index = n;
   }
   sort(packedVoxel.begin(), packedVoxel.end());
 
+  // Each attribute occupies a contiguous set of transform channels
+  std::vector<RahtQuantLayers> quantLayers;
+  for (const auto& brick : bricks) {
+    assert(isRahtJointCodable(aps, *brick.aps));
+    QpSet qpSet = deriveQpSet(*brick.aps, brick.abh);
+    int numDims = brick.desc->attr_num_dimensions;
+    assert(numDims == 1 || numDims == 3);
+    appendRahtQuantLayers(qpSet, numDims, &quantLayers);
+  }
+
   // Allocate arrays.
-  int64_t* mortonCode = new int64_t[voxelCount];
-  const int attribCount = 3;
-  int* attributes = new int[attribCount * voxelCount];
-  int* coefficients = new int[attribCount * voxelCount];
+  const int attribCount = int(quantLayers.size());
+  auto& mortonCode = _rahtWorkspace.mortonCode;
+  auto& attributes = _rahtWorkspace.attributes;
+  auto& coefficients = _rahtWorkspace.coefficients;
+  mortonCode.resize(voxelCount);
+  attributes.resize(attribCount * voxelCount);
+  coefficients.resize(attribCount * voxelCount);
 
   // Populate input arrays.
   for (int n = 0; n < voxelCount; n++) {
     mortonCode[n] = packedVoxel[n].mortonCode;
-    const auto color = pointCloud.getColor(packedVoxel[n].index);
-    attributes[attribCount * n] = color[0];
-    attributes[attribCount * n + 1] = color[1];
-    attributes[attribCount * n + 2] = color[2];
+    auto attributesIt = std::next(attributes.begin(), attribCount * n);
+    for (const auto& brick : bricks) {
+      if (brick.desc->attr_num_dimensions == 1) {
+        *attributesIt++ = pointCloud.getReflectance(packedVoxel[n].index);
+      } else {
+        const auto color = pointCloud.getColor(packedVoxel[n].index);
+        *attributesIt++ = color[0];
+        *attributesIt++ = color[1];
+        *attributesIt++ = color[2];
+      }
+    }
   }
 
-  auto quantLayers = qpSet.quantizerLayers();
   // Transform.
   regionAdaptiveHierarchicalTransform(
-    aps.raht_prediction_enabled_flag, quantLayers, mortonCode, attributes,
-    attribCount, voxelCount, coefficients);
+    aps.raht_prediction_enabled_flag, quantLayers, mortonCode.data(),
+    attributes.data(), attribCount, voxelCount, coefficients.data(),
+    &_rahtWorkspace);
+
+  // Entropy encode each attribute into its own brick, and write back the
+  // reconstruction.
+  int channel = 0;
+  for (const auto& brick : bricks) {
+    const auto& desc = *brick.desc;
+    const int numDims = desc.attr_num_dimensions;
+
+    PCCResidualsEncoder encoder;
+    encoder.start(sps, voxelCount);
+    encodeRahtCoefficients(
+      numDims, voxelCount, &coefficients[voxelCount * channel], encoder);
+
+    uint32_t acDataLen = encoder.stop();
+    std::copy_n(
+      encoder.arithmeticEncoder.buffer(), acDataLen,
+      std::back_inserter(*brick.payload));
+
+    if (numDims == 1) {
+      const int64_t maxReflectance = (1 << desc.attr_bitdepth) - 1;
+      const int64_t minReflectance = 0;
+      for (int n = 0; n < voxelCount; n++) {
+        int64_t val = attributes[attribCount * n + channel];
+        const attr_t reflectance =
+          attr_t(PCCClip(val, minReflectance, maxReflectance));
+        pointCloud.setReflectance(packedVoxel[n].index, reflectance);
+      }
+    } else {
+      Vec3<int> clipMax{(1 << desc.attr_bitdepth) - 1,
+                        (1 << desc.attr_bitdepth_secondary) - 1,
+                        (1 << desc.attr_bitdepth_secondary) - 1};
 
-  // Entropy encode.
-  uint32_t values[attribCount];
-  int zero_cnt = 0;
-  for (int n = 0; n < voxelCount; ++n) {
-    for (int d = 0; d < attribCount; ++d) {
-      const int64_t detail = IntToUInt(coefficients[voxelCount * d + n]);
-      assert(detail < std::numeric_limits<uint32_t>::max());
-      values[d] = uint32_t(detail);
-    }
-    if (!values[0] && !values[1] && !values[2])
-      ++zero_cnt;
-    else {
-      encoder.encodeZeroCnt(zero_cnt, voxelCount);
-      encoder.encode(values[0], values[1], values[2]);
-      zero_cnt = 0;
+      for (int n = 0; n < voxelCount; n++) {
+        const int r = attributes[attribCount * n + channel];
+        const int g = attributes[attribCount * n + channel + 1];
+        const int b = attributes[attribCount * n + channel + 2];
+        Vec3<attr_t> color;
+        color[0] = attr_t(PCCClip(r, 0, clipMax[0]));
+        color[1] = attr_t(PCCClip(g, 0, clipMax[1]));
+        color[2] = attr_t(PCCClip(b, 0, clipMax[2]));
+        pointCloud.setColor(packedVoxel[n].index, color);
+      }
     }
-  }
-  encoder.encodeZeroCnt(zero_cnt, voxelCount);
-
-  Vec3<int> clipMax{(1 << desc.attr_bitdepth) - 1,
-                    (1 << desc.attr_bitdepth_secondary) - 1,
-                    (1 << desc.attr_bitdepth_secondary) - 1};
 
-  for (int n = 0; n < voxelCount; n++) {
-    const int r = attributes[attribCount * n];
-    const int g = attributes[attribCount * n + 1];
-    const int b = attributes[attribCount * n + 2];
-    Vec3<attr_t> color;
-    color[0] = attr_t(PCCClip(r, 0, clipMax[0]));
-    color[1] = attr_t(PCCClip(g, 0, clipMax[1]));
-    color[2] = attr_t(PCCClip(b, 0, clipMax[2]));
-    pointCloud.setColor(packedVoxel[n].index, color);
+    channel += numDims;
   }
-
-  // De-allocate arrays.
-  delete[] mortonCode;
-  delete[] attributes;
-  delete[] coefficients;
 }
+
 //----------------------------------------------------------------------------
 
 void
@@ -942,23 +848,24 @@ AttributeEncoder::encodeColorsLift(
   }
 
   const size_t lodCount = _lods.numPointsInLod.size();
-  std::vector<Vec3<int64_t>> colors;
-  colors.resize(pointCount);
+  std::vector<int64_t> colors[3];
+  for (auto& component : colors)
+    component.resize(pointCount);
 
   for (size_t index = 0; index < pointCount; ++index) {
     const auto& color = pointCloud.getColor(_lods.indexes[index]);
     for (size_t d = 0; d < 3; ++d) {
-      colors[index][d] = int32_t(color[d]) << kFixedPointAttributeShift;
+      colors[d][index] = int32_t(color[d]) << kFixedPointAttributeShift;
     }
   }
 
+  LiftingNeighbours neighbours(_lods.predictors);
   for (size_t i = 0; (i + 1) < lodCount; ++i) {
     const size_t lodIndex = lodCount - i - 1;
     const size_t startIndex = _lods.numPointsInLod[lodIndex - 1];
     const size_t endIndex = _lods.numPointsInLod[lodIndex];
-    PCCLiftPredict(_lods.predictors, startIndex, endIndex, true, colors);
-    PCCLiftUpdate(
-      _lods.predictors, weights, startIndex, endIndex, true, colors);
+    PCCLiftPredict(neighbours, startIndex, endIndex, true, 3, colors);
+    PCCLiftUpdate(neighbours, weights, startIndex, endIndex, true, 3, colors);
   }
 
   // compress
@@ -973,20 +880,21 @@ AttributeEncoder::encodeColorsLift(
     auto quant = qpSet.quantizers(pointCloud[pointIndex], quantLayer);
 
     const int64_t quantWeight = weights[predictorIndex];
-    auto& color = colors[predictorIndex];
-    const int64_t delta = quant[0].quantize(color[0] * quantWeight);
+    auto& color0 = colors[0][predictorIndex];
+    const int64_t delta = quant[0].quantize(color0 * quantWeight);
     const int64_t detail = IntToUInt(delta);
     assert(detail < std::numeric_limits<uint32_t>::max());
     const int64_t reconstructedDelta = quant[0].scale(delta);
-    color[0] = reconstructedDelta / quantWeight;
+    color0 = reconstructedDelta / quantWeight;
     uint32_t values[3];
     values[0] = uint32_t(detail);
     for (size_t d = 1; d < 3; ++d) {
-      const int64_t delta = quant[1].quantize(color[d] * quantWeight);
+      auto& color = colors[d][predictorIndex];
+      const int64_t delta = quant[1].quantize(color * quantWeight);
       const int64_t detail = IntToUInt(delta);
       assert(detail < std::numeric_limits<uint32_t>::max());
       const int64_t reconstructedDelta = quant[1].scale(delta);
-      color[d] = reconstructedDelta / quantWeight;
+      color = reconstructedDelta / quantWeight;
       values[d] = uint32_t(detail);
     }
     if (!values[0] && !values[1] && !values[2])
@@ -1003,9 +911,8 @@ AttributeEncoder::encodeColorsLift(
   for (size_t lodIndex = 1; lodIndex < lodCount; ++lodIndex) {
     const size_t startIndex = _lods.numPointsInLod[lodIndex - 1];
     const size_t endIndex = _lods.numPointsInLod[lodIndex];
-    PCCLiftUpdate(
-      _lods.predictors, weights, startIndex, endIndex, false, colors);
-    PCCLiftPredict(_lods.predictors, startIndex, endIndex, false, colors);
+    PCCLiftUpdate(neighbours, weights, startIndex, endIndex, false, 3, colors);
+    PCCLiftPredict(neighbours, startIndex, endIndex, false, 3, colors);
   }
 
   Vec3<int64_t> clipMax{(1 << desc.attr_bitdepth) - 1,
@@ -1013,11 +920,11 @@ AttributeEncoder::encodeColorsLift(
                         (1 << desc.attr_bitdepth_secondary) - 1};
 
   for (size_t f = 0; f < pointCount; ++f) {
-    const auto color0 =
-      divExp2RoundHalfInf(colors[f], kFixedPointAttributeShift);
     Vec3<attr_t> color;
     for (size_t d = 0; d < 3; ++d) {
-      color[d] = attr_t(PCCClip(color0[d], 0, clipMax[d]));
+      const int64_t color0 =
+        divExp2RoundHalfInf(colors[d][f], kFixedPointAttributeShift);
+      color[d] = attr_t(PCCClip(color0, int64_t(0), clipMax[d]));
     }
     pointCloud.setColor(_lods.indexes[f], color);
   }
@@ -1053,13 +960,14 @@ AttributeEncoder::encodeReflectancesLift(
       << kFixedPointAttributeShift;
   }
 
+  LiftingNeighbours neighbours(_lods.predictors);
   for (size_t i = 0; (i + 1) < lodCount; ++i) {
     const size_t lodIndex = lodCount - i - 1;
     const size_t startIndex = _lods.numPointsInLod[lodIndex - 1];
     const size_t endIndex = _lods.numPointsInLod[lodIndex];
-    PCCLiftPredict(_lods.predictors, startIndex, endIndex, true, reflectances);
+    PCCLiftPredict(neighbours, startIndex, endIndex, true, 1, &reflectances);
     PCCLiftUpdate(
-      _lods.predictors, weights, startIndex, endIndex, true, reflectances);
+      neighbours, weights, startIndex, endIndex, true, 1, &reflectances);
   }
 
   // compress
@@ -1095,9 +1003,8 @@ AttributeEncoder::encodeReflectancesLift(
     const size_t startIndex = _lods.numPointsInLod[lodIndex - 1];
     const size_t endIndex = _lods.numPointsInLod[lodIndex];
     PCCLiftUpdate(
-      _lods.predictors, weights, startIndex, endIndex, false, reflectances);
-    PCCLiftPredict(
-      _lods.predictors, startIndex, endIndex, false, reflectances);
+      neighbours, weights, startIndex, endIndex, false, 1, &reflectances);
+    PCCLiftPredict(neighbours, startIndex, endIndex, false, 1, &reflectances);
   }
   const int64_t maxReflectance = (1 << desc.attr_bitdepth) - 1;
   for (size_t f = 0; f < pointCount; ++f) {
@@ -43,6 +43,7 @@
 #include "PayloadBuffer.h"
 #include "PCCTMC3Common.h"
 #include "quantization.h"
+#include "RAHT.h"
 
 namespace pcc {
 
@@ -50,7 +51,6 @@ namespace pcc {
 // Opaque definitions (Internal detail)
 
 struct PCCResidualsEncoder;
-struct PCCResidualsEntropyEstimator;
 
 //============================================================================
 
@@ -58,14 +58,22 @@ class AttributeEncoder : public AttributeEncoderIntf {
 public:
   void encode(
     const SequenceParameterSet& sps,
+    const AttributeEncOpts& opt,
     const AttributeDescription& desc,
     const AttributeParameterSet& attr_aps,
     const AttributeBrickHeader& abh,
     PCCPointSet3& pointCloud,
     PayloadBuffer* payload) override;
 
+  void encodeRahtJoint(
+    const SequenceParameterSet& sps,
+    const std::vector<JointAttributeBrick>& bricks,
+    PCCPointSet3& pointCloud) override;
+
   bool isReusable(const AttributeParameterSet& aps) const override;
 
+  void reset() override;
+
 protected:
   // todo(df): consider alternative encapsulation
 
@@ -97,52 +105,42 @@ protected:
     PCCPointSet3& pointCloud,
     PCCResidualsEncoder& encoder);
 
-  void encodeReflectancesTransformRaht(
-    const AttributeDescription& desc,
-    const AttributeParameterSet& aps,
-    const QpSet& qpSet,
-    PCCPointSet3& pointCloud,
-    PCCResidualsEncoder& encoder);
-
-  void encodeColorsTransformRaht(
-    const AttributeDescription& desc,
-    const AttributeParameterSet& aps,
-    const QpSet& qpSet,
-    PCCPointSet3& pointCloud,
-    PCCResidualsEncoder& encoder);
-
   static Vec3<int64_t> computeColorResiduals(
     const Vec3<attr_t> color,
     const Vec3<attr_t> predictedColor,
     const Quantizers& quant);
 
-  static void computeColorPredictionWeights(
+  int64_t computeColorPredictionWeights(
     const AttributeParameterSet& aps,
     const PCCPointSet3& pointCloud,
     const std::vector<uint32_t>& indexesLOD,
     const uint32_t predictorIndex,
     PCCPredictor& predictor,
     PCCResidualsEncoder& encoder,
-    PCCResidualsEntropyEstimator& context,
-    const Quantizers& quant);
+    const Quantizers& quant) const;
 
   static int64_t computeReflectanceResidual(
     const uint64_t reflectance,
     const uint64_t predictedReflectance,
     const Quantizer& quant);
 
-  static void computeReflectancePredictionWeights(
+  int64_t computeReflectancePredictionWeights(
     const AttributeParameterSet& aps,
     const PCCPointSet3& pointCloud,
     const std::vector<uint32_t>& indexesLOD,
     const uint32_t predictorIndex,
     PCCPredictor& predictor,
     PCCResidualsEncoder& encoder,
-    PCCResidualsEntropyEstimator& context,
-    const Quantizer& quant);
+    const Quantizer& quant) const;
 
 private:
+  // Options of the current call to encode()
+  AttributeEncOpts _opt;
+
   AttributeLods _lods;
+
+  // Working memory for RAHT, retained between point clouds
+  RahtWorkspace _rahtWorkspace;
 };
 
 //============================================================================
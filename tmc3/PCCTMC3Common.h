@@ -99,62 +99,67 @@ struct PCCNeighborInfo {
 
 //---------------------------------------------------------------------------
 
-struct PCCPredictor {
+// The transient state of the nearest neighbour search for a single
+// predictor.  Neighbours are ordered by increasing distance.
+
+struct PCCNeighborSearch {
   uint32_t neighborCount;
   PCCNeighborInfo neighbors[kAttributePredictionMaxNeighbourCount];
-  int8_t predMode;
-  int64_t maxDiff;
 
-  Vec3<attr_t> predictColor(
-    const PCCPointSet3& pointCloud, const std::vector<uint32_t>& indexes) const
+  void init()
   {
-    Vec3<int64_t> predicted(0);
-    if (predMode > neighborCount) {
-      /* nop */
-    } else if (predMode > 0) {
-      const Vec3<attr_t> color =
-        pointCloud.getColor(indexes[neighbors[predMode - 1].predictorIndex]);
-      for (size_t k = 0; k < 3; ++k) {
-        predicted[k] += color[k];
-      }
-    } else {
-      for (size_t i = 0; i < neighborCount; ++i) {
-        const Vec3<attr_t> color =
-          pointCloud.getColor(indexes[neighbors[i].predictorIndex]);
-        const uint32_t w = neighbors[i].weight;
-        for (size_t k = 0; k < 3; ++k) {
-          predicted[k] += w * color[k];
-        }
-      }
-      for (uint32_t k = 0; k < 3; ++k) {
-        predicted[k] =
-          divExp2RoundHalfInf(predicted[k], kFixedPointWeightShift);
-      }
-    }
-    return Vec3<attr_t>(predicted[0], predicted[1], predicted[2]);
+    neighborCount = 0;
+    memset(
+      neighbors, 0,
+      sizeof(PCCNeighborInfo) * kAttributePredictionMaxNeighbourCount);
   }
 
-  int64_t predictReflectance(
-    const PCCPointSet3& pointCloud, const std::vector<uint32_t>& indexes) const
+  void insertNeighbor(
+    const uint32_t reference,
+    const uint64_t weight,
+    const uint32_t maxNeighborCount,
+    const uint32_t insertIndex)
   {
-    int64_t predicted(0);
-    if (predMode > neighborCount) {
-      /* nop */
-    } else if (predMode > 0) {
-      predicted = pointCloud.getReflectance(
-        indexes[neighbors[predMode - 1].predictorIndex]);
+    bool sort = false;
+    assert(
+      maxNeighborCount > 0
+      && maxNeighborCount <= kAttributePredictionMaxNeighbourCount);
+    if (neighborCount < maxNeighborCount) {
+      PCCNeighborInfo& neighborInfo = neighbors[neighborCount];
+      neighborInfo.weight = weight;
+      neighborInfo.predictorIndex = reference;
+      neighborInfo.insertIndex = insertIndex;
+      ++neighborCount;
+      sort = true;
     } else {
-      for (size_t i = 0; i < neighborCount; ++i) {
-        predicted += neighbors[i].weight
-          * pointCloud.getReflectance(indexes[neighbors[i].predictorIndex]);
+      PCCNeighborInfo& neighborInfo = neighbors[maxNeighborCount - 1];
+      if (
+        weight < neighborInfo.weight
+        || (weight == neighborInfo.weight
+            && insertIndex < neighborInfo.insertIndex)) {
+        neighborInfo.weight = weight;
+        neighborInfo.predictorIndex = reference;
+        neighborInfo.insertIndex = insertIndex;
+        sort = true;
       }
-      predicted = divExp2RoundHalfInf(predicted, kFixedPointWeightShift);
     }
-    return predicted;
+    for (int32_t k = neighborCount - 1; k > 0 && sort; --k) {
+      if (neighbors[k] < neighbors[k - 1])
+        std::swap(neighbors[k], neighbors[k - 1]);
+      else
+        return;
+    }
   }
 
   void computeWeights()
   {
+    if (neighborCount < 2) {
+      neighbors[0].weight = 1;
+    } else if (neighbors[0].weight == 0) {
+      neighborCount = 1;
+      neighbors[0].weight = 1;
+    }
+
     const uint32_t shift = (1 << kFixedPointWeightShift);
     int32_t n = 0;
     while ((neighbors[0].weight >> n) >= shift) {
@@ -198,214 +203,81 @@ struct PCCPredictor {
       neighbors[2].weight = uint32_t(w2);
     }
   }
+};
 
-  void init(const uint32_t predictorIndex)
-  {
-    neighborCount = (predictorIndex != PCC_UNDEFINED_INDEX) ? 1 : 0;
-    neighbors[0].predictorIndex = predictorIndex;
-    neighbors[0].weight = 1;
-    predMode = 0;
-  }
+//---------------------------------------------------------------------------
+// A compact representation of a predictor: the interpolation weights are
+// fixed-point values with kFixedPointWeightShift fractional bits, and so
+// never exceed 1 << kFixedPointWeightShift.
 
-  void init()
-  {
-    neighborCount = 0;
-    memset(
-      neighbors, 0,
-      sizeof(PCCNeighborInfo) * kAttributePredictionMaxNeighbourCount);
-  }
+struct PCCPredictor {
+  uint32_t neighborIndex[kAttributePredictionMaxNeighbourCount];
+  uint16_t neighborWeight[kAttributePredictionMaxNeighbourCount];
+  uint8_t neighborCount;
+  int8_t predMode;
 
-  void insertNeighbor(
-    const uint32_t reference,
-    const uint64_t weight,
-    const uint32_t maxNeighborCount,
-    const uint32_t insertIndex)
+  Vec3<attr_t> predictColor(
+    const PCCPointSet3& pointCloud, const std::vector<uint32_t>& indexes) const
   {
-    bool sort = false;
-    assert(
-      maxNeighborCount > 0
-      && maxNeighborCount <= kAttributePredictionMaxNeighbourCount);
-    if (neighborCount < maxNeighborCount) {
-      PCCNeighborInfo& neighborInfo = neighbors[neighborCount];
-      neighborInfo.weight = weight;
-      neighborInfo.predictorIndex = reference;
-      neighborInfo.insertIndex = insertIndex;
-      ++neighborCount;
-      sort = true;
-    } else {
-      PCCNeighborInfo& neighborInfo = neighbors[maxNeighborCount - 1];
-      if (
-        weight < neighborInfo.weight
-        || (weight == neighborInfo.weight
-            && insertIndex < neighborInfo.insertIndex)) {
-        neighborInfo.weight = weight;
-        neighborInfo.predictorIndex = reference;
-        neighborInfo.insertIndex = insertIndex;
-        sort = true;
+    Vec3<int64_t> predicted(0);
+    if (predMode > neighborCount) {
+      /* nop */
+    } else if (predMode > 0) {
+      const Vec3<attr_t> color =
+        pointCloud.getColor(indexes[neighborIndex[predMode - 1]]);
+      for (size_t k = 0; k < 3; ++k) {
+        predicted[k] += color[k];
       }
-    }
-    for (int32_t k = neighborCount - 1; k > 0 && sort; --k) {
-      if (neighbors[k] < neighbors[k - 1])
-        std::swap(neighbors[k], neighbors[k - 1]);
-      else
-        return;
-    }
-  }
-};
-
-//---------------------------------------------------------------------------
-
-inline void
-PCCLiftPredict(
-  const std::vector<PCCPredictor>& predictors,
-  const size_t startIndex,
-  const size_t endIndex,
-  const bool direct,
-  std::vector<Vec3<int64_t>>& attributes)
-{
-  const size_t predictorCount = endIndex - startIndex;
-  for (size_t index = 0; index < predictorCount; ++index) {
-    const size_t predictorIndex = predictorCount - index - 1 + startIndex;
-    const auto& predictor = predictors[predictorIndex];
-    auto& attribute = attributes[predictorIndex];
-    Vec3<int64_t> predicted(int64_t(0));
-    for (size_t i = 0; i < predictor.neighborCount; ++i) {
-      const size_t neighborPredIndex = predictor.neighbors[i].predictorIndex;
-      const uint32_t weight = predictor.neighbors[i].weight;
-      assert(neighborPredIndex < startIndex);
-      predicted += weight * attributes[neighborPredIndex];
-    }
-    predicted = divExp2RoundHalfInf(predicted, kFixedPointWeightShift);
-    if (direct) {
-      attribute -= predicted;
     } else {
-      attribute += predicted;
+      for (size_t i = 0; i < neighborCount; ++i) {
+        const Vec3<attr_t> color =
+          pointCloud.getColor(indexes[neighborIndex[i]]);
+        const uint32_t w = neighborWeight[i];
+        for (size_t k = 0; k < 3; ++k) {
+          predicted[k] += w * color[k];
+        }
+      }
+      for (uint32_t k = 0; k < 3; ++k) {
+        predicted[k] =
+          divExp2RoundHalfInf(predicted[k], kFixedPointWeightShift);
+      }
     }
+    return Vec3<attr_t>(predicted[0], predicted[1], predicted[2]);
   }
-}
 
-inline void
-PCCLiftPredict(
-  const std::vector<PCCPredictor>& predictors,
-  const size_t startIndex,
-  const size_t endIndex,
-  const bool direct,
-  std::vector<int64_t>& attributes)
-{
-  const size_t predictorCount = endIndex - startIndex;
-  for (size_t index = 0; index < predictorCount; ++index) {
-    const size_t predictorIndex = predictorCount - index - 1 + startIndex;
-    const auto& predictor = predictors[predictorIndex];
-    auto& attribute = attributes[predictorIndex];
-    int64_t predicted(int64_t(0));
-    for (size_t i = 0; i < predictor.neighborCount; ++i) {
-      const size_t neighborPredIndex = predictor.neighbors[i].predictorIndex;
-      const uint32_t weight = predictor.neighbors[i].weight;
-      assert(neighborPredIndex < startIndex);
-      predicted += weight * attributes[neighborPredIndex];
-    }
-    predicted = divExp2RoundHalfInf(predicted, kFixedPointWeightShift);
-    if (direct) {
-      attribute -= predicted;
+  int64_t predictReflectance(
+    const PCCPointSet3& pointCloud, const std::vector<uint32_t>& indexes) const
+  {
+    int64_t predicted(0);
+    if (predMode > neighborCount) {
+      /* nop */
+    } else if (predMode > 0) {
+      predicted =
+        pointCloud.getReflectance(indexes[neighborIndex[predMode - 1]]);
     } else {
-      attribute += predicted;
-    }
-  }
-}
-
-//---------------------------------------------------------------------------
-
-inline void
-PCCLiftUpdate(
-  const std::vector<PCCPredictor>& predictors,
-  const std::vector<uint64_t>& quantizationWeights,
-  const size_t startIndex,
-  const size_t endIndex,
-  const bool direct,
-  std::vector<Vec3<int64_t>>& attributes)
-{
-  std::vector<uint64_t> updateWeights;
-  updateWeights.resize(startIndex, uint64_t(0));
-  std::vector<Vec3<int64_t>> updates;
-  updates.resize(startIndex);
-  for (size_t index = 0; index < startIndex; ++index) {
-    updates[index] = int64_t(0);
-  }
-  const size_t predictorCount = endIndex - startIndex;
-  for (size_t index = 0; index < predictorCount; ++index) {
-    const size_t predictorIndex = predictorCount - index - 1 + startIndex;
-    const auto& predictor = predictors[predictorIndex];
-    const auto currentQuantWeight = quantizationWeights[predictorIndex];
-    for (size_t i = 0; i < predictor.neighborCount; ++i) {
-      const size_t neighborPredIndex = predictor.neighbors[i].predictorIndex;
-      const uint64_t weight =
-        predictor.neighbors[i].weight * currentQuantWeight;
-      assert(neighborPredIndex < startIndex);
-      updateWeights[neighborPredIndex] += weight;
-      updates[neighborPredIndex] += weight * attributes[predictorIndex];
-    }
-  }
-  for (size_t predictorIndex = 0; predictorIndex < startIndex;
-       ++predictorIndex) {
-    const uint32_t sumWeights = updateWeights[predictorIndex];
-    if (sumWeights) {
-      auto& update = updates[predictorIndex];
-      update = (update + sumWeights / 2) / sumWeights;
-      auto& attribute = attributes[predictorIndex];
-      if (direct) {
-        attribute += update;
-      } else {
-        attribute -= update;
+      for (size_t i = 0; i < neighborCount; ++i) {
+        predicted += uint64_t(neighborWeight[i])
+          * pointCloud.getReflectance(indexes[neighborIndex[i]]);
       }
+      predicted = divExp2RoundHalfInf(predicted, kFixedPointWeightShift);
     }
+    return predicted;
   }
-}
 
-inline void
-PCCLiftUpdate(
-  const std::vector<PCCPredictor>& predictors,
-  const std::vector<uint64_t>& quantizationWeights,
-  const size_t startIndex,
-  const size_t endIndex,
-  const bool direct,
-  std::vector<int64_t>& attributes)
-{
-  std::vector<uint64_t> updateWeights;
-  updateWeights.resize(startIndex, uint64_t(0));
-  std::vector<int64_t> updates;
-  updates.resize(startIndex);
-  for (size_t index = 0; index < startIndex; ++index) {
-    updates[index] = int64_t(0);
-  }
-  const size_t predictorCount = endIndex - startIndex;
-  for (size_t index = 0; index < predictorCount; ++index) {
-    const size_t predictorIndex = predictorCount - index - 1 + startIndex;
-    const auto& predictor = predictors[predictorIndex];
-    const auto currentQuantWeight = quantizationWeights[predictorIndex];
-    for (size_t i = 0; i < predictor.neighborCount; ++i) {
-      const size_t neighborPredIndex = predictor.neighbors[i].predictorIndex;
-      const uint64_t weight =
-        predictor.neighbors[i].weight * currentQuantWeight;
-      assert(neighborPredIndex < startIndex);
-      updateWeights[neighborPredIndex] += weight;
-      updates[neighborPredIndex] += weight * attributes[predictorIndex];
-    }
-  }
-  for (size_t predictorIndex = 0; predictorIndex < startIndex;
-       ++predictorIndex) {
-    const uint32_t sumWeights = updateWeights[predictorIndex];
-    if (sumWeights > 0.0) {
-      auto& update = updates[predictorIndex];
-      update = (update + sumWeights / 2) / sumWeights;
-      auto& attribute = attributes[predictorIndex];
-      if (direct) {
-        attribute += update;
-      } else {
-        attribute -= update;
-      }
+  // Initialise the predictor from the result of a neighbour search.
+  // Unused neighbours have a zero weight and index.
+  void init(PCCNeighborSearch& search)
+  {
+    search.computeWeights();
+    neighborCount = uint8_t(search.neighborCount);
+    predMode = 0;
+    for (int i = 0; i < kAttributePredictionMaxNeighbourCount; i++) {
+      bool used = i < neighborCount;
+      neighborIndex[i] = used ? search.neighbors[i].predictorIndex : 0;
+      neighborWeight[i] = used ? uint16_t(search.neighbors[i].weight) : 0;
     }
   }
-}
+};
 
 //---------------------------------------------------------------------------
 
@@ -424,8 +296,8 @@ PCCComputeQuantizationWeights(
     const auto& predictor = predictors[predictorIndex];
     const auto currentQuantWeight = quantizationWeights[predictorIndex];
     for (size_t j = 0; j < predictor.neighborCount; ++j) {
-      const size_t neighborPredIndex = predictor.neighbors[j].predictorIndex;
-      const auto weight = predictor.neighbors[j].weight;
+      const size_t neighborPredIndex = predictor.neighborIndex[j];
+      const auto weight = predictor.neighborWeight[j];
       auto& neighborQuantWeight = quantizationWeights[neighborPredIndex];
       neighborQuantWeight += divExp2RoundHalfInf(
         weight * currentQuantWeight, kFixedPointWeightShift);
@@ -479,31 +351,92 @@ computeQuantizationWeightsScalable(
 
 //---------------------------------------------------------------------------
 
-inline uint32_t
-FindNeighborWithinDistance(
-  const PCCPointSet3& pointCloud,
-  const std::vector<MortonCodeWithIndex>& packedVoxel,
-  const int32_t index,
-  const double radius2,
-  const int32_t searchRange,
-  std::vector<uint32_t>& retained)
-{
-  const auto& point = pointCloud[packedVoxel[index].index];
-  const int32_t retainedSize = retained.size();
-  int32_t j = retainedSize - 2;
-  int32_t k = 0;
-  while (j >= 0 && ++k < searchRange) {
-    const int32_t index1 = retained[j];
-    const int32_t pointIndex1 = packedVoxel[index1].index;
-    const auto& point1 = pointCloud[pointIndex1];
-    const auto d2 = (point1 - point).getNorm2<double>();
-    if (d2 <= radius2) {
-      return index1;
+// A spatial hash of the points retained by distance based subsampling,
+// used to determine if any of the most recently retained points lies within
+// a given distance of a query point.
+//
+// Only the last @searchRange retained points are considered, in order to
+// reproduce the search window of the original Morton-order search.  Since
+// each retained point is at least the search distance from all points in
+// its window, every grid cell contains a bounded number of window points
+// and each query takes constant time.
+
+class RecentRetainedPointGrid {
+public:
+  RecentRetainedPointGrid(double radius2, int32_t searchRange)
+    : _radius2(radius2), _windowSize(std::max(1, searchRange))
+  {
+    // the cell size is the smallest power of two not less than the radius
+    // so that any neighbour lies in an adjacent cell.
+    _cellSizeLog2 = 0;
+    while (_cellSizeLog2 < 31 && double(1ll << 2 * _cellSizeLog2) < radius2)
+      _cellSizeLog2++;
+
+    int bucketCountLog2 = std::max(6, ceillog2(uint32_t(4 * _windowSize)));
+    _bucketMask = (1u << bucketCountLog2) - 1;
+    _head.assign(size_t(1) << bucketCountLog2, -1);
+  }
+
+  void insert(const point_t& point)
+  {
+    int32_t idx = int32_t(_points.size());
+    auto& head = _head[bucket(cell(point))];
+    _prev.push_back(head);
+    _points.push_back(point);
+    head = idx;
+  }
+
+  bool hasNeighbor(const point_t& point) const
+  {
+    const int32_t windowStart =
+      std::max(0, int32_t(_points.size()) - _windowSize);
+
+    const Vec3<int32_t> cell0 = cell(point);
+    for (int32_t dz = -1; dz <= 1; dz++) {
+      for (int32_t dy = -1; dy <= 1; dy++) {
+        for (int32_t dx = -1; dx <= 1; dx++) {
+          Vec3<int32_t> cell1{cell0[0] + dx, cell0[1] + dy, cell0[2] + dz};
+
+          // NB: buckets are chained in decreasing order of insertion.
+          //     Bucket collisions only introduce further candidates.
+          int32_t idx = _head[bucket(cell1)];
+          for (; idx >= windowStart; idx = _prev[idx]) {
+            if ((_points[idx] - point).getNorm2<double>() <= _radius2)
+              return true;
+          }
+        }
+      }
     }
-    --j;
+    return false;
   }
-  return PCC_UNDEFINED_INDEX;
-}
+
+private:
+  Vec3<int32_t> cell(const point_t& point) const
+  {
+    return {point[0] >> _cellSizeLog2, point[1] >> _cellSizeLog2,
+            point[2] >> _cellSizeLog2};
+  }
+
+  uint32_t bucket(const Vec3<int32_t>& cell) const
+  {
+    uint32_t h = uint32_t(cell[0]) * 73856093u;
+    h ^= uint32_t(cell[1]) * 19349663u;
+    h ^= uint32_t(cell[2]) * 83492791u;
+    return h & _bucketMask;
+  }
+
+  double _radius2;
+  int32_t _windowSize;
+  int _cellSizeLog2;
+  uint32_t _bucketMask;
+
+  // The most recently inserted point of each bucket
+  std::vector<int32_t> _head;
+
+  // The retained points and the previously inserted point in each bucket
+  std::vector<point_t> _points;
+  std::vector<int32_t> _prev;
+};
 
 //---------------------------------------------------------------------------
 
@@ -652,7 +585,8 @@ computeNearestNeighbors(
     auto& predictor = predictors[--predIndex];
     pointIndexToPredictorIndex[pointIndex] = predIndex;
 
-    predictor.init();
+    PCCNeighborSearch search;
+    search.init();
 
     const int32_t j0 = std::max(0, j - aps.search_range);
     const int32_t j1 = std::min(retainedSize, j + aps.search_range + 1);
@@ -674,7 +608,7 @@ computeNearestNeighbors(
         norm2 = double(1 << (nodeSizeLog2 - 1));
         norm2 = norm2 * norm2;
       }
-      predictor.insertNeighbor(
+      search.insertNeighbor(
         pointIndex1, norm2, aps.num_pred_nearest_neighbours,
         indexTieBreaker(k, j));
     }
@@ -688,9 +622,9 @@ computeNearestNeighbors(
           continue;
         }
         if (
-          predictor.neighborCount < aps.num_pred_nearest_neighbours
+          search.neighborCount < aps.num_pred_nearest_neighbours
           || bBoxes[bucketIndex1].getDist2<int64_t>(point)
-            <= predictor.neighbors[index0].weight) {
+            <= search.neighbors[index0].weight) {
           const int32_t k0 = std::max(bucketIndex1 * bucketSize, j0);
           const int32_t k1 = std::min((bucketIndex1 + 1) * bucketSize, j1);
           for (int32_t k = k0; k < k1; ++k) {
@@ -706,7 +640,7 @@ computeNearestNeighbors(
               norm2 = (double)(1 << (nodeSizeLog2 - 1));
               norm2 = norm2 * norm2;
             }
-            predictor.insertNeighbor(
+            search.insertNeighbor(
               pointIndex1, norm2, aps.num_pred_nearest_neighbours,
               indexTieBreaker(k, j));
           }
@@ -725,7 +659,7 @@ computeNearestNeighbors(
         const int32_t pointIndex1 = packedVoxel[indexes[startIndex + k]].index;
         const auto& point1 = pointCloud[pointIndex1];
         auto d2 = times(point - point1, aps.lod_neigh_bias).getNorm2<double>();
-        predictor.insertNeighbor(
+        search.insertNeighbor(
           pointIndex1, d2, aps.num_pred_nearest_neighbours,
           startIndex + k - i + 2 * aps.search_range);
       }
@@ -737,9 +671,9 @@ computeNearestNeighbors(
           continue;
 
         if (
-          predictor.neighborCount < aps.num_pred_nearest_neighbours
+          search.neighborCount < aps.num_pred_nearest_neighbours
           || bBoxesI[bucketIndex1].getDist2<int64_t>(point)
-            <= predictor.neighbors[index0].weight) {
+            <= search.neighbors[index0].weight) {
           const int32_t k0 = bucketIndex1 * bucketSize;
           const int32_t k1 = std::min((bucketIndex1 + 1) * bucketSize, j1);
           for (int32_t k = k0; k < k1; ++k) {
@@ -749,14 +683,15 @@ computeNearestNeighbors(
             auto d2 =
               times(point - point1, aps.lod_neigh_bias).getNorm2<double>();
 
-            predictor.insertNeighbor(
+            search.insertNeighbor(
               pointIndex1, d2, aps.num_pred_nearest_neighbours,
               startIndex + k - i + 2 * aps.search_range);
           }
         }
       }
     }
-    assert(predictor.neighborCount <= aps.num_pred_nearest_neighbours);
+    assert(search.neighborCount <= aps.num_pred_nearest_neighbours);
+    predictor.init(search);
   }
 }
 
@@ -775,23 +710,17 @@ subsampleByDistance(
   if (input.size() == 1) {
     indexes.push_back(input[0]);
   } else {
+    RecentRetainedPointGrid grid(radius2, searchRange);
+    for (const auto index : retained)
+      grid.insert(pointCloud[packedVoxel[index].index]);
+
     for (const auto index : input) {
-      if (retained.empty()) {
-        retained.push_back(index);
-        continue;
-      }
       const auto& point = pointCloud[packedVoxel[index].index];
-      const auto& lastRetained =
-        pointCloud[packedVoxel[retained.back()].index];
-      auto distanceToLastRetained = (lastRetained - point).getNorm2<double>();
-      if (
-        distanceToLastRetained <= radius2
-        || FindNeighborWithinDistance(
-             pointCloud, packedVoxel, index, radius2, searchRange, retained)
-          != PCC_UNDEFINED_INDEX) {
-        indexes.push_back(index);
-      } else {
+      if (retained.empty() || !grid.hasNeighbor(point)) {
         retained.push_back(index);
+        grid.insert(point);
+      } else {
+        indexes.push_back(index);
       }
     }
   }
@@ -907,16 +836,9 @@ updatePredictors(
   std::vector<PCCPredictor>& predictors)
 {
   for (auto& predictor : predictors) {
-    if (predictor.neighborCount < 2) {
-      predictor.neighbors[0].weight = 1;
-    } else if (predictor.neighbors[0].weight == 0) {
-      predictor.neighborCount = 1;
-      predictor.neighbors[0].weight = 1;
-    }
     for (int32_t k = 0; k < predictor.neighborCount; ++k) {
-      auto& neighbor = predictor.neighbors[k];
-      neighbor.predictorIndex =
-        pointIndexToPredictorIndex[neighbor.predictorIndex];
+      auto& neighbor = predictor.neighborIndex[k];
+      neighbor = pointIndexToPredictorIndex[neighbor];
     }
   }
 }
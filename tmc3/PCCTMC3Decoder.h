@@ -37,6 +37,8 @@
 
 #include <functional>
 #include <map>
+#include <memory>
+#include <vector>
 
 #include "Attribute.h"
 #include "PayloadBuffer.h"
@@ -53,6 +55,25 @@ struct DecoderParams {
   // layers to skip during the decode process (attribute coding must take
   // this into account)
   int minGeomNodeSizeLog2;
+
+  // Output each slice via Callbacks::onOutputSlice as soon as it is decoded
+  // rather than accumulating complete frames.
+  bool outputSlices;
+};
+
+//============================================================================
+// Description of a decoded slice passed to Callbacks::onOutputSlice
+
+struct DecodedSliceInfo {
+  int frameIdx;
+  int tileId;
+  int sliceId;
+
+  // Position of the slice in the translated+scaled co-ordinate system.
+  Vec3<int> sliceOrigin;
+
+  // Bounding box of the slice's points (including the slice origin).
+  Box3<int32_t> bbox;
 };
 
 //============================================================================
@@ -85,8 +106,12 @@ public:
 private:
   void activateParameterSets(const GeometryBrickHeader& gbh);
   int decodeGeometryBrick(const PayloadBuffer& buf);
-  void decodeAttributeBrick(const PayloadBuffer& buf);
+  void queueAttributeBrick(const PayloadBuffer& buf);
+  void decodeAttributeBricks();
+  void resetAttributeDecoders();
   bool frameIdxChanged(const GeometryBrickHeader& gbh) const;
+  void outputSlice(Callbacks* callback);
+  void outputFrame(Callbacks* callback);
 
   //==========================================================================
 
@@ -107,6 +132,9 @@ private:
   PCCPointSet3 _currentPointCloud;
   PCCPointSet3 _accumCloud;
 
+  // The number of slices decoded in the current frame
+  int _frameSliceCount;
+
   // Received parameter sets, mapping parameter set id -> parameterset
   std::map<int, SequenceParameterSet> _spss;
   std::map<int, GeometryParameterSet> _gpss;
@@ -121,8 +149,12 @@ private:
 
   GeometryBrickHeader _gbh;
 
-  // Attribute decoder for reuse between attributes of same slice
-  std::unique_ptr<AttributeDecoderIntf> _attrDecoder;
+  // Attribute bricks of the current slice that are yet to be decoded
+  std::vector<PayloadBuffer> _attrBricks;
+
+  // Attribute decoders for reuse between attributes of same slice.
+  // NB: only the last decoder is considered for reuse.
+  std::vector<std::unique_ptr<AttributeDecoderIntf>> _attrDecoders;
 };
 
 //----------------------------------------------------------------------------
@@ -131,6 +163,12 @@ class PCCTMC3Decoder3::Callbacks {
 public:
   virtual void
   onOutputCloud(const SequenceParameterSet&, const PCCPointSet3&) = 0;
+
+  // Called with each decoded slice when slice output is enabled.
+  // NB: onOutputCloud then marks the end of each frame with an empty cloud.
+  virtual void onOutputSlice(
+    const SequenceParameterSet&, const DecodedSliceInfo&, const PCCPointSet3&)
+  {}
 };
 
 //============================================================================
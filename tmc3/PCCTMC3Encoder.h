@@ -37,9 +37,11 @@
 
 #include <functional>
 #include <map>
+#include <memory>
 #include <string>
 #include <vector>
 
+#include "Attribute.h"
 #include "PayloadBuffer.h"
 #include "PCCMath.h"
 #include "PCCPointSet.h"
@@ -70,6 +72,9 @@ struct EncoderParams {
   // Encoder specific parameters for attributes
   std::vector<EncoderAttributeParams> attr;
 
+  // Encoder specific attribute coding options
+  AttributeEncOpts attrEnc;
+
   // todo(df): this should go away
   std::map<std::string, int> attributeIdxMap;
 
@@ -99,6 +104,21 @@ public:
     Callbacks*,
     PCCPointSet3* reconstructedCloud = nullptr);
 
+  // Encoding of a frame supplied as a sequence of tiles, such that the
+  // whole frame need not be resident in memory:
+  //  - beginTiledFrame() writes the parameter sets and tile inventory,
+  //  - compressTile() then encodes the slices of each tile in turn.
+  // NB: the sequence bounding box must be set (eg, deriveSeqBoundingBox)
+  //     since it positions the tiles.
+  void beginTiledFrame(
+    EncoderParams* params, const TileInventory& tileInventory, Callbacks*);
+
+  int compressTile(
+    const PCCPointSet3& tileCloud,
+    int tileId,
+    EncoderParams* params,
+    Callbacks*);
+
   void compressPartition(
     const PCCPointSet3& inputPointCloud,
     const PCCPointSet3& originPartCloud,
@@ -108,7 +128,29 @@ public:
 
   static void fixupParameterSets(EncoderParams* params);
 
+  // Set the sps sequence bounding box from that of the source points.
+  static void
+  deriveSeqBoundingBox(const Box3<int32_t>& bbox, SequenceParameterSet* sps);
+
 private:
+  void beginFrame(EncoderParams* params, Callbacks*);
+
+  void partitionTileSlices(
+    const PCCPointSet3& inputPointCloud,
+    const PCCPointSet3& quantizedInputCloud,
+    const std::vector<int32_t>& tile,
+    int tileId,
+    const EncoderParams* params,
+    std::vector<Partition>* slices);
+
+  void compressSlices(
+    const PCCPointSet3& inputPointCloud,
+    const PCCPointSet3& quantizedInputCloud,
+    const std::vector<Partition>& slices,
+    EncoderParams* params,
+    Callbacks*,
+    PCCPointSet3* reconstructedCloud = nullptr);
+
   void appendReconstructedPoints(PCCPointSet3* reconstructedCloud);
 
   void encodeGeometryBrick(const EncoderParams*, PayloadBuffer* buf);
@@ -146,6 +188,9 @@ private:
 
   // Map quantized points to the original input points
   std::multimap<point_t, int32_t> quantizedToOrigin;
+
+  // Attribute encoder, retained between slices to reuse its working memory
+  std::unique_ptr<AttributeEncoderIntf> _attrEncoder;
 };
 
 //----------------------------------------------------------------------------
@@ -45,15 +45,31 @@
 
 #include "PCCTMC3Common.h"
 #include "PCCMisc.h"
+#include "parallel.h"
 
 namespace pcc {
 
 //============================================================================
 
-struct UrahtNode {
-  int64_t pos;
-  int weight;
-};
+// The minimum number of blocks in a level processed by each thread.
+static const size_t kRahtMinGrain = 256;
+
+//============================================================================
+
+void
+appendRahtQuantLayers(
+  const QpSet& qpSet, int numDims, std::vector<RahtQuantLayers>* quantLayers)
+{
+  // NB: the first dimension uses the primary quantiser, the remainder
+  //     use the secondary quantiser.
+  auto layers = qpSet.quantizerLayers();
+  for (int k = 0; k < numDims; k++) {
+    RahtQuantLayers channel;
+    for (const auto& quant : layers)
+      channel.push_back(quant[std::min(k, int(quant.size()) - 1)]);
+    quantLayers->push_back(channel);
+  }
+}
 
 //============================================================================
 // remove any non-unique leaves from a level in the uraht tree
@@ -316,7 +332,7 @@ intraDcPred(
 
     // apply weighted neighbour value to masked positions
     auto neighValueIt = std::next(first, numAttrs * neighIdx[i]);
-    FixedPoint neighValue[3];
+    FixedPoint neighValue[kRahtMaxChannels];
     for (int k = 0; k < numAttrs; k++) {
       neighValue[k] = *neighValueIt++;
       neighValue[k] *= predWeight[i];
@@ -345,6 +361,10 @@ intraDcPred(
 
 //============================================================================
 // Encapsulation of a RAHT transform stage.
+//
+// The butterflies are implemented using branchless fixed-point arithmetic
+// that is equivalent to FixedPoint::operator*=, permitting the transform
+// of multiple buffers to be vectorised.
 
 class RahtKernel {
 public:
@@ -358,40 +378,46 @@ public:
   void fwdTransform(
     FixedPoint left, FixedPoint right, FixedPoint* lf, FixedPoint* hf)
   {
-    FixedPoint a = _a, b = _b;
     // lf = left * a + right * b
     // hf = right * a - left * b
-
-    *lf = right;
-    *lf *= b;
-    *hf = right;
-    *hf *= a;
-
-    a *= left;
-    b *= left;
-
-    *lf += a;
-    *hf -= b;
+    lf->val = mul(right.val, _b.val) + mul(left.val, _a.val);
+    hf->val = mul(right.val, _a.val) - mul(left.val, _b.val);
   }
 
   void invTransform(
     FixedPoint lf, FixedPoint hf, FixedPoint* left, FixedPoint* right)
   {
-    FixedPoint a = _a, b = _b;
-
-    *left = lf;
-    *left *= a;
-    *right = lf;
-    *right *= b;
+    // left = lf * a - hf * b
+    // right = lf * b + hf * a
+    left->val = mul(lf.val, _a.val) - mul(hf.val, _b.val);
+    right->val = mul(lf.val, _b.val) + mul(hf.val, _a.val);
+  }
 
-    b *= hf;
-    a *= hf;
+  // Forward transform elements i0 and i1 of each of numBufs buffers
+  void fwdTransform(int numBufs, FixedPoint buf[][8], int i0, int i1)
+  {
+    for (int k = 0; k < numBufs; k++)
+      fwdTransform(buf[k][i0], buf[k][i1], &buf[k][i0], &buf[k][i1]);
+  }
 
-    *left -= b;
-    *right += a;
+  // Inverse transform elements i0 and i1 of each of numBufs buffers
+  void invTransform(int numBufs, FixedPoint buf[][8], int i0, int i1)
+  {
+    for (int k = 0; k < numBufs; k++)
+      invTransform(buf[k][i0], buf[k][i1], &buf[k][i0], &buf[k][i1]);
   }
 
 private:
+  // Fixed-point product of x and y, rounding half away from zero
+  static int64_t mul(int64_t x, int64_t y)
+  {
+    int64_t prod = x * y;
+    int64_t sign = prod >> 63;
+    int64_t mag = ((prod ^ sign) - sign + FixedPoint::kOneHalf);
+    mag >>= FixedPoint::kFracBits;
+    return (mag ^ sign) - sign;
+  }
+
   FixedPoint _a, _b;
 };
 
@@ -421,10 +447,7 @@ fwdTransformBlock222(int numBufs, FixedPoint buf[][8], int weights[8 + 4 + 2])
 
       // actual transform
       Kernel kernel(weights[iw], weights[iw + 1]);
-      for (int k = 0; k < numBufs; k++) {
-        auto& bufk = buf[k];
-        kernel.fwdTransform(bufk[i0], bufk[i1], &bufk[i0], &bufk[i1]);
-      }
+      kernel.fwdTransform(numBufs, buf, i0, i1);
     }
   }
 }
@@ -456,10 +479,7 @@ invTransformBlock222(int numBufs, FixedPoint buf[][8], int weights[8 + 4 + 2])
 
       // actual transform
       Kernel kernel(weights[iw], weights[iw + 1]);
-      for (int k = 0; k < numBufs; k++) {
-        auto& bufk = buf[k];
-        kernel.invTransform(bufk[i0], bufk[i1], &bufk[i0], &bufk[i1]);
-      }
+      kernel.invTransform(numBufs, buf, i0, i1);
     }
   }
 }
@@ -507,6 +527,20 @@ isSibling(int64_t pos0, int64_t pos1, int level)
   return ((pos0 ^ pos1) >> level) == 0;
 }
 
+//============================================================================
+// Resize a buffer whose contents need not be retained.  Any reallocation
+// is of the requested size, since the buffer is not grown incrementally.
+
+static void
+resizeDiscarding(std::vector<int>* buf, size_t size)
+{
+  if (buf->capacity() < size) {
+    buf->clear();
+    buf->reserve(size);
+  }
+  buf->resize(size);
+}
+
 //============================================================================
 // Core transform process (for encoder/decoder)
 
@@ -514,83 +548,115 @@ template<bool isEncoder>
 void
 uraht_process(
   bool raht_prediction_enabled_flag,
-  const std::vector<Quantizers>& quantLayers,
+  const std::vector<RahtQuantLayers>& quantLayers,
   int numPoints,
   int numAttrs,
   int64_t* positions,
   int* attributes,
-  int32_t* coeffBufIt)
+  int32_t* coeffBufIt,
+  RahtWorkspace* workspace)
 {
-  // coefficients are stored in three planar arrays.  coeffBufItK is a set
-  // of iterators to each array.
-  int32_t* coeffBufItK[3] = {
-    coeffBufIt,
-    coeffBufIt + numPoints,
-    coeffBufIt + numPoints * 2,
-  };
-
-  std::vector<UrahtNode> weightsLf, weightsHf;
-  std::vector<int> attrsLf, attrsHf;
+  assert(numAttrs <= kRahtMaxChannels);
+  assert(quantLayers.size() == numAttrs);
+
+  // coefficients are stored in numAttrs planar arrays.  coeffBufItK is a
+  // set of iterators to each array.
+  int32_t* coeffBufItK[kRahtMaxChannels];
+  for (int k = 0; k < numAttrs; k++)
+    coeffBufItK[k] = coeffBufIt + numPoints * k;
+
+  // Only the encoder uses the attribute sums of each node, the decoder
+  // builds the tree from the weights alone.
+  const int numTreeAttrs = isEncoder ? numAttrs : 0;
+
+  auto& weightsLf = workspace->weightsLf;
+  auto& weightsHf = workspace->weightsHf;
+  auto& attrsLf = workspace->attrsLf;
+  auto& attrsHf = workspace->attrsHf;
+  weightsLf.clear();
+  weightsHf.clear();
+  attrsLf.clear();
+  attrsHf.clear();
 
   weightsLf.reserve(numPoints);
-  attrsLf.reserve(numPoints * numAttrs);
+  attrsLf.reserve(numPoints * numTreeAttrs);
 
   // copy positions into internal form
   // todo(df): lift to api
   for (int i = 0; i < numPoints; i++) {
     weightsLf.emplace_back(UrahtNode{positions[i], 1});
-    for (int k = 0; k < numAttrs; k++) {
+    for (int k = 0; k < numTreeAttrs; k++) {
       attrsLf.push_back(attributes[i * numAttrs + k]);
     }
   }
 
   weightsHf.reserve(numPoints);
-  attrsHf.reserve(numPoints * numAttrs);
+  attrsHf.reserve(numPoints * numTreeAttrs);
 
   // ascend tree
-  std::vector<int> levelHfPos;
+  auto& levelHfPos = workspace->levelHfPos;
+  levelHfPos.clear();
 
   for (int level = 0, numNodes = weightsLf.size(); numNodes > 1; level++) {
     levelHfPos.push_back(weightsHf.size());
     if (level == 0) {
       // process any duplicate points
       numNodes = reduceUnique(
-        numNodes, numAttrs, &weightsLf, &weightsHf, &attrsLf, &attrsHf);
+        numNodes, numTreeAttrs, &weightsLf, &weightsHf, &attrsLf, &attrsHf);
     } else {
       // normal level reduction
       numNodes = reduceLevel(
-        level, numNodes, numAttrs, &weightsLf, &weightsHf, &attrsLf, &attrsHf);
+        level, numNodes, numTreeAttrs, &weightsLf, &weightsHf, &attrsLf,
+        &attrsHf);
     }
   }
 
   assert(weightsLf[0].weight == numPoints);
 
-  // reconstruction buffers
-  std::vector<int> attrRec, attrRecParent;
-  attrRec.resize(numPoints * numAttrs);
-  attrRecParent.resize(numPoints * numAttrs);
+  // reconstruction buffers, sized according to the nodes of each level.
+  // The current and parent buffers are exchanged at each transform level.
+  auto& attrRec = workspace->attrRec;
+  auto& attrRecParent = workspace->attrRecParent;
+  auto& attrRecUs = workspace->attrRecUs;
+  auto& attrRecParentUs = workspace->attrRecParentUs;
+
+  // Transforms are performed at every third level, counting from zero.
+  // The largest, final, level is reconstructed into the buffer that held
+  // it in a previous transform, so that only one buffer grows to the full
+  // number of points.
+  int numTransformLevels =
+    levelHfPos.size() < 2 ? 0 : (int(levelHfPos.size()) - 2) / 3 + 1;
+  if (numTransformLevels % 2) {
+    std::swap(attrRec, attrRecParent);
+    std::swap(attrRecUs, attrRecParentUs);
+  }
 
-  std::vector<int> attrRecUs, attrRecParentUs;
-  attrRecUs.resize(numPoints * numAttrs);
-  attrRecParentUs.resize(numPoints * numAttrs);
+  // without any transform, the single node is reconstructed as zero
+  if (!numTransformLevels)
+    attrRec.assign(numAttrs, 0);
 
-  std::vector<UrahtNode> weightsParent;
-  weightsParent.reserve(numPoints);
+  auto& weightsParent = workspace->weightsParent;
+  weightsParent.clear();
+
+  // the first node and first coefficient of each block in a level
+  auto& blockStart = workspace->blockStart;
+  auto& blockCoeffPos = workspace->blockCoeffPos;
 
   // quant layer selection
-  auto quantLayerIt = quantLayers.begin();
+  int quantLayer = 0;
 
   // descend tree
   weightsLf.resize(1);
-  attrsLf.resize(numAttrs);
+  attrsLf.resize(numTreeAttrs);
   for (int level = levelHfPos.size() - 1, isFirst = 1; level > 0; /*nop*/) {
     int numNodes = weightsHf.size() - levelHfPos[level];
     weightsLf.resize(weightsLf.size() + numNodes);
-    attrsLf.resize(attrsLf.size() + numNodes * numAttrs);
+    attrsLf.resize(attrsLf.size() + numNodes * numTreeAttrs);
     expandLevel(
-      level, numNodes, numAttrs, &weightsLf, &weightsHf, &attrsLf, &attrsHf);
+      level, numNodes, numTreeAttrs, &weightsLf, &weightsHf, &attrsLf,
+      &attrsHf);
     weightsHf.resize(levelHfPos[level]);
-    attrsHf.resize(levelHfPos[level] * numAttrs);
+    attrsHf.resize(levelHfPos[level] * numTreeAttrs);
 
     // expansion of level is complete, processing is now on the next level
     level--;
@@ -606,28 +672,32 @@ uraht_process(
     bool enablePrediction = inheritDc && raht_prediction_enabled_flag;
     isFirst = 0;
 
-    // select quantiser according to transform layer
-    const auto& quant = *quantLayerIt;
-    if (std::next(quantLayerIt) != quantLayers.end())
-      quantLayerIt++;
+    // select quantiser of each attribute according to transform layer
+    const Quantizer* quant[kRahtMaxChannels];
+    for (int k = 0; k < numAttrs; k++) {
+      const auto& layers = quantLayers[k];
+      quant[k] = &layers[std::min(quantLayer, int(layers.size()) - 1)];
+    }
+    quantLayer++;
 
     // prepare reconstruction buffers
     //  previous reconstruction -> attrRecParent
+    //  NB: the upsampled reconstruction is only used by the next level
+    bool isLast = !level;
     std::swap(attrRec, attrRecParent);
     std::swap(attrRecUs, attrRecParentUs);
-    auto attrRecParentUsIt = attrRecParentUs.cbegin();
-    auto attrRecParentIt = attrRecParent.cbegin();
-    auto weightsParentIt = weightsParent.cbegin();
-
+    resizeDiscarding(&attrRec, weightsLf.size() * numAttrs);
+    if (!isLast)
+      resizeDiscarding(&attrRecUs, weightsLf.size() * numAttrs);
+
+    // partition the level into blocks of siblings.  Each block inherits
+    // from a single parent node and codes a known number of coefficients,
+    // permitting the blocks of a level to be processed independently.
+    blockStart.clear();
+    blockCoeffPos.clear();
+    int numLevelCoeffs = 0;
     for (int i = 0, iLast, iEnd = weightsLf.size(); i < iEnd; i = iLast) {
-      // todo(df): hoist and dynamically allocate
-      FixedPoint transformBuf[6][8] = {};
-      FixedPoint(*transformPredBuf)[8] = &transformBuf[numAttrs];
       int weights[8 + 4 + 2] = {};
-      uint8_t occupancy = 0;
-
-      // generate weights, occupancy mask, and fwd transform buffers
-      // for all siblings of the current node.
       for (iLast = i; iLast < iEnd; iLast++) {
         int nextNode = iLast > i
           && !isSibling(weightsLf[iLast].pos, weightsLf[i].pos, level + 3);
@@ -636,11 +706,48 @@ uraht_process(
 
         int nodeIdx = (weightsLf[iLast].pos >> level) & 0x7;
         weights[nodeIdx] = weightsLf[iLast].weight;
+      }
+
+      mkWeightTree(weights);
+      blockStart.push_back(i);
+      blockCoeffPos.push_back(numLevelCoeffs);
+      scanBlock(weights, [&](int idx) {
+        if (!inheritDc || idx)
+          numLevelCoeffs++;
+      });
+    }
+    blockStart.push_back(weightsLf.size());
+
+    auto processBlock = [&](int blockIdx) {
+      const int i = blockStart[blockIdx];
+      const int iLast = blockStart[blockIdx + 1];
+
+      // the parent node and the coefficients of the current block
+      const int parentIdx = inheritDc ? blockIdx : 0;
+      auto attrRecParentUsIt =
+        std::next(attrRecParentUs.cbegin(), parentIdx * numAttrs);
+      auto weightsParentIt = std::next(weightsParent.cbegin(), parentIdx);
+
+      int32_t* blockCoeffIt[kRahtMaxChannels];
+      for (int k = 0; k < numAttrs; k++)
+        blockCoeffIt[k] = coeffBufItK[k] + blockCoeffPos[blockIdx];
+
+      // todo(df): hoist and dynamically allocate
+      FixedPoint transformBuf[2 * kRahtMaxChannels][8] = {};
+      FixedPoint(*transformPredBuf)[8] = &transformBuf[numAttrs];
+      int weights[8 + 4 + 2] = {};
+      uint8_t occupancy = 0;
+
+      // generate weights, occupancy mask, and fwd transform buffers
+      // for all siblings of the current node.
+      for (int j = i; j < iLast; j++) {
+        int nodeIdx = (weightsLf[j].pos >> level) & 0x7;
+        weights[nodeIdx] = weightsLf[j].weight;
         occupancy |= 1 << nodeIdx;
 
         if (isEncoder) {
           for (int k = 0; k < numAttrs; k++)
-            transformBuf[k][nodeIdx] = attrsLf[iLast * numAttrs + k];
+            transformBuf[k][nodeIdx] = attrsLf[j * numAttrs + k];
         }
       }
 
@@ -666,10 +773,8 @@ uraht_process(
       }
 
       int parentWeight = 0;
-      if (inheritDc) {
+      if (inheritDc)
         parentWeight = weightsParentIt->weight;
-        weightsParentIt++;
-      }
 
       // normalise coefficients
       for (int childIdx = 0; childIdx < 8; childIdx++) {
@@ -722,16 +827,16 @@ uraht_process(
         // The RAHT transform
         for (int k = 0; k < numAttrs; k++) {
           // todo: hoist to preallocated array
-          auto& q = quant[std::min(k, int(quant.size()) - 1)];
+          auto& q = *quant[k];
           if (isEncoder) {
             auto coeff = transformBuf[k][idx].round();
             assert(coeff <= INT_MAX && coeff >= INT_MIN);
-            *coeffBufItK[k]++ = coeff =
+            *blockCoeffIt[k]++ = coeff =
               q.quantize(coeff << kFixedPointAttributeShift);
             transformPredBuf[k][idx] +=
               divExp2RoundHalfUp(q.scale(coeff), kFixedPointAttributeShift);
           } else {
-            int64_t coeff = *coeffBufItK[k]++;
+            int64_t coeff = *blockCoeffIt[k]++;
             transformPredBuf[k][idx] +=
               divExp2RoundHalfUp(q.scale(coeff), kFixedPointAttributeShift);
           }
@@ -744,10 +849,8 @@ uraht_process(
         sqrtWeight.val =
           isqrt(uint64_t(parentWeight) << (2 * FixedPoint::kFracBits));
 
-        for (int k = 0; k < numAttrs; k++) {
-          attrRecParentIt++;
+        for (int k = 0; k < numAttrs; k++)
           transformPredBuf[k][0] = *attrRecParentUsIt++;
-        }
       }
 
       invTransformBlock222<RahtKernel>(numAttrs, transformPredBuf, weights);
@@ -756,8 +859,11 @@ uraht_process(
         if (!weights[nodeIdx])
           continue;
 
-        for (int k = 0; k < numAttrs; k++)
-          attrRecUs[j * numAttrs + k] = transformPredBuf[k][nodeIdx].round();
+        if (!isLast) {
+          for (int k = 0; k < numAttrs; k++)
+            attrRecUs[j * numAttrs + k] =
+              transformPredBuf[k][nodeIdx].round();
+        }
 
         // scale values for next level
         if (weights[nodeIdx] > 1) {
@@ -772,30 +878,40 @@ uraht_process(
           attrRec[j * numAttrs + k] = transformPredBuf[k][nodeIdx].round();
         j++;
       }
-    }
+    };
+
+    const int numBlocks = blockCoeffPos.size();
+    parallelFor(0, numBlocks, kRahtMinGrain, [&](size_t begin, size_t end) {
+      for (int blockIdx = begin; blockIdx < end; blockIdx++)
+        processBlock(blockIdx);
+    });
+
+    for (int k = 0; k < numAttrs; k++)
+      coeffBufItK[k] += numLevelCoeffs;
 
     // preserve current weights/positions for later search
-    weightsParent = weightsLf;
+    if (!isLast)
+      weightsParent = weightsLf;
   }
 
-  // process duplicate points at level 0
-  std::swap(attrRec, attrRecParent);
-  auto attrRecParentIt = attrRecParent.cbegin();
+  // process duplicate points at level 0, writing the reconstruction of
+  // each point to the output
+  auto attrRecParentIt = attrRec.cbegin();
   auto attrsHfIt = attrsHf.cbegin();
-  const auto& quant = quantLayers.back();
+  int* attrRecOut = attributes;
 
   for (int i = 0, out = 0, iEnd = weightsLf.size(); i < iEnd; i++) {
     int weight = weightsLf[i].weight;
     // unique points have weight = 1
     if (weight == 1) {
       for (int k = 0; k < numAttrs; k++)
-        attrRec[out++] = *attrRecParentIt++;
+        attrRecOut[out++] = *attrRecParentIt++;
       continue;
     }
 
     // duplicates
-    FixedPoint attrSum[3];
-    FixedPoint attrRecDc[3];
+    FixedPoint attrSum[kRahtMaxChannels];
+    FixedPoint attrRecDc[kRahtMaxChannels];
     FixedPoint sqrtWeight;
     sqrtWeight.val = isqrt(uint64_t(weight) << (2 * FixedPoint::kFracBits));
     for (int k = 0; k < numAttrs; k++) {
@@ -810,7 +926,7 @@ uraht_process(
       sqrtWeight.val = isqrt(uint64_t(w) << (2 * FixedPoint::kFracBits));
 
       for (int k = 0; k < numAttrs; k++) {
-        auto q = quant[std::min(k, int(quant.size()) - 1)];
+        const auto& q = quantLayers[k].back();
 
         FixedPoint transformBuf[2];
         if (isEncoder) {
@@ -847,19 +963,15 @@ uraht_process(
           &transformBuf[1]);
 
         attrRecDc[k] = transformBuf[0];
-        attrRec[out + w * numAttrs + k] = transformBuf[1].round();
+        attrRecOut[out + w * numAttrs + k] = transformBuf[1].round();
         if (w == 1)
-          attrRec[out + k] = transformBuf[0].round();
+          attrRecOut[out + k] = transformBuf[0].round();
       }
     }
 
-    attrsHfIt += (weight - 1) * numAttrs;
+    attrsHfIt += (weight - 1) * numTreeAttrs;
     out += weight * numAttrs;
   }
-
-  // write-back reconstructed attributes
-  assert(attrRec.size() == numAttrs * numPoints);
-  std::copy(attrRec.begin(), attrRec.end(), attributes);
 }
 
 //============================================================================
@@ -884,16 +996,17 @@ uraht_process(
 void
 regionAdaptiveHierarchicalTransform(
   bool raht_prediction_enabled_flag,
-  const std::vector<Quantizers>& quantLayers,
+  const std::vector<RahtQuantLayers>& quantLayers,
   int64_t* mortonCode,
   int* attributes,
   const int attribCount,
   const int voxelCount,
-  int* coefficients)
+  int* coefficients,
+  RahtWorkspace* workspace)
 {
   uraht_process<true>(
     raht_prediction_enabled_flag, quantLayers, voxelCount, attribCount,
-    mortonCode, attributes, coefficients);
+    mortonCode, attributes, coefficients, workspace);
 }
 
 //============================================================================
@@ -916,16 +1029,17 @@ regionAdaptiveHierarchicalTransform(
 void
 regionAdaptiveHierarchicalInverseTransform(
   bool raht_prediction_enabled_flag,
-  const std::vector<Quantizers>& quantLayers,
+  const std::vector<RahtQuantLayers>& quantLayers,
   int64_t* mortonCode,
   int* attributes,
   const int attribCount,
   const int voxelCount,
-  int* coefficients)
+  int* coefficients,
+  RahtWorkspace* workspace)
 {
   uraht_process<false>(
     raht_prediction_enabled_flag, quantLayers, voxelCount, attribCount,
-    mortonCode, attributes, coefficients);
+    mortonCode, attributes, coefficients, workspace);
 }
 
 //============================================================================
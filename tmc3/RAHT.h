@@ -37,29 +37,76 @@
 #include <cstdint>
 
 #include "FixedPoint.h"
+#include "PCCTMC3Common.h"
 #include "quantization.h"
 
-#include "quantization.h"
 #include <vector>
 
 namespace pcc {
 
+//============================================================================
+
+// The maximum number of attribute channels that may be transformed together
+const int kRahtMaxChannels = 8;
+
+// The quantisers of a single attribute channel, one per transform layer.
+// The last quantiser applies to any further layers.
+typedef std::vector<Quantizer> RahtQuantLayers;
+
+// Appends the quantisers of each of the @numDims channels of an attribute
+void appendRahtQuantLayers(
+  const QpSet& qpSet, int numDims, std::vector<RahtQuantLayers>* quantLayers);
+
+//============================================================================
+
+struct UrahtNode {
+  int64_t pos;
+  int weight;
+};
+
+//============================================================================
+// Working memory for the RAHT.
+//
+// A workspace may be used for successive transforms in order to avoid
+// repeatedly allocating buffers proportional to the number of points.
+// Concurrent transforms require distinct workspaces.
+
+struct RahtWorkspace {
+  // Transform input and output arrays, for use by the caller
+  std::vector<MortonCodeWithIndex> packedVoxel;
+  std::vector<int64_t> mortonCode;
+  std::vector<int> attributes;
+  std::vector<int> coefficients;
+
+  // Internal state of the transform
+  std::vector<UrahtNode> weightsLf, weightsHf, weightsParent;
+  std::vector<int> attrsLf, attrsHf;
+  std::vector<int> attrRec, attrRecParent;
+  std::vector<int> attrRecUs, attrRecParentUs;
+  std::vector<int> levelHfPos;
+  std::vector<int> blockStart, blockCoeffPos;
+};
+
+//============================================================================
+
 void regionAdaptiveHierarchicalTransform(
   bool raht_prediction_enabled_flag,
-  const std::vector<Quantizers>& quantLayers,
+  const std::vector<RahtQuantLayers>& quantLayers,
   int64_t* mortonCode,
   int* attributes,
   const int attribCount,
   const int voxelCount,
-  int* coefficients);
+  int* coefficients,
+  RahtWorkspace* workspace);
 
 void regionAdaptiveHierarchicalInverseTransform(
   bool raht_prediction_enabled_flag,
-  const std::vector<Quantizers>& quantLayers,
+  const std::vector<RahtQuantLayers>& quantLayers,
   int64_t* mortonCode,
   int* attributes,
   const int attribCount,
   const int voxelCount,
-  int* coefficients);
+  int* coefficients,
+  RahtWorkspace* workspace);
 
 } /* namespace pcc */
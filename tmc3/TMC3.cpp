@@ -35,15 +35,23 @@
 
 #include "TMC3.h"
 
+#include <algorithm>
+#include <cmath>
 #include <memory>
 
 #include "PCCTMC3Encoder.h"
 #include "PCCTMC3Decoder.h"
+#include "colourspace.h"
 #include "constants.h"
 #include "ply.h"
+#include "rawcloud.h"
 #include "pointset_processing.h"
 #include "program_options_lite.h"
+#include "io_index.h"
 #include "io_tlv.h"
+#include "parallel.h"
+#include "realtime.h"
+#include "tile_spill.h"
 #include "version.h"
 
 using namespace std;
@@ -60,6 +68,9 @@ struct Parameters {
   // output mode for ply writing (binary or ascii)
   bool outputBinaryPly;
 
+  // write ply positions using the most compact exact type
+  bool outputCompactPlyPositions;
+
   // when true, configure the encoder as if no attributes are specified
   bool disableAttributeCoding;
 
@@ -69,6 +80,9 @@ struct Parameters {
   // Number of frames to process.
   int frameCount;
 
+  // Number of frames in each merged input/output file (0 => not merged).
+  int mergedFrameCount;
+
   std::string uncompressedDataPath;
   std::string compressedStreamPath;
   std::string reconstructedDataPath;
@@ -79,6 +93,18 @@ struct Parameters {
   // Filename for saving pre inverse scaled point cloud (decoder).
   std::string preInvScalePath;
 
+  // Filename of the bitstream frame index (encoder=output, decoder=input).
+  std::string frameIndexPath;
+
+  // Prefix of the tile spill files used by out-of-core encoding (encoder).
+  std::string tileSpillPath;
+
+  // Index of the first frame to decode, requires a frame index (decoder).
+  int decodeFirstFrame;
+
+  // Number of frames to decode (decoder, 0 => all remaining frames).
+  int decodeFrameCount;
+
   pcc::EncoderParams encoder;
   pcc::DecoderParams decoder;
 
@@ -87,19 +113,86 @@ struct Parameters {
 
   // todo(df): this should be per-attribute
   int reflectanceScale;
+
+  // Number of threads used for parallel processing (0 => hardware threads)
+  int numThreads;
+
+  // Trade-off between encoder complexity and coding efficiency (0 => none)
+  int speedPreset;
+
+  // Per-frame encoder latency control
+  pcc::RealtimeParams realtime;
+};
+
+//----------------------------------------------------------------------------
+// The path denoting the standard input or output streams.  Point clouds
+// are carried by these streams as a sequence of native format records.
+
+static const char kStdioPath[] = "-";
+
+//----------------------------------------------------------------------------
+// Accumulates output frames into groups of mergedFrameCount frames, each
+// group being written as a single point cloud in which the frame index of
+// each point identifies its frame within the group.
+
+class MergedFrameWriter {
+public:
+  // NB: params and stdoutData must outlive the lifetime of the writer.
+  MergedFrameWriter(const Parameters* params, std::ostream* stdoutData)
+    : params(params), _stdoutData(stdoutData)
+  {}
+
+  // Add the frame numbered @a frameNum to the current group, writing the
+  // group once complete.  The remaining arguments are as per ply::write.
+  bool add(
+    const PCCPointSet3& frame,
+    int frameNum,
+    const std::string& pathSpec,
+    const ply::PropertyNameMap& attrNames,
+    double positionScale,
+    Vec3<int32_t> positionOffset);
+
+  // Write any incomplete group.
+  bool flush();
+
+  // Write a single point cloud to fileName without grouping.
+  bool write(
+    const PCCPointSet3& cloud,
+    const std::string& fileName,
+    const ply::PropertyNameMap& attrNames,
+    double positionScale,
+    Vec3<int32_t> positionOffset);
+
+private:
+  const Parameters* params;
+
+  // Destination of output written to kStdioPath
+  std::ostream* _stdoutData;
+
+  // the current group and the arguments used to write it
+  PCCPointSet3 _cloud;
+  std::string _fileName;
+  ply::PropertyNameMap _attrNames;
+  double _positionScale;
+  Vec3<int32_t> _positionOffset;
 };
 
 //----------------------------------------------------------------------------
 
 class SequenceEncoder : public PCCTMC3Encoder3::Callbacks {
 public:
-  // NB: params must outlive the lifetime of the decoder.
-  SequenceEncoder(Parameters* params);
+  // NB: params and stdoutData must outlive the lifetime of the encoder.
+  SequenceEncoder(Parameters* params, std::ostream* stdoutData);
 
   int compress(Stopwatch* clock);
 
 protected:
   int compressOneFrame(Stopwatch* clock);
+  int readSourceFrame(PCCPointSet3* cloud);
+  void sanitiseSourceFrame(PCCPointSet3* cloud);
+
+  int spillSourceTiles(TileSpill* tiles);
+  int compressSpilledTiles(const TileSpill& tiles);
 
   void onOutputBuffer(const PayloadBuffer& buf) override;
   void onPostRecolour(const PCCPointSet3& cloud) override;
@@ -109,9 +202,24 @@ private:
 
   Parameters* params;
   PCCTMC3Encoder3 encoder;
+  RealtimeController _realtime;
 
   std::ofstream bytestreamFile;
 
+  // The output bitstream: either bytestreamFile or stdout
+  std::ostream* _bytestream;
+
+  // Number of bytes written to the output bitstream
+  int64_t _bytestreamLen;
+
+  // Index of the frames written to the output bitstream
+  FrameIndex _frameIndex;
+
+  // Frames of the current merged input file
+  std::vector<PCCPointSet3> _sourceFrames;
+
+  MergedFrameWriter _reconWriter;
+
   int frameNum;
 };
 
@@ -119,8 +227,8 @@ private:
 
 class SequenceDecoder : public PCCTMC3Decoder3::Callbacks {
 public:
-  // NB: params must outlive the lifetime of the decoder.
-  SequenceDecoder(const Parameters* params);
+  // NB: params and stdoutData must outlive the lifetime of the decoder.
+  SequenceDecoder(const Parameters* params, std::ostream* stdoutData);
 
   int decompress(Stopwatch* clock);
 
@@ -129,33 +237,50 @@ protected:
     const SequenceParameterSet& sps,
     const PCCPointSet3& decodedPointCloud) override;
 
+  void onOutputSlice(
+    const SequenceParameterSet& sps,
+    const DecodedSliceInfo& info,
+    const PCCPointSet3& decodedSlice) override;
+
 private:
+  void convertOutput(const SequenceParameterSet& sps, PCCPointSet3& cloud);
+
   const Parameters* params;
   PCCTMC3Decoder3 decoder;
 
-  std::ofstream bytestreamFile;
+  MergedFrameWriter _outputWriter;
+
+  // Set when output to stdout fails, terminating decoding
+  bool _liveOutputFailed;
 
   int frameNum;
   Stopwatch* clock;
+
+  // Index of the next slice to be output in the current frame
+  int sliceNum;
 };
 
 //============================================================================
 
 void convertToGbr(const SequenceParameterSet& sps, PCCPointSet3& cloud);
-void convertFromGbr(const SequenceParameterSet& sps, PCCPointSet3& cloud);
+void convertInputAttributes(const Parameters& params, PCCPointSet3& cloud);
 
 //============================================================================
 
 int
 main(int argc, char* argv[])
 {
-  cout << "MPEG PCC tmc3 version " << ::pcc::version << endl;
+  // Retain the standard output stream for use when it carries data.
+  // NB: console output may be redirected by ParseParameters.
+  std::ostream stdoutData(std::cout.rdbuf());
 
   Parameters params;
   if (!ParseParameters(argc, argv, params)) {
     return -1;
   }
 
+  pcc::setNumThreads(params.numThreads);
+
   // Timers to count elapsed wall/user time
   pcc::chrono::Stopwatch<std::chrono::steady_clock> clock_wall;
   pcc::chrono::Stopwatch<pcc::chrono::utime_inc_children_clock> clock_user;
@@ -164,9 +289,9 @@ main(int argc, char* argv[])
 
   int ret = 0;
   if (params.isDecoder) {
-    ret = SequenceDecoder(&params).decompress(&clock_user);
+    ret = SequenceDecoder(&params, &stdoutData).decompress(&clock_user);
   } else {
-    ret = SequenceEncoder(&params).compress(&clock_user);
+    ret = SequenceEncoder(&params, &stdoutData).compress(&clock_user);
   }
 
   clock_wall.stop();
@@ -399,6 +524,12 @@ ParseParameters(int argc, char* argv[], Parameters& params)
      params.frameCount, 1,
      "Number of frames to encode")
 
+  ("mergedFrameCount",
+     params.mergedFrameCount, 0,
+     "Number of frames in each input (encoder) or output file, with each "
+     "frame identified by the frameindex property:\n"
+     "  0: one frame per file")
+
   ("reconstructedDataPath",
     params.reconstructedDataPath, {},
     "The ouput reconstructed pointcloud file path (decoder only)")
@@ -419,10 +550,19 @@ ParseParameters(int argc, char* argv[], Parameters& params)
     params.preInvScalePath, {},
     "Pre inverse scaled pointcloud file path (decoder only)")
 
+  ("frameIndexPath",
+    params.frameIndexPath, {},
+    "The bitstream frame index path (encoder=output, decoder=input)")
+
   ("outputBinaryPly",
     params.outputBinaryPly, false,
     "Output ply files using binary (or otherwise ascii) format")
 
+  ("outputCompactPlyPositions",
+    params.outputCompactPlyPositions, false,
+    "Output ply positions using the most compact exact type (int32, "
+    "float or float64), rather than always as floating point")
+
   ("convertPlyColourspace",
     params.convertColourspace, true,
     "Convert ply colourspace according to attribute colourMatrix")
@@ -434,6 +574,11 @@ ParseParameters(int argc, char* argv[], Parameters& params)
     "scale factor to be applied to reflectance "
     "pre encoding / post reconstruction")
 
+  ("numThreads",
+    params.numThreads, 1,
+    "Number of threads used for parallel processing:\n"
+    "  0: one thread per hardware thread")
+
   (po::Section("Decoder"))
 
   ("skipOctreeLayers",
@@ -442,8 +587,39 @@ ParseParameters(int argc, char* argv[], Parameters& params)
     " N>0 : Skip the bottom N layers in decoding process.\n"
     " skipLayerNum indicates the number of skipped lod layers from leaf lod.")
 
+  ("outputSlices",
+    params.decoder.outputSlices, false,
+    "Output each slice as soon as it is decoded rather than complete "
+    "frames.  Slices are written to reconstructedDataPath with the "
+    "suffix _slice<N>, numbered in decoding order (or to stdout)")
+
+  ("decodeFirstFrame",
+    params.decodeFirstFrame, 0,
+    "Index of the first frame in the bitstream to decode "
+    "(requires frameIndexPath)")
+
+  ("decodeFrameCount",
+    params.decodeFrameCount, 0,
+    "Number of frames to decode (requires frameIndexPath):\n"
+    "  0: all remaining frames")
+
   (po::Section("Encoder"))
 
+  ("speedPreset",
+    params.speedPreset, 0,
+    "Encoder complexity/efficiency trade-off (non-normative):\n"
+    "  0: exhaustive encoder decisions\n"
+    "  1: limit attribute prediction mode search to the first direct "
+    "predictor, four forward recolouring neighbours\n"
+    "  2: no attribute prediction mode search (weighted average "
+    "prediction only), single neighbour recolouring")
+
+  ("realtimeFrameLatency",
+    params.realtime.frameLatencyMs, 0.,
+    "Target encoding time per frame in milliseconds.  The encoder adapts "
+    "its complexity between frames to meet the target:\n"
+    "  0: disabled")
+
   ("geometry_axis_order",
     params.encoder.sps.geometry_axis_order, AxisOrder::kXYZ,
     "Sets the geometry axis coding order:\n"
@@ -478,11 +654,26 @@ ParseParameters(int argc, char* argv[], Parameters& params)
     "  0: none\n"
     "  1: none (deprecated)\n"
     "  2: n Uniform-Geometry partition bins along the longest edge\n"
-    "  3: Uniform Geometry partition at n octree depth")
+    "  3: Uniform Geometry partition at n octree depth\n"
+    "  4: Cost balanced partition in morton order")
 
   ("partitionOctreeDepth",
     params.encoder.partition.octreeDepth, 1,
-    "Depth of octree partition for partitionMethod=4")
+    "Depth of octree partition for partitionMethod=3")
+
+  ("partitionSliceCount",
+    params.encoder.partition.sliceCount, 0,
+    "Number of slices per tile for partitionMethod=4 "
+    "(0 => determined by sliceMaxPoints)")
+
+  ("partitionNodeCost",
+    params.encoder.partition.nodeCost, 2.5,
+    "Expected geometry coding time per octree node (us) "
+    "for partitionMethod=4")
+
+  ("partitionPointCost",
+    params.encoder.partition.pointCost, 13.,
+    "Expected attribute coding time per point (us) for partitionMethod=4")
 
   ("sliceMaxPoints",
     params.encoder.partition.sliceMaxPoints, 1100000,
@@ -496,6 +687,12 @@ ParseParameters(int argc, char* argv[], Parameters& params)
     params.encoder.partition.tileSize, 0,
     "Partition input into cubic tiles of given size")
 
+  ("tileSpillPath",
+    params.tileSpillPath, {},
+    "Encode each frame one tile at a time, spilling tiles to temporary "
+    "files with the given path prefix (requires tileSize and native "
+    "format input)")
+
   ("cabac_bypass_stream_enabled_flag",
     params.encoder.sps.cabac_bypass_stream_enabled_flag, false,
     "Controls coding method for ep(bypass) bins")
@@ -771,6 +968,15 @@ ParseParameters(int argc, char* argv[], Parameters& params)
     err.warn() << "Unhandled argument ignored: " << arg << "\n";
   }
 
+  // When the standard output carries data, console output uses stderr
+  bool isStdoutData = params.reconstructedDataPath == kStdioPath;
+  if (!params.isDecoder)
+    isStdoutData |= params.compressedStreamPath == kStdioPath;
+  if (isStdoutData)
+    std::cout.rdbuf(std::cerr.rdbuf());
+
+  cout << "MPEG PCC tmc3 version " << ::pcc::version << endl;
+
   if (argc == 1 || print_help) {
     po::doHelp(std::cout, opts, 78);
     return false;
@@ -796,6 +1002,23 @@ ParseParameters(int argc, char* argv[], Parameters& params)
     params.encoder.gps.geom_planar_mode_enabled_flag = false;
   }
 
+  // Map the speed preset to the individual encoder decisions.
+  // NB: these only affect encoder search effort, never conformance.
+  params.encoder.attrEnc.predModeMaxCandidates = -1;
+  if (params.speedPreset >= 1) {
+    params.encoder.attrEnc.predModeMaxCandidates = 1;
+
+    auto& recolour = params.encoder.recolour;
+    recolour.numNeighboursFwd = std::min(recolour.numNeighboursFwd, 4);
+  }
+  if (params.speedPreset >= 2) {
+    params.encoder.attrEnc.predModeMaxCandidates = 0;
+
+    auto& recolour = params.encoder.recolour;
+    recolour.numNeighboursFwd = std::min(recolour.numNeighboursFwd, 1);
+    recolour.numNeighboursBwd = std::min(recolour.numNeighboursBwd, 1);
+  }
+
   // support disabling attribute coding (simplifies configuration)
   if (params.disableAttributeCoding) {
     params.encoder.attributeIdxMap.clear();
@@ -888,6 +1111,12 @@ ParseParameters(int argc, char* argv[], Parameters& params)
 
   // sanity checks
 
+  if (params.speedPreset < 0 || params.speedPreset > 2)
+    err.error() << "speedPreset must be in the range [0,2]\n";
+
+  if (params.realtime.frameLatencyMs < 0)
+    err.error() << "realtimeFrameLatency must be positive\n";
+
   if (
     params.encoder.partition.sliceMaxPoints
     < params.encoder.partition.sliceMinPoints)
@@ -980,6 +1209,59 @@ ParseParameters(int argc, char* argv[], Parameters& params)
   if (params.compressedStreamPath.empty())
     err.error() << "compressedStreamPath not set\n";
 
+  if (params.isDecoder && params.frameIndexPath.empty()) {
+    if (params.decodeFirstFrame || params.decodeFrameCount)
+      err.error() << "decoding a frame range requires frameIndexPath\n";
+  }
+
+  if (params.isDecoder && params.frameIndexPath.size()) {
+    if (params.compressedStreamPath == kStdioPath)
+      err.error() << "frameIndexPath requires a seekable bitstream\n";
+  }
+
+  if (
+    !params.isDecoder && params.compressedStreamPath == kStdioPath
+    && params.reconstructedDataPath == kStdioPath)
+    err.error() << "bitstream and reconstruction cannot both use stdout\n";
+
+  // NB: the native format written to stdout has integer positions
+  if (!params.isDecoder && params.reconstructedDataPath == kStdioPath) {
+    double scale = 1.0 / params.encoder.sps.seq_source_geom_scale_factor;
+    if (scale != std::floor(scale))
+      err.error() << "reconstruction to stdout requires the reciprocal of "
+                     "positionQuantizationScale to be an integer\n";
+  }
+
+  if (params.decodeFirstFrame < 0 || params.decodeFrameCount < 0)
+    err.error() << "decodeFirstFrame/decodeFrameCount must be positive\n";
+
+  if (!params.isDecoder && !params.tileSpillPath.empty()) {
+    if (!params.encoder.partition.tileSize)
+      err.error() << "tileSpillPath requires tileSize\n";
+
+    // NB: without partitioning, tileSize is ignored
+    if (params.encoder.partition.method == PartitionMethod::kNone)
+      err.error() << "tileSpillPath cannot be used with partitionMethod=0\n";
+
+    if (!rawcloud::isRawCloudPath(params.uncompressedDataPath))
+      err.error() << "tileSpillPath requires a native format source\n";
+
+    if (params.mergedFrameCount > 1)
+      err.error() << "tileSpillPath cannot be used with mergedFrameCount\n";
+
+    if (!params.reconstructedDataPath.empty())
+      err.error() << "tileSpillPath cannot be used with "
+                     "reconstructedDataPath\n";
+  }
+
+  if (params.isDecoder && params.decoder.outputSlices) {
+    if (params.mergedFrameCount > 1)
+      err.error() << "outputSlices cannot be used with mergedFrameCount\n";
+
+    if (!params.preInvScalePath.empty())
+      err.error() << "outputSlices cannot be used with preInvScalePath\n";
+  }
+
   // report the current configuration (only in the absence of errors so
   // that errors/warnings are more obvious and in the same place).
   if (err.is_errored)
@@ -1013,7 +1295,93 @@ ParseParameters(int argc, char* argv[], Parameters& params)
 
 //============================================================================
 
-SequenceEncoder::SequenceEncoder(Parameters* params) : params(params)
+bool
+MergedFrameWriter::add(
+  const PCCPointSet3& frame,
+  int frameNum,
+  const std::string& pathSpec,
+  const ply::PropertyNameMap& attrNames,
+  double positionScale,
+  Vec3<int32_t> positionOffset)
+{
+  if (params->mergedFrameCount <= 1) {
+    return write(
+      frame, expandNum(pathSpec, frameNum), attrNames, positionScale,
+      positionOffset);
+  }
+
+  // Frames are grouped relative to the first frame in the sequence
+  const int seqFrameIdx = frameNum - params->firstFrameNum;
+  const int groupFrameIdx = seqFrameIdx % params->mergedFrameCount;
+  const int groupNum =
+    params->firstFrameNum + seqFrameIdx / params->mergedFrameCount;
+
+  _fileName = expandNum(pathSpec, groupNum);
+  _attrNames = attrNames;
+  _positionScale = positionScale;
+  _positionOffset = positionOffset;
+  appendFrame(frame, groupFrameIdx, &_cloud);
+
+  if (groupFrameIdx == params->mergedFrameCount - 1)
+    return flush();
+
+  return true;
+}
+
+//----------------------------------------------------------------------------
+
+bool
+MergedFrameWriter::flush()
+{
+  if (!_cloud.getPointCount())
+    return true;
+
+  bool ok =
+    write(_cloud, _fileName, _attrNames, _positionScale, _positionOffset);
+
+  _cloud.clear();
+  return ok;
+}
+
+//----------------------------------------------------------------------------
+
+bool
+MergedFrameWriter::write(
+  const PCCPointSet3& cloud,
+  const std::string& fileName,
+  const ply::PropertyNameMap& attrNames,
+  double positionScale,
+  Vec3<int32_t> positionOffset)
+{
+  if (fileName != kStdioPath) {
+    return writePointCloud(
+      cloud, attrNames, positionScale, positionOffset, fileName,
+      !params->outputBinaryPly, params->outputCompactPlyPositions);
+  }
+
+  // NB: the native format cannot represent fractional positions
+  if (positionScale != std::floor(positionScale)) {
+    cout << "Error: output to stdout requires an integer geometry scale"
+         << endl;
+    return false;
+  }
+
+  // each frame is made available to the consumer immediately
+  if (!rawcloud::write(cloud, positionScale, positionOffset, *_stdoutData))
+    return false;
+
+  return bool(_stdoutData->flush());
+}
+
+//============================================================================
+
+SequenceEncoder::SequenceEncoder(
+  Parameters* params, std::ostream* stdoutData)
+  : params(params)
+  , _realtime(params->realtime, params->encoder)
+  , _bytestream(stdoutData)
+  , _bytestreamLen(0)
+  , _reconWriter(params, stdoutData)
 {
   // determine the naming (ordering) of ply properties
   _plyAttrNames.position =
@@ -1025,19 +1393,45 @@ SequenceEncoder::SequenceEncoder(Parameters* params) : params(params)
 int
 SequenceEncoder::compress(Stopwatch* clock)
 {
-  bytestreamFile.open(params->compressedStreamPath, ios::binary);
-  if (!bytestreamFile.is_open()) {
-    return -1;
+  if (params->compressedStreamPath != kStdioPath) {
+    bytestreamFile.open(params->compressedStreamPath, ios::binary);
+    if (!bytestreamFile.is_open()) {
+      return -1;
+    }
+    _bytestream = &bytestreamFile;
   }
 
+  // NB: live input is encoded until its end, ignoring frameCount
+  const bool isLiveInput = params->uncompressedDataPath == kStdioPath;
   const int lastFrameNum = params->firstFrameNum + params->frameCount;
-  for (frameNum = params->firstFrameNum; frameNum < lastFrameNum; frameNum++) {
-    if (compressOneFrame(clock))
+  for (frameNum = params->firstFrameNum;
+       isLiveInput || frameNum < lastFrameNum; frameNum++) {
+    int ret = compressOneFrame(clock);
+    if (ret < 0)
+      return -1;
+
+    // end of live input
+    if (ret > 0)
+      break;
+  }
+
+  if (!_reconWriter.flush()) {
+    cout << "Error: can't open output file!" << endl;
+    if (params->reconstructedDataPath == kStdioPath)
       return -1;
   }
 
-  std::cout << "Total bitstream size " << bytestreamFile.tellp() << " B\n";
-  bytestreamFile.close();
+  std::cout << "Total bitstream size " << _bytestreamLen << " B\n";
+  _bytestream->flush();
+  if (bytestreamFile.is_open())
+    bytestreamFile.close();
+
+  if (!params->frameIndexPath.empty()) {
+    if (!writeFrameIndex(_frameIndex, params->frameIndexPath)) {
+      cout << "Error: can't write frame index!" << endl;
+      return -1;
+    }
+  }
 
   return 0;
 }
@@ -1045,58 +1439,135 @@ SequenceEncoder::compress(Stopwatch* clock)
 //----------------------------------------------------------------------------
 
 int
-SequenceEncoder::compressOneFrame(Stopwatch* clock)
+SequenceEncoder::readSourceFrame(PCCPointSet3* cloud)
 {
-  std::string srcName{expandNum(params->uncompressedDataPath, frameNum)};
-  PCCPointSet3 pointCloud;
+  // Live input is read from a sequence of native format records, ending
+  // at the end of the stream.
+  const bool isLiveInput = params->uncompressedDataPath == kStdioPath;
+  auto readInput = [&](const std::string& srcName, PCCPointSet3* cloud) {
+    if (!isLiveInput)
+      return readPointCloud(srcName, _plyAttrNames, *cloud);
+    return rawcloud::read(std::cin, *cloud);
+  };
+
+  if (params->mergedFrameCount <= 1) {
+    if (isLiveInput && std::cin.peek() == EOF)
+      return 1;
+
+    std::string srcName{expandNum(params->uncompressedDataPath, frameNum)};
+    if (!readInput(srcName, cloud) || cloud->getPointCount() == 0) {
+      cout << "Error: can't open input file!" << endl;
+      return -1;
+    }
+    return 0;
+  }
+
+  // Each merged input file is read once, and split into its frames, upon
+  // reaching its first frame.
+  const int seqFrameIdx = frameNum - params->firstFrameNum;
+  const int groupFrameIdx = seqFrameIdx % params->mergedFrameCount;
+  if (!groupFrameIdx) {
+    int groupNum =
+      params->firstFrameNum + seqFrameIdx / params->mergedFrameCount;
+    std::string srcName{expandNum(params->uncompressedDataPath, groupNum)};
+
+    if (isLiveInput && std::cin.peek() == EOF)
+      return 1;
+
+    PCCPointSet3 merged;
+    if (!readInput(srcName, &merged)) {
+      cout << "Error: can't open input file!" << endl;
+      return -1;
+    }
+
+    if (!merged.hasFrameIndex()) {
+      cout << "Error: missing frameindex property: " << srcName << endl;
+      return -1;
+    }
+
+    splitFrames(merged, &_sourceFrames);
+    if (_sourceFrames.size() > params->mergedFrameCount) {
+      cout << "Error: frameindex exceeds mergedFrameCount: " << srcName
+           << endl;
+      return -1;
+    }
+  }
+
+  // NB: the last group of a live input may be incomplete
+  if (isLiveInput && groupFrameIdx >= _sourceFrames.size())
+    return 1;
+
   if (
-    !ply::read(srcName, _plyAttrNames, pointCloud)
-    || pointCloud.getPointCount() == 0) {
-    cout << "Error: can't open input file!" << endl;
+    groupFrameIdx >= _sourceFrames.size()
+    || !_sourceFrames[groupFrameIdx].getPointCount()) {
+    cout << "Error: frame " << frameNum << " missing from input!" << endl;
     return -1;
   }
 
-  // Sanitise the input point cloud
-  // todo(df): remove the following with generic handling of properties
-  bool codeColour = params->encoder.attributeIdxMap.count("color");
-  if (!codeColour)
-    pointCloud.removeColors();
-  assert(codeColour == pointCloud.hasColors());
-
-  bool codeReflectance = params->encoder.attributeIdxMap.count("reflectance");
-  if (!codeReflectance)
-    pointCloud.removeReflectances();
-  assert(codeReflectance == pointCloud.hasReflectances());
+  cloud->swap(_sourceFrames[groupFrameIdx]);
+  return 0;
+}
 
-  clock->start();
+//----------------------------------------------------------------------------
 
-  if (params->convertColourspace)
-    convertFromGbr(params->encoder.sps, pointCloud);
+int
+SequenceEncoder::compressOneFrame(Stopwatch* clock)
+{
+  // Out-of-core encoding reads the source frame one tile at a time
+  const bool isTiledSource = !params->tileSpillPath.empty();
+  TileSpill tiles(expandNum(params->tileSpillPath, frameNum));
 
-  if (params->reflectanceScale > 1 && pointCloud.hasReflectances()) {
-    const auto pointCount = pointCloud.getPointCount();
-    for (size_t i = 0; i < pointCount; ++i) {
-      int val = pointCloud.getReflectance(i) / params->reflectanceScale;
-      pointCloud.setReflectance(i, val);
-    }
+  PCCPointSet3 pointCloud;
+  if (isTiledSource) {
+    if (int ret = spillSourceTiles(&tiles))
+      return ret;
+  } else {
+    if (int ret = readSourceFrame(&pointCloud))
+      return ret;
+    sanitiseSourceFrame(&pointCloud);
   }
 
+  clock->start();
+
+  convertInputAttributes(*params, pointCloud);
+
   // The reconstructed point cloud
   std::unique_ptr<PCCPointSet3> reconPointCloud;
   if (!params->reconstructedDataPath.empty()) {
     reconPointCloud.reset(new PCCPointSet3);
   }
 
-  auto bytestreamLenFrameStart = bytestreamFile.tellp();
+  auto bytestreamLenFrameStart = _bytestreamLen;
+  _frameIndex.startFrame();
 
-  int ret = encoder.compress(
-    pointCloud, &params->encoder, this, reconPointCloud.get());
+  if (_realtime.enabled())
+    _realtime.configure(&params->encoder);
+
+  pcc::chrono::Stopwatch<std::chrono::steady_clock> clock_frame;
+  clock_frame.start();
+
+  int ret = isTiledSource
+    ? compressSpilledTiles(tiles)
+    : encoder.compress(
+        pointCloud, &params->encoder, this, reconPointCloud.get());
   if (ret) {
     cout << "Error: can't compress point cloud!" << endl;
     return -1;
   }
 
-  auto bytestreamLenFrameEnd = bytestreamFile.tellp();
+  auto frameTime = clock_frame.stop();
+  if (_realtime.enabled()) {
+    _realtime.report(std::cout, params->encoder, frameTime);
+    _realtime.update(frameTime);
+  }
+
+  // A live bitstream marks the end of each frame, permitting the decoder
+  // to output the frame without waiting for the next.
+  if (params->compressedStreamPath == kStdioPath)
+    onOutputBuffer(PayloadBuffer(PayloadType::kFrameBoundaryMarker));
+
+  auto bytestreamLenFrameEnd = _bytestreamLen;
+  _frameIndex.endFrame(bytestreamLenFrameEnd);
   int frameLen = bytestreamLenFrameEnd - bytestreamLenFrameStart;
 
   std::cout << "Total frame size " << frameLen << " B" << std::endl;
@@ -1116,12 +1587,95 @@ SequenceEncoder::compressOneFrame(Stopwatch* clock)
       }
     }
 
-    std::string recName{expandNum(params->reconstructedDataPath, frameNum)};
-    ply::write(
-      *reconPointCloud, _plyAttrNames,
-      1.0 / params->encoder.sps.seq_source_geom_scale_factor,
-      params->encoder.sps.seq_bounding_box_xyz0, recName,
-      !params->outputBinaryPly);
+    if (!_reconWriter.add(
+          *reconPointCloud, frameNum, params->reconstructedDataPath,
+          _plyAttrNames,
+          1.0 / params->encoder.sps.seq_source_geom_scale_factor,
+          params->encoder.sps.seq_bounding_box_xyz0)) {
+      cout << "Error: can't open output file!" << endl;
+
+      // frames lost from live output cannot be recovered by the consumer
+      if (params->reconstructedDataPath == kStdioPath)
+        return -1;
+    }
+  }
+
+  return 0;
+}
+
+//----------------------------------------------------------------------------
+
+void
+SequenceEncoder::sanitiseSourceFrame(PCCPointSet3* cloud)
+{
+  // todo(df): remove the following with generic handling of properties
+  bool codeColour = params->encoder.attributeIdxMap.count("color");
+  if (!codeColour)
+    cloud->removeColors();
+  assert(codeColour == cloud->hasColors());
+
+  bool codeReflectance = params->encoder.attributeIdxMap.count("reflectance");
+  if (!codeReflectance)
+    cloud->removeReflectances();
+  assert(codeReflectance == cloud->hasReflectances());
+}
+
+//----------------------------------------------------------------------------
+// Partition the source frame into tiles held in spill files.
+
+int
+SequenceEncoder::spillSourceTiles(TileSpill* tiles)
+{
+  std::string srcName{expandNum(params->uncompressedDataPath, frameNum)};
+  rawcloud::BlockReader src;
+  if (!src.open(srcName) || !src.pointCount()) {
+    cout << "Error: can't open input file!" << endl;
+    return -1;
+  }
+
+  // The sequence bounding box positions the tiles, requiring it to be
+  // known before partitioning (rather than as determined by the encoder)
+  auto& sps = params->encoder.sps;
+  if (sps.seq_bounding_box_whd == Vec3<int>{0}) {
+    Box3<int32_t> bbox{{INT32_MAX, INT32_MAX, INT32_MAX},
+                       {INT32_MIN, INT32_MIN, INT32_MIN}};
+
+    PCCPointSet3 block;
+    while (src.read(1 << 20, &block))
+      bbox.merge(block.computeBoundingBox());
+    src.rewind();
+
+    PCCTMC3Encoder3::deriveSeqBoundingBox(bbox, &sps);
+  }
+
+  if (!tiles->partition(src, sps, params->encoder.partition.tileSize)) {
+    cout << "Error: can't write tile spill files!" << endl;
+    return -1;
+  }
+
+  return 0;
+}
+
+//----------------------------------------------------------------------------
+// Encode the spilled tiles of a frame, each being loaded in turn.
+
+int
+SequenceEncoder::compressSpilledTiles(const TileSpill& tiles)
+{
+  encoder.beginTiledFrame(&params->encoder, tiles.tileInventory(), this);
+
+  for (int t = 0; t < tiles.numTiles(); t++) {
+    PCCPointSet3 tileCloud;
+    if (!tiles.loadTile(t, &tileCloud)) {
+      cout << "Error: can't read tile spill file!" << endl;
+      return -1;
+    }
+
+    sanitiseSourceFrame(&tileCloud);
+    convertInputAttributes(*params, tileCloud);
+
+    if (int ret = encoder.compressTile(tileCloud, t, &params->encoder, this))
+      return ret;
   }
 
   return 0;
@@ -1132,7 +1686,13 @@ SequenceEncoder::compressOneFrame(Stopwatch* clock)
 void
 SequenceEncoder::onOutputBuffer(const PayloadBuffer& buf)
 {
-  writeTlv(buf, bytestreamFile);
+  _frameIndex.addPayload(buf.type, _bytestreamLen);
+  writeTlv(buf, *_bytestream);
+  _bytestreamLen += kTlvHeaderSize + buf.size();
+
+  // each payload of a live bitstream is sent immediately
+  if (params->compressedStreamPath == kStdioPath)
+    _bytestream->flush();
 }
 
 //----------------------------------------------------------------------------
@@ -1148,27 +1708,31 @@ SequenceEncoder::onPostRecolour(const PCCPointSet3& cloud)
 
   // todo(df): stop the clock
   if (!params->convertColourspace) {
-    ply::write(
+    writePointCloud(
       cloud, _plyAttrNames,
       1.0 / params->encoder.sps.seq_source_geom_scale_factor,
       params->encoder.sps.seq_bounding_box_xyz0, plyName,
-      !params->outputBinaryPly);
+      !params->outputBinaryPly, params->outputCompactPlyPositions);
     return;
   }
 
   PCCPointSet3 tmpCloud(cloud);
   convertToGbr(params->encoder.sps, tmpCloud);
-  ply::write(
+  writePointCloud(
     tmpCloud, _plyAttrNames,
     1.0 / params->encoder.sps.seq_source_geom_scale_factor,
     params->encoder.sps.seq_bounding_box_xyz0, plyName,
-    !params->outputBinaryPly);
+    !params->outputBinaryPly, params->outputCompactPlyPositions);
 }
 
 //============================================================================
 
-SequenceDecoder::SequenceDecoder(const Parameters* params)
-  : params(params), decoder(params->decoder)
+SequenceDecoder::SequenceDecoder(
+  const Parameters* params, std::ostream* stdoutData)
+  : params(params)
+  , decoder(params->decoder)
+  , _outputWriter(params, stdoutData)
+  , _liveOutputFailed(false)
 {}
 
 //----------------------------------------------------------------------------
@@ -1176,38 +1740,109 @@ SequenceDecoder::SequenceDecoder(const Parameters* params)
 int
 SequenceDecoder::decompress(Stopwatch* clock)
 {
-  ifstream fin(params->compressedStreamPath, ios::binary);
-  if (!fin.is_open()) {
-    return -1;
+  ifstream fin;
+  std::istream* in = &std::cin;
+  if (params->compressedStreamPath != kStdioPath) {
+    fin.open(params->compressedStreamPath, ios::binary);
+    if (!fin.is_open()) {
+      return -1;
+    }
+    in = &fin;
   }
 
   frameNum = params->firstFrameNum;
+  sliceNum = 0;
   this->clock = clock;
 
   PayloadBuffer buf;
 
   clock->start();
 
+  // When decoding a range of frames, the decoder is primed with the
+  // parameter sets active for the first frame before seeking to its
+  // first brick.  Decoding stops at the end of the last frame.
+  // NB: the position of a live input stream is not known.
+  int64_t offset = 0;
+  int64_t endOffset = -1;
+
+  // The bitstream read: any parameter sets and the frames from startOffset
+  int64_t paramSetBytes = 0;
+  int64_t startOffset = 0;
+  if (!params->frameIndexPath.empty()) {
+    FrameIndex index;
+    if (!readFrameIndex(params->frameIndexPath, &index)) {
+      cout << "Error: can't read frame index!" << endl;
+      return -1;
+    }
+
+    const int numFrames = int(index.frames.size());
+    const int firstFrame = params->decodeFirstFrame;
+    int lastFrame = numFrames;
+    if (params->decodeFrameCount)
+      lastFrame = std::min(lastFrame, firstFrame + params->decodeFrameCount);
+
+    if (firstFrame >= numFrames) {
+      cout << "Error: frame " << firstFrame << " not in bitstream" << endl;
+      return -1;
+    }
+
+    const auto& entry = index.frames[firstFrame];
+    std::vector<int64_t> paramSetOffsets{entry.spsOffset, entry.gpsOffset};
+    paramSetOffsets.insert(
+      paramSetOffsets.end(), entry.apsOffsets.begin(), entry.apsOffsets.end());
+
+    for (auto psOffset : paramSetOffsets) {
+      if (psOffset < 0 || !readTlv(in->seekg(psOffset), &buf)) {
+        cout << "Error: can't read parameter set at " << psOffset << endl;
+        return -1;
+      }
+      paramSetBytes += kTlvHeaderSize + buf.size();
+
+      if (decoder.decompress(&buf, this)) {
+        cout << "Error: can't decompress point cloud!" << endl;
+        return -1;
+      }
+    }
+
+    in->seekg(entry.firstBrickOffset);
+    offset = startOffset = entry.firstBrickOffset;
+    endOffset = index.frames[lastFrame - 1].endOffset;
+    frameNum += firstFrame;
+  }
+
   while (true) {
     PayloadBuffer* buf_ptr = &buf;
-    readTlv(fin, &buf);
+    if (endOffset < 0 || offset < endOffset)
+      readTlv(*in, &buf);
+    else
+      in->setstate(ios::eofbit | ios::failbit);
 
     // at end of file (or other error), flush decoder
-    if (!fin)
+    if (!*in)
       buf_ptr = nullptr;
+    else
+      offset += kTlvHeaderSize + buf.size();
 
     if (decoder.decompress(buf_ptr, this)) {
       cout << "Error: can't decompress point cloud!" << endl;
       return -1;
     }
 
+    if (_liveOutputFailed)
+      return -1;
+
     if (!buf_ptr)
       break;
   }
 
-  fin.clear();
-  fin.seekg(0, ios_base::end);
-  std::cout << "Total bitstream size " << fin.tellg() << " B" << std::endl;
+  if (!_outputWriter.flush()) {
+    cout << "Error: can't open output file!" << endl;
+    if (params->reconstructedDataPath == kStdioPath)
+      return -1;
+  }
+
+  const int64_t bytesRead = paramSetBytes + offset - startOffset;
+  std::cout << "Total bitstream size " << bytesRead << " B" << std::endl;
 
   clock->stop();
 
@@ -1220,19 +1855,16 @@ void
 SequenceDecoder::onOutputCloud(
   const SequenceParameterSet& sps, const PCCPointSet3& decodedPointCloud)
 {
+  // when outputting slices, the (empty) cloud marks the end of a frame
+  if (params->decoder.outputSlices) {
+    frameNum++;
+    sliceNum = 0;
+    return;
+  }
+
   // copy the point cloud in order to modify it according to the output options
   PCCPointSet3 pointCloud(decodedPointCloud);
-
-  if (params->convertColourspace)
-    convertToGbr(sps, pointCloud);
-
-  if (params->reflectanceScale > 1 && pointCloud.hasReflectances()) {
-    const auto pointCount = pointCloud.getPointCount();
-    for (size_t i = 0; i < pointCount; ++i) {
-      int val = pointCloud.getReflectance(i) * params->reflectanceScale;
-      pointCloud.setReflectance(i, val);
-    }
-  }
+  convertOutput(sps, pointCloud);
 
   // the order of the property names must be determined from the sps
   ply::PropertyNameMap attrNames;
@@ -1241,20 +1873,20 @@ SequenceDecoder::onOutputCloud(
   // Dump the decoded colour using the pre inverse scaled geometry
   if (!params->preInvScalePath.empty()) {
     std::string filename{expandNum(params->preInvScalePath, frameNum)};
-    ply::write(
+    writePointCloud(
       pointCloud, attrNames,
       1.0 / params->encoder.sps.seq_source_geom_scale_factor,
       params->encoder.sps.seq_bounding_box_xyz0, params->preInvScalePath,
-      !params->outputBinaryPly);
+      !params->outputBinaryPly, params->outputCompactPlyPositions);
   }
 
   clock->stop();
 
-  std::string decName{expandNum(params->reconstructedDataPath, frameNum)};
-  if (!ply::write(
-        pointCloud, attrNames, 1.0 / sps.seq_source_geom_scale_factor,
-        sps.seq_bounding_box_xyz0, decName, !params->outputBinaryPly)) {
+  if (!_outputWriter.add(
+        pointCloud, frameNum, params->reconstructedDataPath, attrNames,
+        1.0 / sps.seq_source_geom_scale_factor, sps.seq_bounding_box_xyz0)) {
     cout << "Error: can't open output file!" << endl;
+    _liveOutputFailed |= params->reconstructedDataPath == kStdioPath;
   }
 
   clock->start();
@@ -1263,6 +1895,69 @@ SequenceDecoder::onOutputCloud(
   frameNum++;
 }
 
+//----------------------------------------------------------------------------
+
+void
+SequenceDecoder::onOutputSlice(
+  const SequenceParameterSet& sps,
+  const DecodedSliceInfo& info,
+  const PCCPointSet3& decodedSlice)
+{
+  cout << "Output slice " << info.sliceId << " (tile " << info.tileId
+       << "): " << decodedSlice.getPointCount() << " points, bbox "
+       << info.bbox << endl;
+
+  PCCPointSet3 pointCloud(decodedSlice);
+  convertOutput(sps, pointCloud);
+
+  ply::PropertyNameMap attrNames;
+  attrNames.position = axisOrderToPropertyNames(sps.geometry_axis_order);
+
+  // Slices are named after the frame's file and numbered in decoding order,
+  // eg frame0001_slice2.ply.  NB: slice ids are not unique within a frame.
+  std::string fileName = expandNum(params->reconstructedDataPath, frameNum);
+  if (fileName != kStdioPath) {
+    auto dirPos = fileName.find_last_of("/\\");
+    auto extPos = fileName.find_last_of('.');
+    bool hasExt = extPos != std::string::npos
+      && (dirPos == std::string::npos || extPos > dirPos);
+    if (!hasExt)
+      extPos = fileName.size();
+    fileName.insert(extPos, "_slice" + std::to_string(sliceNum));
+  }
+  sliceNum++;
+
+  clock->stop();
+
+  if (!_outputWriter.write(
+        pointCloud, fileName, attrNames,
+        1.0 / sps.seq_source_geom_scale_factor, sps.seq_bounding_box_xyz0)) {
+    cout << "Error: can't open output file!" << endl;
+    _liveOutputFailed |= params->reconstructedDataPath == kStdioPath;
+  }
+
+  clock->start();
+}
+
+//----------------------------------------------------------------------------
+// Modify a decoded point cloud according to the output options
+
+void
+SequenceDecoder::convertOutput(
+  const SequenceParameterSet& sps, PCCPointSet3& cloud)
+{
+  if (params->convertColourspace)
+    convertToGbr(sps, cloud);
+
+  if (params->reflectanceScale > 1 && cloud.hasReflectances()) {
+    const auto pointCount = cloud.getPointCount();
+    for (size_t i = 0; i < pointCount; ++i) {
+      int val = cloud.getReflectance(i) * params->reflectanceScale;
+      cloud.setReflectance(i, val);
+    }
+  }
+}
+
 //============================================================================
 
 const AttributeDescription*
@@ -1299,23 +1994,53 @@ convertToGbr(const SequenceParameterSet& sps, PCCPointSet3& cloud)
 
 //----------------------------------------------------------------------------
 
+// Convert the attributes of the input point cloud to their coded form in a
+// single pass over the points:
+//  - colour is converted from GBR according to the colour matrix,
+//  - reflectance is divided by the reflectance scale.
+
 void
-convertFromGbr(const SequenceParameterSet& sps, PCCPointSet3& cloud)
+convertInputAttributes(const Parameters& params, PCCPointSet3& cloud)
 {
-  const AttributeDescription* attrDesc = findColourAttrDesc(sps);
-  if (!attrDesc)
-    return;
+  const AttributeDescription* attrDesc =
+    findColourAttrDesc(params.encoder.sps);
 
-  switch (attrDesc->cicp_matrix_coefficients_idx) {
-  case ColourMatrix::kBt709: convertGbrToYCbCrBt709(cloud); break;
+  ColourMatrix matrix = ColourMatrix::kIdentity;
+  if (params.convertColourspace && attrDesc && cloud.hasColors())
+    matrix = attrDesc->cicp_matrix_coefficients_idx;
 
-  case ColourMatrix::kYCgCo:
-    // todo(df): select YCgCoR vs YCgCo
-    convertGbrToYCgCoR(attrDesc->attr_bitdepth, cloud);
-    break;
+  const int bitDepth = attrDesc ? attrDesc->attr_bitdepth : 0;
+  const bool scaleReflectance =
+    params.reflectanceScale > 1 && cloud.hasReflectances();
 
-  default: break;
-  }
+  if (matrix != ColourMatrix::kBt709 && matrix != ColourMatrix::kYCgCo
+      && !scaleReflectance)
+    return;
+
+  const size_t kMinGrain = 16384;
+  const size_t pointCount = cloud.getPointCount();
+  pcc::parallelFor(0, pointCount, kMinGrain, [&](size_t b, size_t e) {
+    for (size_t i = b; i < e; ++i) {
+      switch (matrix) {
+      case ColourMatrix::kBt709:
+        cloud.getColor(i) = transformGbrToYCbCrBt709(cloud.getColor(i));
+        break;
+
+      case ColourMatrix::kYCgCo:
+        // todo(df): select YCgCoR vs YCgCo
+        cloud.getColor(i) =
+          transformGbrToYCgCoR(bitDepth, cloud.getColor(i));
+        break;
+
+      default: break;
+      }
+
+      if (scaleReflectance) {
+        int val = cloud.getReflectance(i) / params.reflectanceScale;
+        cloud.setReflectance(i, val);
+      }
+    }
+  });
 }
 
 //============================================================================
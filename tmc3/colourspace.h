@@ -35,6 +35,8 @@
 
 #pragma once
 
+#include <algorithm>
+#include <cmath>
 #include <cstdint>
 
 #include "PCCMath.h"
@@ -43,19 +45,52 @@ namespace pcc {
 
 //============================================================================
 
+// Round the non-negative quotient num / den to the nearest integer, clipped
+// to [0, 255].  Exact ties are resolved by rounding the floating point
+// evaluation of the quotient, fpVal(), which may differ from num / den by
+// the rounding error of its calculation.
+
+template<typename Fn>
+inline int
+roundBt709(int64_t num, int64_t den, Fn fpVal)
+{
+  if (num < 0)
+    return 0;
+
+  int64_t q = num / den;
+  int64_t rem = num - q * den;
+  if (2 * rem == den)
+    return int(PCCClip(std::round(fpVal()), 0., 255.));
+
+  q += 2 * rem > den;
+  return int(std::min(q, int64_t(255)));
+}
+
+//----------------------------------------------------------------------------
+// NB: the transform is evaluated using the (exact) integer form of the
+//     decimal coefficients, producing results identical to those of the
+//     floating point form.
+
 template<template<typename> class T, typename Tv>
 T<Tv>
 transformGbrToYCbCrBt709(T<Tv>& gbr)
 {
-  const Tv g = gbr[0];
-  const Tv b = gbr[1];
-  const Tv r = gbr[2];
-  const double y =
-    PCCClip(std::round(0.212600 * r + 0.715200 * g + 0.072200 * b), 0., 255.);
-  const double u = PCCClip(
-    std::round(-0.114572 * r - 0.385428 * g + 0.5 * b + 128.0), 0., 255.);
-  const double v = PCCClip(
-    std::round(0.5 * r - 0.454153 * g - 0.045847 * b + 128.0), 0., 255.);
+  const int64_t g = gbr[0];
+  const int64_t b = gbr[1];
+  const int64_t r = gbr[2];
+
+  const int y = roundBt709(2126 * r + 7152 * g + 722 * b, 10000, [&]() {
+    return 0.212600 * r + 0.715200 * g + 0.072200 * b;
+  });
+
+  const int u = roundBt709(
+    -114572 * r - 385428 * g + 500000 * b + 128000000, 1000000,
+    [&]() { return -0.114572 * r - 0.385428 * g + 0.5 * b + 128.0; });
+
+  const int v = roundBt709(
+    500000 * r - 454153 * g - 45847 * b + 128000000, 1000000,
+    [&]() { return 0.5 * r - 0.454153 * g - 0.045847 * b + 128.0; });
+
   return {Tv(y), Tv(u), Tv(v)};
 }
 
@@ -35,6 +35,7 @@
 
 #include "PCCTMC3Decoder.h"
 
+#include <algorithm>
 #include <cassert>
 #include <string>
 
@@ -45,6 +46,8 @@
 #include "io_tlv.h"
 #include "pcc_chrono.h"
 #include "osspecific.h"
+#include "parallel.h"
+#include "RAHT.h"
 
 namespace pcc {
 
@@ -54,6 +57,7 @@ void
 PCCTMC3Decoder3::init()
 {
   _currentFrameIdx = -1;
+  _frameSliceCount = 0;
   _sps = nullptr;
   _gps = nullptr;
   _spss.clear();
@@ -70,27 +74,36 @@ payloadStartsNewSlice(PayloadType type)
     || type == PayloadType::kFrameBoundaryMarker;
 }
 
+//----------------------------------------------------------------------------
+// Parameter sets may replace those used by the current slice
+
+static bool
+payloadIsParameterSet(PayloadType type)
+{
+  return type == PayloadType::kSequenceParameterSet
+    || type == PayloadType::kGeometryParameterSet
+    || type == PayloadType::kAttributeParameterSet;
+}
+
 //============================================================================
 
 int
 PCCTMC3Decoder3::decompress(
   const PayloadBuffer* buf, PCCTMC3Decoder3::Callbacks* callback)
 {
-  // Starting a new geometry brick/slice/tile, transfer any
-  // finished points to the output accumulator
-  if (!buf || payloadStartsNewSlice(buf->type)) {
-    if (size_t numPoints = _currentPointCloud.getPointCount()) {
-      for (size_t i = 0; i < numPoints; i++)
-        for (int k = 0; k < 3; k++)
-          _currentPointCloud[i][k] += _sliceOrigin[k];
-      _accumCloud.append(_currentPointCloud);
-    }
+  // Starting a new geometry brick/slice/tile, complete decoding of the
+  // current slice and transfer any finished points to the output accumulator
+  if (
+    !buf || payloadStartsNewSlice(buf->type)
+    || payloadIsParameterSet(buf->type)) {
+    decodeAttributeBricks();
+    outputSlice(callback);
   }
 
   if (!buf) {
     // flush decoder, output pending cloud if any
-    callback->onOutputCloud(*_sps, _accumCloud);
-    _accumCloud.clear();
+    // NB: a frame boundary marker may have already output the last frame
+    outputFrame(callback);
     return 0;
   }
 
@@ -106,24 +119,21 @@ PCCTMC3Decoder3::decompress(
   //     on the next slice.
   case PayloadType::kFrameBoundaryMarker:
     // todo(df): if no sps is activated ...
-    callback->onOutputCloud(*_sps, _accumCloud);
-    _accumCloud.clear();
+    outputFrame(callback);
     _currentFrameIdx = -1;
-    _attrDecoder.reset();
+    resetAttributeDecoders();
     return 0;
 
   case PayloadType::kGeometryBrick:
     activateParameterSets(parseGbhIds(*buf));
-    if (frameIdxChanged(parseGbh(*_sps, *_gps, *buf, nullptr))) {
-      callback->onOutputCloud(*_sps, _accumCloud);
-      _accumCloud.clear();
-    }
+    if (frameIdxChanged(parseGbh(*_sps, *_gps, *buf, nullptr)))
+      outputFrame(callback);
 
     // avoid accidents with stale attribute decoder on next slice
-    _attrDecoder.reset();
+    resetAttributeDecoders();
     return decodeGeometryBrick(*buf);
 
-  case PayloadType::kAttributeBrick: decodeAttributeBrick(*buf); return 0;
+  case PayloadType::kAttributeBrick: queueAttributeBrick(*buf); return 0;
 
   case PayloadType::kTileInventory:
     storeTileInventory(parseTileInventory(*buf));
@@ -139,8 +149,9 @@ PCCTMC3Decoder3::decompress(
 void
 PCCTMC3Decoder3::storeSps(SequenceParameterSet&& sps)
 {
-  // todo(df): handle replacement semantics
-  _spss.emplace(std::make_pair(sps.sps_seq_parameter_set_id, sps));
+  // NB: a parameter set replaces any with the same id, permitting
+  //     the coding parameters to change between frames.
+  _spss[sps.sps_seq_parameter_set_id] = std::move(sps);
 }
 
 //--------------------------------------------------------------------------
@@ -148,8 +159,7 @@ PCCTMC3Decoder3::storeSps(SequenceParameterSet&& sps)
 void
 PCCTMC3Decoder3::storeGps(GeometryParameterSet&& gps)
 {
-  // todo(df): handle replacement semantics
-  _gpss.emplace(std::make_pair(gps.gps_geom_parameter_set_id, gps));
+  _gpss[gps.gps_geom_parameter_set_id] = std::move(gps);
 }
 
 //--------------------------------------------------------------------------
@@ -157,8 +167,7 @@ PCCTMC3Decoder3::storeGps(GeometryParameterSet&& gps)
 void
 PCCTMC3Decoder3::storeAps(AttributeParameterSet&& aps)
 {
-  // todo(df): handle replacement semantics
-  _apss.emplace(std::make_pair(aps.aps_attr_parameter_set_id, aps));
+  _apss[aps.aps_attr_parameter_set_id] = std::move(aps);
 }
 
 //--------------------------------------------------------------------------
@@ -181,6 +190,52 @@ PCCTMC3Decoder3::frameIdxChanged(const GeometryBrickHeader& gbh) const
   return _currentFrameIdx != gbh.frame_idx;
 }
 
+//==========================================================================
+// Transfer the completely decoded slice (if any) to the output accumulator,
+// or directly to the output when slices are output individually.
+
+void
+PCCTMC3Decoder3::outputSlice(Callbacks* callback)
+{
+  size_t numPoints = _currentPointCloud.getPointCount();
+  if (!numPoints)
+    return;
+
+  for (size_t i = 0; i < numPoints; i++)
+    for (int k = 0; k < 3; k++)
+      _currentPointCloud[i][k] += _sliceOrigin[k];
+
+  if (_params.outputSlices) {
+    DecodedSliceInfo info;
+    info.frameIdx = _gbh.frame_idx;
+    info.tileId = _gbh.geom_tile_id;
+    info.sliceId = _sliceId;
+    info.sliceOrigin = _sliceOrigin;
+    info.bbox = _currentPointCloud.computeBoundingBox();
+    callback->onOutputSlice(*_sps, info, _currentPointCloud);
+  } else {
+    _accumCloud.append(_currentPointCloud);
+  }
+
+  _currentPointCloud.clear();
+  _frameSliceCount++;
+}
+
+//--------------------------------------------------------------------------
+// Output the current frame if any slices have been decoded.  When slices
+// are output individually, the accumulated cloud is empty.
+
+void
+PCCTMC3Decoder3::outputFrame(Callbacks* callback)
+{
+  if (!_frameSliceCount)
+    return;
+
+  callback->onOutputCloud(*_sps, _accumCloud);
+  _accumCloud.clear();
+  _frameSliceCount = 0;
+}
+
 //==========================================================================
 
 void
@@ -262,50 +317,218 @@ PCCTMC3Decoder3::decodeGeometryBrick(const PayloadBuffer& buf)
 }
 
 //--------------------------------------------------------------------------
-// Initialise the point cloud storage and decode a single geometry brick.
+// Prepare the attribute decoders for a new slice.  A single decoder is
+// retained in order to reuse its working memory.
+
+void
+PCCTMC3Decoder3::resetAttributeDecoders()
+{
+  if (_attrDecoders.empty())
+    return;
+
+  _attrDecoders.erase(std::next(_attrDecoders.begin()), _attrDecoders.end());
+  _attrDecoders.front()->reset();
+}
+
+//--------------------------------------------------------------------------
+// Defer decoding of an attribute brick until all attribute bricks of the
+// current slice have been received.
 
 void
-PCCTMC3Decoder3::decodeAttributeBrick(const PayloadBuffer& buf)
+PCCTMC3Decoder3::queueAttributeBrick(const PayloadBuffer& buf)
 {
   assert(buf.type == PayloadType::kAttributeBrick);
+
+  // verify that this corresponds to the correct geometry slice
+  assert(parseAbhIds(buf).attr_geom_slice_id == _sliceId);
+
+  _attrBricks.push_back(buf);
+}
+
+//--------------------------------------------------------------------------
+// Decode all attribute bricks of the current slice.
+//
+// Any state shared between attributes (eg, LoDs) is generated once, prior
+// to decoding independent attribute bricks concurrently.
+
+void
+PCCTMC3Decoder3::decodeAttributeBricks()
+{
+  if (_attrBricks.empty())
+    return;
+
   // todo(df): replace assertions with error handling
   assert(_sps);
   assert(_gps);
 
-  // verify that this corresponds to the correct geometry slice
-  AttributeBrickHeader abh = parseAbhIds(buf);
-  assert(abh.attr_geom_slice_id == _sliceId);
+  struct AttributeBrickJob {
+    const PayloadBuffer* buf;
+    const AttributeDescription* desc;
+    const AttributeParameterSet* aps;
+    AttributeDecoderIntf* decoder;
+  };
+
+  pcc::chrono::Stopwatch<pcc::chrono::utime_inc_children_clock> clock_user;
+  clock_user.start();
 
-  // todo(df): validate that sps activation is not changed via the APS
-  const auto it_attr_aps = _apss.find(abh.attr_attr_parameter_set_id);
+  std::vector<AttributeBrickJob> jobs;
+  for (const auto& buf : _attrBricks) {
+    AttributeBrickHeader abh = parseAbhIds(buf);
 
-  assert(it_attr_aps != _apss.cend());
-  const auto& attr_aps = it_attr_aps->second;
+    // todo(df): validate that sps activation is not changed via the APS
+    const auto it_attr_aps = _apss.find(abh.attr_attr_parameter_set_id);
 
-  assert(abh.attr_sps_attr_idx < _sps->attributeSets.size());
-  const auto& attr_sps = _sps->attributeSets[abh.attr_sps_attr_idx];
-  const auto& label = attr_sps.attributeLabel;
+    assert(it_attr_aps != _apss.cend());
+    const auto& attr_aps = it_attr_aps->second;
 
-  pcc::chrono::Stopwatch<pcc::chrono::utime_inc_children_clock> clock_user;
+    assert(abh.attr_sps_attr_idx < _sps->attributeSets.size());
+    const auto& attr_sps = _sps->attributeSets[abh.attr_sps_attr_idx];
 
-  // replace the attribute decoder if not compatible
-  if (!_attrDecoder || !_attrDecoder->isReusable(attr_aps))
-    _attrDecoder = makeAttributeDecoder();
+    // replace the attribute decoder if not compatible
+    if (_attrDecoders.empty() || !_attrDecoders.back()->isReusable(attr_aps))
+      _attrDecoders.push_back(makeAttributeDecoder());
+
+    auto* decoder = _attrDecoders.back().get();
+    decoder->prepare(
+      attr_aps, _params.minGeomNodeSizeLog2, _currentPointCloud);
+
+    jobs.push_back({&buf, &attr_sps, &attr_aps, decoder});
+  }
+
+  // Jobs that depend upon each other are grouped into ordered tasks:
+  //  - jobs that write the same point cloud attribute, and
+  //  - predicting transform jobs that share a decoder: the prediction
+  //    modes of the shared LoDs are updated by each attribute.
+  auto isDependent = [&](int i, int j) {
+    const auto& a = jobs[i];
+    const auto& b = jobs[j];
+    const auto& labelA = a.desc->attributeLabel;
+    const auto& labelB = b.desc->attributeLabel;
+    if (labelA.attribute_label_four_bytes == labelB.attribute_label_four_bytes)
+      return true;
+
+    if (a.decoder != b.decoder)
+      return false;
+
+    const auto encA = a.aps->attr_encoding;
+    const auto encB = b.aps->attr_encoding;
+    return encA == encB && encA == AttributeEncoding::kPredictingTransform;
+  };
+
+  // RAHT jobs that share a decoder are decoded with a single transform if
+  // doing so does not reorder any dependent jobs.  Each unit of work is
+  // either a single job or a group of jointly decoded RAHT jobs.
+  std::vector<std::vector<int>> units;
+  std::vector<bool> isGrouped(jobs.size());
+  for (int i = 0; i < jobs.size(); i++) {
+    if (isGrouped[i])
+      continue;
+
+    std::vector<int> unit{i};
+    const auto& head = jobs[i];
+    int numChannels = head.desc->attr_num_dimensions;
+    for (int k = i + 1; k < jobs.size(); k++) {
+      if (head.aps->attr_encoding != AttributeEncoding::kRAHTransform)
+        break;
+
+      const auto& job = jobs[k];
+      if (isGrouped[k] || job.decoder != head.decoder)
+        continue;
+
+      if (!isRahtJointCodable(*head.aps, *job.aps))
+        continue;
+
+      if (numChannels + job.desc->attr_num_dimensions > kRahtMaxChannels)
+        continue;
+
+      // Members must code distinct attributes, and moving the job forward
+      // must not change its order with respect to any dependent job.
+      bool isMovable = true;
+      for (int j = i; j < k && isMovable; j++) {
+        bool isMember = std::count(unit.begin(), unit.end(), j);
+        const auto& labelA = jobs[j].desc->attributeLabel;
+        const auto& labelB = job.desc->attributeLabel;
+        if (isMember)
+          isMovable = labelA.attribute_label_four_bytes
+            != labelB.attribute_label_four_bytes;
+        else if (!isGrouped[j])
+          isMovable = !isDependent(j, k);
+      }
+
+      if (!isMovable)
+        continue;
+
+      unit.push_back(k);
+      isGrouped[k] = true;
+      numChannels += job.desc->attr_num_dimensions;
+    }
+
+    units.push_back(std::move(unit));
+  }
+
+  auto isUnitDependent = [&](int a, int b) {
+    for (int i : units[a])
+      for (int j : units[b])
+        if (isDependent(i, j))
+          return true;
+    return false;
+  };
+
+  std::vector<std::vector<int>> tasks;
+  for (int j = 0; j < units.size(); j++) {
+    std::vector<int> task;
+    for (auto it = tasks.begin(); it != tasks.end();) {
+      auto dependsOn = [&](int i) { return isUnitDependent(i, j); };
+      if (std::none_of(it->begin(), it->end(), dependsOn)) {
+        ++it;
+        continue;
+      }
+      task.insert(task.end(), it->begin(), it->end());
+      it = tasks.erase(it);
+    }
+    std::sort(task.begin(), task.end());
+    task.push_back(j);
+    tasks.push_back(std::move(task));
+  }
+
+  parallelInvoke(int(tasks.size()), [&](int t) {
+    for (int u : tasks[t]) {
+      const auto& unit = units[u];
+      if (unit.size() == 1) {
+        const auto& job = jobs[unit.front()];
+        job.decoder->decode(
+          *_sps, *job.desc, *job.aps, _gbh.geom_num_points,
+          _params.minGeomNodeSizeLog2, *job.buf, _currentPointCloud);
+        continue;
+      }
+
+      std::vector<JointAttributeBrick> bricks(unit.size());
+      for (int i = 0; i < unit.size(); i++) {
+        const auto& job = jobs[unit[i]];
+        bricks[i].desc = job.desc;
+        bricks[i].aps = job.aps;
+        bricks[i].buf = job.buf;
+      }
+
+      auto* decoder = jobs[unit.front()].decoder;
+      decoder->decodeRahtJoint(*_sps, bricks, _currentPointCloud);
+    }
+  });
 
-  clock_user.start();
-  _attrDecoder->decode(
-    *_sps, attr_sps, attr_aps, _gbh.geom_num_points,
-    _params.minGeomNodeSizeLog2, buf, _currentPointCloud);
   clock_user.stop();
 
-  std::cout << label << "s bitstream size " << buf.size() << " B\n";
+  for (const auto& job : jobs) {
+    std::cout << job.desc->attributeLabel << "s bitstream size "
+              << job.buf->size() << " B\n";
+  }
 
   auto total_user =
     std::chrono::duration_cast<std::chrono::milliseconds>(clock_user.count());
-  std::cout << label
-            << "s processing time (user): " << total_user.count() / 1000.0
-            << " s\n";
+  std::cout << "attributes processing time (user): "
+            << total_user.count() / 1000.0 << " s\n";
   std::cout << std::endl;
+
+  _attrBricks.clear();
 }
 
 //============================================================================
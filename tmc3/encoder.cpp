@@ -35,7 +35,10 @@
 
 #include "PCCTMC3Encoder.h"
 
+#include <algorithm>
 #include <cassert>
+#include <map>
+#include <numeric>
 #include <set>
 
 #include "Attribute.h"
@@ -46,6 +49,7 @@
 #include "partitioning.h"
 #include "pcc_chrono.h"
 #include "ply.h"
+#include "RAHT.h"
 
 namespace pcc {
 
@@ -63,47 +67,11 @@ PCCTMC3Encoder3::compress(
   PCCTMC3Encoder3::Callbacks* callback,
   PCCPointSet3* reconstructedCloud)
 {
-  // start of frame
-  _frameCounter++;
-
-  fixupParameterSets(params);
-
   // Determine input bounding box (for SPS metadata) if not manually set
-  if (params->sps.seq_bounding_box_whd == Vec3<int>{0}) {
-    const auto& bbox = inputPointCloud.computeBoundingBox();
-    for (int k = 0; k < 3; k++) {
-      params->sps.seq_bounding_box_xyz0[k] = int(bbox.min[k]);
-
-      // somehow determine the decoder's reconstructed points bounding box
-      // and update sps accordingly.
-      auto max_k = bbox.max[k] - bbox.min[k];
-      max_k = std::round(max_k * params->sps.seq_source_geom_scale_factor);
-      max_k = std::round(max_k / params->sps.seq_source_geom_scale_factor);
-
-      // NB: plus one to convert to range
-      params->sps.seq_bounding_box_whd[k] = int(max_k) + 1;
-    }
-  }
+  if (params->sps.seq_bounding_box_whd == Vec3<int>{0})
+    deriveSeqBoundingBox(inputPointCloud.computeBoundingBox(), &params->sps);
 
-  // placeholder to "activate" the parameter sets
-  _sps = &params->sps;
-  _gps = &params->gps;
-  _aps.clear();
-  for (const auto& aps : params->aps) {
-    _aps.push_back(&aps);
-  }
-
-  // write out all parameter sets prior to encoding
-  callback->onOutputBuffer(write(*_sps));
-  callback->onOutputBuffer(write(*_gps));
-  for (const auto aps : _aps) {
-    callback->onOutputBuffer(write(*aps));
-  }
-
-  // initial geometry IDs
-  _tileId = 0;
-  _sliceId = 0;
-  _sliceOrigin = Vec3<int>{0};
+  beginFrame(params, callback);
 
   // Partition the input point cloud into tiles
   //  - quantize the input point cloud (without duplicate point removal)
@@ -118,6 +86,16 @@ PCCTMC3Encoder3::compress(
   PCCPointSet3 quantizedInputCloud;
   quantizedInputCloud = quantization(inputPointCloud);
 
+  // If partitioning is not enabled, encode input as a single "partition"
+  if (params->partition.method == PartitionMethod::kNone) {
+    // todo(df): params->gps.geom_box_present_flag = false;
+    _sliceOrigin = Vec3<int>{0};
+    compressPartition(
+      quantizedInputCloud, inputPointCloud, params, callback,
+      reconstructedCloud);
+    return 0;
+  }
+
   std::vector<std::vector<int32_t>> tileMaps;
   if (params->partition.tileSize) {
     PCCPointSet3 inverseQuantizedCloud;
@@ -147,85 +125,214 @@ PCCTMC3Encoder3::compress(
       tile.push_back(i);
   }
 
-  // If partitioning is not enabled, encode input as a single "partition"
+  for (int t = 0; t < tileMaps.size(); t++) {
+    partitionTileSlices(
+      inputPointCloud, quantizedInputCloud, tileMaps[t], t, params,
+      &partitions.slices);
+  }
+  std::cout << "Slice number: " << partitions.slices.size() << std::endl;
+
+  if (partitions.tileInventory.tiles.size() > 1) {
+    assert(partitions.tileInventory.tiles.size() == tileMaps.size());
+    std::cout << "Tile number: " << tileMaps.size() << std::endl;
+    callback->onOutputBuffer(write(partitions.tileInventory));
+  }
+
+  compressSlices(
+    inputPointCloud, quantizedInputCloud, partitions.slices, params, callback,
+    reconstructedCloud);
+
+  return 0;
+}
+
+//----------------------------------------------------------------------------
+
+void
+PCCTMC3Encoder3::beginTiledFrame(
+  EncoderParams* params,
+  const TileInventory& tileInventory,
+  PCCTMC3Encoder3::Callbacks* callback)
+{
+  // NB: tiles are positioned relative to the sequence bounding box
+  assert(params->sps.seq_bounding_box_whd != Vec3<int>{0});
+
+  beginFrame(params, callback);
+
+  if (tileInventory.tiles.size() > 1) {
+    std::cout << "Tile number: " << tileInventory.tiles.size() << std::endl;
+    callback->onOutputBuffer(write(tileInventory));
+  }
+}
+
+//----------------------------------------------------------------------------
+
+int
+PCCTMC3Encoder3::compressTile(
+  const PCCPointSet3& tileCloud,
+  int tileId,
+  EncoderParams* params,
+  PCCTMC3Encoder3::Callbacks* callback)
+{
+  // NB: quantization is performed prior to positioning any slice
+  _sliceOrigin = Vec3<int>{0};
+  PCCPointSet3 quantizedTileCloud = quantization(tileCloud);
+
   if (params->partition.method == PartitionMethod::kNone) {
-    // todo(df): params->gps.geom_box_present_flag = false;
-    _sliceOrigin = Vec3<int>{0};
-    compressPartition(
-      quantizedInputCloud, inputPointCloud, params, callback,
-      reconstructedCloud);
+    compressPartition(quantizedTileCloud, tileCloud, params, callback);
     return 0;
   }
 
-  // Partition the input point cloud
-  //  - get the partitial cloud of each tile
-  //  - partitioning function produces a list of point indexes, origin and
-  //    optional tile metadata for each partition.
-  //  - encode any tile metadata
-  //  todo(df): consider requiring partitioning function to sort the input
-  //            points and provide ranges rather than a set of indicies.
-  do {
-    Box3<int32_t> clampBox{{0, 0, 0}, {INT32_MAX, INT32_MAX, INT32_MAX}};
+  // The whole tile is partitioned into slices
+  std::vector<int32_t> tile(quantizedTileCloud.getPointCount());
+  std::iota(tile.begin(), tile.end(), 0);
 
-    for (int t = 0; t < tileMaps.size(); t++) {
-      const auto& tile = tileMaps[t];
+  std::vector<Partition> slices;
+  partitionTileSlices(
+    tileCloud, quantizedTileCloud, tile, tileId, params, &slices);
+  std::cout << "Tile " << tileId << " slice number: " << slices.size()
+            << std::endl;
 
-      // Get the point cloud of current tile and compute their bounding boxes
-      PCCPointSet3 tileCloud;
-      getSrcPartition(quantizedInputCloud, tileCloud, tile);
-      Box3<int32_t> bbox = tileCloud.computeBoundingBox();
-      Vec3<int> tile_quantized_box_xyz0;
-      for (int k = 0; k < 3; k++) {
-        tile_quantized_box_xyz0[k] = int(bbox.min[k]);
-      }
+  compressSlices(tileCloud, quantizedTileCloud, slices, params, callback);
+  return 0;
+}
 
-      // Move the tile cloud to coodinate origin
-      // for the convenience of slice partitioning
-      quantizePositions(
-        1, tile_quantized_box_xyz0, clampBox, tileCloud, &tileCloud);
-
-      //Slice partition of current tile
-      std::vector<Partition> curSlices;
-      switch (params->partition.method) {
-      // NB: this method is handled earlier
-      case PartitionMethod::kNone: return 1;
-
-      case PartitionMethod::kUniformGeom:
-        curSlices = partitionByUniformGeom(
-          params->partition, tileCloud, t, _gps->trisoup_node_size_log2);
-        break;
-
-      case PartitionMethod::kOctreeUniform:
-        curSlices = partitionByOctreeDepth(params->partition, tileCloud, t);
-        break;
-      }
-      // Map slice indexes to tile indexes(the original indexes)
-      for (int i = 0; i < curSlices.size(); i++) {
-        for (int p = 0; p < curSlices[i].pointIndexes.size(); p++) {
-          curSlices[i].pointIndexes[p] = tile[curSlices[i].pointIndexes[p]];
-        }
-      }
-      // Adjust the point number of each slice
-      // to the range between sliceMaxPoints and sliceMinPoints
-      // by merge small slices and split large ones.
-      refineSlices(params->partition, inputPointCloud, curSlices);
+//----------------------------------------------------------------------------
 
-      partitions.slices.insert(
-        partitions.slices.end(), curSlices.begin(), curSlices.end());
-    }
-    std::cout << "Slice number: " << partitions.slices.size() << std::endl;
-  } while (0);
+void
+PCCTMC3Encoder3::deriveSeqBoundingBox(
+  const Box3<int32_t>& bbox, SequenceParameterSet* sps)
+{
+  for (int k = 0; k < 3; k++) {
+    sps->seq_bounding_box_xyz0[k] = int(bbox.min[k]);
 
-  if (partitions.tileInventory.tiles.size() > 1) {
-    assert(partitions.tileInventory.tiles.size() == tileMaps.size());
-    std::cout << "Tile number: " << tileMaps.size() << std::endl;
-    callback->onOutputBuffer(write(partitions.tileInventory));
+    // somehow determine the decoder's reconstructed points bounding box
+    // and update sps accordingly.
+    auto max_k = bbox.max[k] - bbox.min[k];
+    max_k = std::round(max_k * sps->seq_source_geom_scale_factor);
+    max_k = std::round(max_k / sps->seq_source_geom_scale_factor);
+
+    // NB: plus one to convert to range
+    sps->seq_bounding_box_whd[k] = int(max_k) + 1;
   }
+}
+
+//----------------------------------------------------------------------------
+
+void
+PCCTMC3Encoder3::beginFrame(
+  EncoderParams* params, PCCTMC3Encoder3::Callbacks* callback)
+{
+  // start of frame
+  _frameCounter++;
+
+  fixupParameterSets(params);
 
-  // Encode each partition:
-  //  - create a pointset comprising just the partitioned points
-  //  - compress
-  for (const auto& partition : partitions.slices) {
+  // placeholder to "activate" the parameter sets
+  _sps = &params->sps;
+  _gps = &params->gps;
+  _aps.clear();
+  for (const auto& aps : params->aps) {
+    _aps.push_back(&aps);
+  }
+
+  // write out all parameter sets prior to encoding
+  callback->onOutputBuffer(write(*_sps));
+  callback->onOutputBuffer(write(*_gps));
+  for (const auto aps : _aps) {
+    callback->onOutputBuffer(write(*aps));
+  }
+
+  // initial geometry IDs
+  _tileId = 0;
+  _sliceId = 0;
+  _sliceOrigin = Vec3<int>{0};
+}
+
+//----------------------------------------------------------------------------
+// Partition the points of a tile (indexes into quantizedInputCloud) into
+// slices, appending them to @a slices.
+//  - get the partitial cloud of the tile
+//  - partitioning function produces a list of point indexes, origin and
+//    optional tile metadata for each partition.
+//  todo(df): consider requiring partitioning function to sort the input
+//            points and provide ranges rather than a set of indicies.
+
+void
+PCCTMC3Encoder3::partitionTileSlices(
+  const PCCPointSet3& inputPointCloud,
+  const PCCPointSet3& quantizedInputCloud,
+  const std::vector<int32_t>& tile,
+  int tileId,
+  const EncoderParams* params,
+  std::vector<Partition>* slices)
+{
+  Box3<int32_t> clampBox{{0, 0, 0}, {INT32_MAX, INT32_MAX, INT32_MAX}};
+
+  // Get the point cloud of current tile and compute their bounding boxes
+  PCCPointSet3 tileCloud;
+  getSrcPartition(quantizedInputCloud, tileCloud, tile);
+  Box3<int32_t> bbox = tileCloud.computeBoundingBox();
+  Vec3<int> tile_quantized_box_xyz0;
+  for (int k = 0; k < 3; k++) {
+    tile_quantized_box_xyz0[k] = int(bbox.min[k]);
+  }
+
+  // Move the tile cloud to coodinate origin
+  // for the convenience of slice partitioning
+  quantizePositions(
+    1, tile_quantized_box_xyz0, clampBox, tileCloud, &tileCloud);
+
+  //Slice partition of current tile
+  std::vector<Partition> curSlices;
+  switch (params->partition.method) {
+  // NB: this method is handled earlier
+  case PartitionMethod::kNone: return;
+
+  case PartitionMethod::kUniformGeom:
+    curSlices = partitionByUniformGeom(
+      params->partition, tileCloud, tileId, _gps->trisoup_node_size_log2);
+    break;
+
+  case PartitionMethod::kOctreeUniform:
+    curSlices = partitionByOctreeDepth(params->partition, tileCloud, tileId);
+    break;
+
+  case PartitionMethod::kCostBalanced:
+    curSlices = partitionByCost(
+      params->partition, tileCloud, tileId, _gps->trisoup_node_size_log2);
+    break;
+  }
+  // Map slice indexes to tile indexes(the original indexes)
+  for (int i = 0; i < curSlices.size(); i++) {
+    for (int p = 0; p < curSlices[i].pointIndexes.size(); p++) {
+      curSlices[i].pointIndexes[p] = tile[curSlices[i].pointIndexes[p]];
+    }
+  }
+  // Adjust the point number of each slice
+  // to the range between sliceMaxPoints and sliceMinPoints
+  // by merge small slices and split large ones.
+  // NB: cost balanced slices already respect sliceMaxPoints
+  if (params->partition.method != PartitionMethod::kCostBalanced)
+    refineSlices(params->partition, inputPointCloud, curSlices);
+
+  slices->insert(slices->end(), curSlices.begin(), curSlices.end());
+}
+
+//----------------------------------------------------------------------------
+// Encode each partition:
+//  - create a pointset comprising just the partitioned points
+//  - compress
+
+void
+PCCTMC3Encoder3::compressSlices(
+  const PCCPointSet3& inputPointCloud,
+  const PCCPointSet3& quantizedInputCloud,
+  const std::vector<Partition>& slices,
+  EncoderParams* params,
+  PCCTMC3Encoder3::Callbacks* callback,
+  PCCPointSet3* reconstructedCloud)
+{
+  for (const auto& partition : slices) {
     // create partitioned point set
     PCCPointSet3 srcPartition;
     getSrcPartition(quantizedInputCloud, srcPartition, partition.pointIndexes);
@@ -244,6 +351,15 @@ PCCTMC3Encoder3::compress(
     getSrcPartition(
       inputPointCloud, partitionInOriginCloud, partitionOriginIdxes);
 
+    // report the cost model's estimate to permit its calibration against
+    // the measured processing times
+    if (partition.numNodesEstimate >= 0) {
+      std::cout << "Slice " << partition.sliceId << " expected processing "
+                << "time: " << expectedCost(params->partition, partition) / 1e6
+                << " s (" << partition.pointIndexes.size() << " points, "
+                << partition.numNodesEstimate << " octree nodes)" << std::endl;
+    }
+
     _sliceId = partition.sliceId;
     _tileId = partition.tileId;
     _sliceOrigin = partition.origin;
@@ -251,8 +367,6 @@ PCCTMC3Encoder3::compress(
       srcPartition, partitionInOriginCloud, params, callback,
       reconstructedCloud);
   }
-
-  return 0;
 }
 
 //----------------------------------------------------------------------------
@@ -330,21 +444,13 @@ PCCTMC3Encoder3::compressPartition(
 
   // Offset the point cloud to account for (preset) _sliceOrigin.
   // The new maximum bounds of the offset cloud
-  Vec3<int> maxBound{0};
-
-  const size_t pointCount = pointCloud.getPointCount();
-  for (size_t i = 0; i < pointCount; ++i) {
-    const point_t point = (pointCloud[i] -= _sliceOrigin);
-    for (int k = 0; k < 3; ++k) {
-      const int k_coord = int(point[k]);
-      assert(k_coord >= 0);
-      if (maxBound[k] < k_coord)
-        maxBound[k] = k_coord;
-    }
-  }
+  Box3<int32_t> bbox = translatePositions(_sliceOrigin, &pointCloud);
 
   // todo(df): don't update maxBound if something is forcing the value?
-  _sliceBoxWhd = maxBound;
+  for (int k = 0; k < 3; ++k) {
+    assert(!pointCloud.getPointCount() || bbox.min[k] >= 0);
+    _sliceBoxWhd[k] = std::max(0, int(bbox.max[k]));
+  }
 
   // geometry encoding
   if (1) {
@@ -373,9 +479,18 @@ PCCTMC3Encoder3::compressPartition(
 
   // NB: recolouring is required if points are added / removed
   if (_gps->geom_unique_points_flag || _gps->trisoup_node_size_log2 > 0) {
-    for (const auto& attr_sps : _sps->attributeSets) {
+    // If the only change to the geometry is the merging of duplicate points,
+    // the attributes of each point are those of its duplicates.
+    bool isGeomLossless = _sps->seq_source_geom_scale_factor == 1.f
+      && !_gps->trisoup_node_size_log2 && !_gps->geom_scaling_enabled_flag;
+
+    if (
+      !isGeomLossless
+      || !recolourExact(
+        _sps->attributeSets, originPartCloud, _sps->seq_bounding_box_xyz0,
+        _sliceOrigin, &pointCloud)) {
       recolour(
-        attr_sps, params->recolour, originPartCloud,
+        _sps->attributeSets, params->recolour, originPartCloud,
         _sps->seq_source_geom_scale_factor, _sps->seq_bounding_box_xyz0,
         _sliceOrigin, &pointCloud);
     }
@@ -386,22 +501,15 @@ PCCTMC3Encoder3::compressPartition(
   callback->onPostRecolour(pointCloud);
 
   // attributeCoding
-  auto attrEncoder = makeAttributeEncoder();
+  if (!_attrEncoder)
+    _attrEncoder = makeAttributeEncoder();
+  _attrEncoder->reset();
 
-  // for each attribute
-  for (const auto& it : params->attributeIdxMap) {
-    int attrIdx = it.second;
-    const auto& attr_sps = _sps->attributeSets[attrIdx];
+  // todo(df): move elsewhere?
+  auto makeAbh = [&](int attrIdx) {
     const auto& attr_aps = *_aps[attrIdx];
     const auto& attr_enc = params->attr[attrIdx];
-    const auto& label = attr_sps.attributeLabel;
-
-    PayloadBuffer payload(PayloadType::kAttributeBrick);
-
-    pcc::chrono::Stopwatch<pcc::chrono::utime_inc_children_clock> clock_user;
-    clock_user.start();
 
-    // todo(df): move elsewhere?
     AttributeBrickHeader abh;
     abh.attr_attr_parameter_set_id = attr_aps.aps_attr_parameter_set_id;
     abh.attr_sps_attr_idx = attrIdx;
@@ -415,14 +523,92 @@ PCCTMC3Encoder3::compressPartition(
     abh.attr_region_qp_origin = Vec3<int>{0};
     abh.attr_region_qp_whd = Vec3<int>{0};
     abh.attr_region_qp_delta = 0;
+    return abh;
+  };
+
+  // RAHT coded attributes that share a transform tree are coded using a
+  // single traversal.  Each attribute is still coded in its own brick.
+  std::vector<int> rahtJointAttrIdxs;
+  int rahtJointChannels = 0;
+  for (const auto& it : params->attributeIdxMap) {
+    int attrIdx = it.second;
+    const auto& attr_aps = *_aps[attrIdx];
+    int numDims = _sps->attributeSets[attrIdx].attr_num_dimensions;
+    if (attr_aps.attr_encoding != AttributeEncoding::kRAHTransform)
+      continue;
+
+    if (!rahtJointAttrIdxs.empty()) {
+      const auto& head_aps = *_aps[rahtJointAttrIdxs.front()];
+      if (!isRahtJointCodable(head_aps, attr_aps))
+        continue;
+    }
+
+    if (rahtJointChannels + numDims > kRahtMaxChannels)
+      continue;
+
+    rahtJointAttrIdxs.push_back(attrIdx);
+    rahtJointChannels += numDims;
+  }
+
+  if (rahtJointAttrIdxs.size() < 2)
+    rahtJointAttrIdxs.clear();
+
+  // Jointly coded attribute bricks, awaiting output
+  std::map<int, PayloadBuffer> rahtJointPayloads;
+
+  // for each attribute
+  for (const auto& it : params->attributeIdxMap) {
+    int attrIdx = it.second;
+    const auto& attr_sps = _sps->attributeSets[attrIdx];
+    const auto& attr_aps = *_aps[attrIdx];
+    const auto& label = attr_sps.attributeLabel;
+
+    PayloadBuffer payload(PayloadType::kAttributeBrick);
+
+    pcc::chrono::Stopwatch<pcc::chrono::utime_inc_children_clock> clock_user;
+    clock_user.start();
+
+    bool isRahtJoint = std::count(
+      rahtJointAttrIdxs.begin(), rahtJointAttrIdxs.end(), attrIdx);
+
+    // the first member of the joint group codes all members
+    if (isRahtJoint && rahtJointPayloads.empty()) {
+      std::vector<JointAttributeBrick> bricks;
+      for (int memberIdx : rahtJointAttrIdxs) {
+        auto& buf = rahtJointPayloads[memberIdx];
+        buf.type = PayloadType::kAttributeBrick;
+
+        JointAttributeBrick brick;
+        brick.desc = &_sps->attributeSets[memberIdx];
+        brick.aps = _aps[memberIdx];
+        brick.abh = makeAbh(memberIdx);
+        brick.payload = &buf;
+        brick.buf = nullptr;
+        write(*brick.aps, brick.abh, brick.payload);
+        bricks.push_back(brick);
+      }
+
+      // replace the attribute encoder if not compatible
+      if (!_attrEncoder->isReusable(attr_aps))
+        _attrEncoder = makeAttributeEncoder();
+
+      _attrEncoder->encodeRahtJoint(*_sps, bricks, pointCloud);
+    }
 
-    write(attr_aps, abh, &payload);
+    if (isRahtJoint) {
+      payload = std::move(rahtJointPayloads[attrIdx]);
+    } else {
+      AttributeBrickHeader abh = makeAbh(attrIdx);
+      write(attr_aps, abh, &payload);
 
-    // replace the attribute encoder if not compatible
-    if (!attrEncoder->isReusable(attr_aps))
-      attrEncoder = makeAttributeEncoder();
+      // replace the attribute encoder if not compatible
+      if (!_attrEncoder->isReusable(attr_aps))
+        _attrEncoder = makeAttributeEncoder();
 
-    attrEncoder->encode(*_sps, attr_sps, attr_aps, abh, pointCloud, &payload);
+      _attrEncoder->encode(
+        *_sps, params->attrEnc, attr_sps, attr_aps, abh, pointCloud,
+        &payload);
+    }
     clock_user.stop();
 
     int coded_size = int(payload.size());
@@ -549,33 +735,24 @@ PCCTMC3Encoder3::quantization(const PCCPointSet3& inputPointCloud)
         int(ceil(clampBox.max[k] * _sps->seq_source_geom_scale_factor)) - 1;
   }
 
+  // NB: there is no slice origin prior to partitioning, hence the quantised
+  //     cloud does not require offsetting.
+  assert(_sliceOrigin == Vec3<int>{0});
+  Box3<int32_t> bbox;
   if (_gps->geom_unique_points_flag) {
-    quantizePositionsUniq(
+    bbox = quantizePositionsUniq(
       _sps->seq_source_geom_scale_factor, _sps->seq_bounding_box_xyz0,
       clampBox, inputPointCloud, &pointCloud0, quantizedToOrigin);
   } else {
-    quantizePositions(
+    bbox = quantizePositions(
       _sps->seq_source_geom_scale_factor, _sps->seq_bounding_box_xyz0,
       clampBox, inputPointCloud, &pointCloud0);
   }
 
-  // Offset the point cloud to account for (preset) _sliceOrigin.
-  // The new maximum bounds of the offset cloud
-  Vec3<int> maxBound{0};
-
-  const size_t pointCount = pointCloud0.getPointCount();
-  for (size_t i = 0; i < pointCount; ++i) {
-    const point_t point = (pointCloud0[i] -= _sliceOrigin);
-    for (int k = 0; k < 3; ++k) {
-      const int k_coord = int(point[k]);
-      assert(k_coord >= 0);
-      if (maxBound[k] < k_coord)
-        maxBound[k] = k_coord;
-    }
-  }
-
   // todo(df): don't update maxBound if something is forcing the value?
-  _sliceBoxWhd = maxBound;
+  for (int k = 0; k < 3; ++k)
+    _sliceBoxWhd[k] = std::max(0, int(bbox.max[k]));
+
   return pointCloud0;
 }
 
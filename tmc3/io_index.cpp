@@ -0,0 +1,170 @@
+/* The copyright in this software is being made available under the BSD
+ * Licence, included below.  This software may be subject to other third
+ * party and contributor rights, including patent rights, and no such
+ * rights are granted under this licence.
+ *
+ * Copyright (c) 2020, ISO/IEC
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * * Redistributions of source code must retain the above copyright
+ *   notice, this list of conditions and the following disclaimer.
+ *
+ * * Redistributions in binary form must reproduce the above copyright
+ *   notice, this list of conditions and the following disclaimer in the
+ *   documentation and/or other materials provided with the distribution.
+ *
+ * * Neither the name of the ISO/IEC nor the names of its contributors
+ *   may be used to endorse or promote products derived from this
+ *   software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "io_index.h"
+
+#include <fstream>
+#include <sstream>
+
+namespace pcc {
+
+//============================================================================
+
+static const char kFrameIndexHeader[] = "tmc3 frame index v1";
+
+//============================================================================
+
+void
+FrameIndex::startFrame()
+{
+  FrameIndexEntry entry;
+  if (!frames.empty()) {
+    entry = frames.back();
+    entry.firstBrickOffset = -1;
+    entry.endOffset = -1;
+  }
+  frames.push_back(entry);
+}
+
+//----------------------------------------------------------------------------
+
+void
+FrameIndex::addPayload(PayloadType type, int64_t offset)
+{
+  FrameIndexEntry& entry = frames.back();
+
+  // parameter sets following the first brick apply to later frames
+  bool isBeforeFirstBrick = entry.firstBrickOffset < 0;
+
+  switch (type) {
+  case PayloadType::kSequenceParameterSet:
+    if (isBeforeFirstBrick) {
+      // a new sequence invalidates all other parameter sets
+      entry.spsOffset = offset;
+      entry.gpsOffset = -1;
+      entry.apsOffsets.clear();
+    }
+    break;
+
+  case PayloadType::kGeometryParameterSet:
+    if (isBeforeFirstBrick)
+      entry.gpsOffset = offset;
+    break;
+
+  case PayloadType::kAttributeParameterSet:
+    if (isBeforeFirstBrick)
+      entry.apsOffsets.push_back(offset);
+    break;
+
+  case PayloadType::kGeometryBrick:
+    if (isBeforeFirstBrick)
+      entry.firstBrickOffset = offset;
+    break;
+
+  default: break;
+  }
+}
+
+//----------------------------------------------------------------------------
+
+void
+FrameIndex::endFrame(int64_t offset)
+{
+  frames.back().endOffset = offset;
+}
+
+//============================================================================
+
+bool
+writeFrameIndex(const FrameIndex& index, const std::string& fileName)
+{
+  std::ofstream fout(fileName);
+  if (!fout.is_open())
+    return false;
+
+  fout << kFrameIndexHeader << '\n';
+  for (const auto& entry : index.frames) {
+    fout << entry.endOffset << ' ' << entry.firstBrickOffset << ' '
+         << entry.spsOffset << ' ' << entry.gpsOffset << ' '
+         << entry.apsOffsets.size();
+    for (auto offset : entry.apsOffsets)
+      fout << ' ' << offset;
+    fout << '\n';
+  }
+
+  fout.close();
+  return bool(fout);
+}
+
+//----------------------------------------------------------------------------
+
+bool
+readFrameIndex(const std::string& fileName, FrameIndex* index)
+{
+  std::ifstream fin(fileName);
+  if (!fin.is_open())
+    return false;
+
+  std::string line;
+  if (!std::getline(fin, line) || line != kFrameIndexHeader)
+    return false;
+
+  index->frames.clear();
+  while (std::getline(fin, line)) {
+    std::istringstream iss(line);
+    FrameIndexEntry entry;
+    size_t numAps;
+    iss >> entry.endOffset >> entry.firstBrickOffset >> entry.spsOffset
+      >> entry.gpsOffset >> numAps;
+
+    if (!iss)
+      return false;
+
+    entry.apsOffsets.resize(numAps);
+    for (auto& offset : entry.apsOffsets)
+      iss >> offset;
+
+    if (!iss)
+      return false;
+
+    index->frames.push_back(std::move(entry));
+  }
+
+  return true;
+}
+
+//============================================================================
+
+}  // namespace pcc
@@ -0,0 +1,92 @@
+/* The copyright in this software is being made available under the BSD
+ * Licence, included below.  This software may be subject to other third
+ * party and contributor rights, including patent rights, and no such
+ * rights are granted under this licence.
+ *
+ * Copyright (c) 2020, ISO/IEC
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * * Redistributions of source code must retain the above copyright
+ *   notice, this list of conditions and the following disclaimer.
+ *
+ * * Redistributions in binary form must reproduce the above copyright
+ *   notice, this list of conditions and the following disclaimer in the
+ *   documentation and/or other materials provided with the distribution.
+ *
+ * * Neither the name of the ISO/IEC nor the names of its contributors
+ *   may be used to endorse or promote products derived from this
+ *   software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#pragma once
+
+#include "hls.h"
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace pcc {
+
+//============================================================================
+// An index of the frames in a TLV bitstream, permitting a decoder to seek
+// to an arbitrary frame.  Each entry records the byte offsets within the
+// bitstream of the parameter sets active for a frame, and the extent of
+// the frame's bricks.
+
+struct FrameIndexEntry {
+  // Offsets of the most recent parameter sets preceding the first brick
+  int64_t spsOffset = -1;
+  int64_t gpsOffset = -1;
+  std::vector<int64_t> apsOffsets;
+
+  // Offset of the first geometry brick of the frame
+  int64_t firstBrickOffset = -1;
+
+  // Offset of the first byte following the frame
+  int64_t endOffset = -1;
+};
+
+//----------------------------------------------------------------------------
+
+struct FrameIndex {
+  std::vector<FrameIndexEntry> frames;
+
+  // Begin a new frame.  Parameter sets of the previous frame remain
+  // active until replaced.
+  void startFrame();
+
+  // Record the payload of @a type located at @a offset in the current frame
+  void addPayload(PayloadType type, int64_t offset);
+
+  // Complete the current frame, which ends at @a offset
+  void endFrame(int64_t offset);
+};
+
+//============================================================================
+// Read/write a frame index sidecar file.  The file is a text file with a
+// single header line followed by a line per frame:
+//   endOffset firstBrickOffset spsOffset gpsOffset numAps apsOffset...
+
+bool writeFrameIndex(const FrameIndex& index, const std::string& fileName);
+
+bool readFrameIndex(const std::string& fileName, FrameIndex* index);
+
+//============================================================================
+
+}  // namespace pcc
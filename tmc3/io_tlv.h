@@ -44,6 +44,11 @@ namespace pcc {
 
 //============================================================================
 
+// The size of the type and length fields preceding each payload
+const int kTlvHeaderSize = 5;
+
+//============================================================================
+
 std::ostream& writeTlv(const PayloadBuffer& buf, std::ostream& os);
 
 std::istream& readTlv(std::istream& is, PayloadBuffer* buf);
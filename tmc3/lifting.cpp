@@ -0,0 +1,217 @@
+/* The copyright in this software is being made available under the BSD
+ * Licence, included below.  This software may be subject to other third
+ * party and contributor rights, including patent rights, and no such
+ * rights are granted under this licence.
+ *
+ * Copyright (c) 2019, ISO/IEC
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * * Redistributions of source code must retain the above copyright
+ *   notice, this list of conditions and the following disclaimer.
+ *
+ * * Redistributions in binary form must reproduce the above copyright
+ *   notice, this list of conditions and the following disclaimer in the
+ *   documentation and/or other materials provided with the distribution.
+ *
+ * * Neither the name of the ISO/IEC nor the names of its contributors
+ *   may be used to endorse or promote products derived from this
+ *   software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "lifting.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cassert>
+
+#include "PCCMath.h"
+#include "parallel.h"
+
+namespace pcc {
+
+//============================================================================
+
+// The minimum number of predictors processed by each thread.
+static const size_t kLiftingMinGrain = 4096;
+
+//============================================================================
+
+LiftingNeighbours::LiftingNeighbours(
+  const std::vector<PCCPredictor>& predictors)
+{
+  const size_t predictorCount = predictors.size();
+  for (int k = 0; k < kAttributePredictionMaxNeighbourCount; ++k) {
+    index[k].resize(predictorCount);
+    weight[k].resize(predictorCount);
+  }
+
+  // The number of users of each predictor
+  std::vector<std::atomic<uint32_t>> userCount(predictorCount);
+
+  parallelFor(0, predictorCount, kLiftingMinGrain, [&](size_t b, size_t e) {
+    for (size_t i = b; i < e; ++i) {
+      const auto& predictor = predictors[i];
+      // NB: unused neighbours have zero weight and index
+      for (int k = 0; k < kAttributePredictionMaxNeighbourCount; ++k) {
+        index[k][i] = predictor.neighborIndex[k];
+        weight[k][i] = predictor.neighborWeight[k];
+        if (weight[k][i])
+          userCount[index[k][i]].fetch_add(1, std::memory_order_relaxed);
+      }
+    }
+  });
+
+  userOffset.resize(predictorCount + 1);
+  userOffset[0] = 0;
+  for (size_t i = 0; i < predictorCount; ++i) {
+    userOffset[i + 1] = userOffset[i] + userCount[i];
+    userCount[i] = 0;
+  }
+
+  // Users are inserted concurrently, and then sorted
+  users.resize(userOffset[predictorCount]);
+  parallelFor(0, predictorCount, kLiftingMinGrain, [&](size_t b, size_t e) {
+    for (size_t i = b; i < e; ++i) {
+      for (int k = 0; k < kAttributePredictionMaxNeighbourCount; ++k) {
+        if (!weight[k][i])
+          continue;
+        uint32_t target = index[k][i];
+        size_t pos = userOffset[target]
+          + userCount[target].fetch_add(1, std::memory_order_relaxed);
+        users[pos] = {uint32_t(i), weight[k][i]};
+      }
+    }
+  });
+
+  parallelFor(0, predictorCount, kLiftingMinGrain, [&](size_t b, size_t e) {
+    for (size_t i = b; i < e; ++i) {
+      std::sort(
+        users.begin() + userOffset[i], users.begin() + userOffset[i + 1],
+        [](const User& a, const User& b) { return a.index < b.index; });
+    }
+  });
+}
+
+//============================================================================
+// Predict the values of predictors [begin, end) for a single component.
+//
+// NB: all neighbours precede the level of detail being predicted, therefore
+//     each predictor may be processed independently.
+
+static void
+liftPredictComponent(
+  const LiftingNeighbours& neighbours,
+  size_t begin,
+  size_t end,
+  bool direct,
+  int64_t* attributes)
+{
+  const uint32_t* index[kAttributePredictionMaxNeighbourCount];
+  const uint32_t* weight[kAttributePredictionMaxNeighbourCount];
+  for (int k = 0; k < kAttributePredictionMaxNeighbourCount; ++k) {
+    index[k] = neighbours.index[k].data();
+    weight[k] = neighbours.weight[k].data();
+  }
+
+  const int64_t sign = direct ? -1 : 1;
+  for (size_t i = begin; i < end; ++i) {
+    int64_t predicted = 0;
+    for (int k = 0; k < kAttributePredictionMaxNeighbourCount; ++k)
+      predicted += int64_t(weight[k][i]) * attributes[index[k][i]];
+
+    predicted = divExp2RoundHalfInf(predicted, kFixedPointWeightShift);
+    attributes[i] += sign * predicted;
+  }
+}
+
+//----------------------------------------------------------------------------
+
+void
+PCCLiftPredict(
+  const LiftingNeighbours& neighbours,
+  size_t startIndex,
+  size_t endIndex,
+  bool direct,
+  int numComponents,
+  std::vector<int64_t>* attributes)
+{
+  parallelFor(startIndex, endIndex, kLiftingMinGrain, [&](size_t b, size_t e) {
+    for (int c = 0; c < numComponents; ++c)
+      liftPredictComponent(neighbours, b, e, direct, attributes[c].data());
+  });
+}
+
+//============================================================================
+
+void
+PCCLiftUpdate(
+  const LiftingNeighbours& neighbours,
+  const std::vector<uint64_t>& quantizationWeights,
+  size_t startIndex,
+  size_t endIndex,
+  bool direct,
+  int numComponents,
+  std::vector<int64_t>* attributes)
+{
+  using User = LiftingNeighbours::User;
+  const uint64_t* quantWeight = quantizationWeights.data();
+  const int64_t sign = direct ? 1 : -1;
+  assert(numComponents <= 3);
+
+  // All neighbours precede startIndex.  Each predictor gathers the updates
+  // from its users in [startIndex, endIndex), such that each thread owns
+  // the predictors that it updates.
+  //
+  // NB: the accumulation uses modular arithmetic.
+  parallelFor(0, startIndex, kLiftingMinGrain, [&](size_t b, size_t e) {
+    uint64_t sums[3];
+    for (size_t predictorIndex = b; predictorIndex < e; ++predictorIndex) {
+      auto first = neighbours.users.begin()
+        + neighbours.userOffset[predictorIndex];
+      auto last = neighbours.users.begin()
+        + neighbours.userOffset[predictorIndex + 1];
+
+      first = std::lower_bound(
+        first, last, startIndex,
+        [](const User& user, size_t idx) { return user.index < idx; });
+
+      uint64_t updateWeight = 0;
+      std::fill_n(sums, numComponents, 0);
+      for (; first != last && first->index < endIndex; ++first) {
+        const uint64_t w = uint64_t(first->weight) * quantWeight[first->index];
+        updateWeight += w;
+        for (int c = 0; c < numComponents; ++c)
+          sums[c] += w * uint64_t(attributes[c][first->index]);
+      }
+
+      const uint32_t sumWeights = uint32_t(updateWeight);
+      if (!sumWeights)
+        continue;
+
+      for (int c = 0; c < numComponents; ++c) {
+        const int64_t update =
+          (int64_t(sums[c]) + sumWeights / 2) / sumWeights;
+        attributes[c][predictorIndex] += sign * update;
+      }
+    }
+  });
+}
+
+//============================================================================
+
+}  // namespace pcc
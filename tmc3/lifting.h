@@ -0,0 +1,102 @@
+/* The copyright in this software is being made available under the BSD
+ * Licence, included below.  This software may be subject to other third
+ * party and contributor rights, including patent rights, and no such
+ * rights are granted under this licence.
+ *
+ * Copyright (c) 2019, ISO/IEC
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * * Redistributions of source code must retain the above copyright
+ *   notice, this list of conditions and the following disclaimer.
+ *
+ * * Redistributions in binary form must reproduce the above copyright
+ *   notice, this list of conditions and the following disclaimer in the
+ *   documentation and/or other materials provided with the distribution.
+ *
+ * * Neither the name of the ISO/IEC nor the names of its contributors
+ *   may be used to endorse or promote products derived from this
+ *   software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#pragma once
+
+#include "PCCTMC3Common.h"
+#include "constants.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace pcc {
+
+//============================================================================
+// A structure of arrays representation of the predictor neighbours used by
+// the lifting transform.
+//
+// Each predictor has kAttributePredictionMaxNeighbourCount neighbour slots.
+// Unused slots have a weight of zero and refer to the first predictor so
+// that the transform kernels need not consider the neighbour count.
+//
+// The inverse relation, the predictors that use each predictor as a
+// neighbour, is stored in compressed sparse row form for the update step:
+// the users of predictor i are users[userOffset[i] .. userOffset[i + 1]),
+// ordered by predictor index.
+
+struct LiftingNeighbours {
+  std::vector<uint32_t> index[kAttributePredictionMaxNeighbourCount];
+  std::vector<uint32_t> weight[kAttributePredictionMaxNeighbourCount];
+
+  struct User {
+    uint32_t index;
+    uint32_t weight;
+  };
+
+  std::vector<size_t> userOffset;
+  std::vector<User> users;
+
+  LiftingNeighbours() = default;
+  explicit LiftingNeighbours(const std::vector<PCCPredictor>& predictors);
+};
+
+//============================================================================
+// Lifting transform predict and update steps for the predictors in the
+// range [startIndex, endIndex) of a level of detail.
+//
+// The attributes are stored as one array per component.  The direct steps
+// are used by the forward transform, the inverse steps otherwise.
+
+void PCCLiftPredict(
+  const LiftingNeighbours& neighbours,
+  size_t startIndex,
+  size_t endIndex,
+  bool direct,
+  int numComponents,
+  std::vector<int64_t>* attributes);
+
+void PCCLiftUpdate(
+  const LiftingNeighbours& neighbours,
+  const std::vector<uint64_t>& quantizationWeights,
+  size_t startIndex,
+  size_t endIndex,
+  bool direct,
+  int numComponents,
+  std::vector<int64_t>* attributes);
+
+//============================================================================
+
+}  // namespace pcc
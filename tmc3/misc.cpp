@@ -46,6 +46,10 @@ namespace pcc {
 std::string
 expandNum(const std::string& src, int num)
 {
+  // NB: a string too short to contain a pattern is not otherwise copied
+  if (src.size() < 2)
+    return src;
+
   int idx = 0;
   auto nextChar = [&]() { return idx + 1 < src.size() ? src[idx + 1] : '\0'; };
 
@@ -0,0 +1,289 @@
+/* The copyright in this software is being made available under the BSD
+ * Licence, included below.  This software may be subject to other third
+ * party and contributor rights, including patent rights, and no such
+ * rights are granted under this licence.
+ *
+ * Copyright (c) 2020, ISO/IEC
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * * Redistributions of source code must retain the above copyright
+ *   notice, this list of conditions and the following disclaimer.
+ *
+ * * Redistributions in binary form must reproduce the above copyright
+ *   notice, this list of conditions and the following disclaimer in the
+ *   documentation and/or other materials provided with the distribution.
+ *
+ * * Neither the name of the ISO/IEC nor the names of its contributors
+ *   may be used to endorse or promote products derived from this
+ *   software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "nearest_neighbours.h"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <utility>
+
+namespace pcc {
+
+//============================================================================
+// The cell size is the smallest for which the occupied cells contain, on
+// average, at least this number of points.
+
+static const int kNnGridMinPointsPerCell = 8;
+
+// The number of bits per axis of cell positions (limited by mortonAddr).
+static const int kNnGridMaxCellBits = 21;
+
+//============================================================================
+// Fibonacci hashing of a cell's morton code.
+
+static inline size_t
+cellHash(int64_t code, int shift)
+{
+  return size_t((uint64_t(code) * 0x9E3779B97F4A7C15ull) >> shift);
+}
+
+//============================================================================
+
+NearestNeighbourGrid::NearestNeighbourGrid(const PCCPointSet3& cloud)
+  : _origin(0), _cellSizeLog2(0), _maxCell(0), _cellHashShift(64)
+{
+  const size_t pointCount = cloud.getPointCount();
+  _cellStart.push_back(0);
+  if (!pointCount)
+    return;
+
+  Box3<int32_t> bbox = cloud.computeBoundingBox();
+  _origin = bbox.min;
+
+  // the finest cell size that permits morton codes of the cell positions
+  int minCellSizeLog2 = 0;
+  for (int k = 0; k < 3; k++) {
+    uint32_t extent = uint32_t(int64_t(bbox.max[k]) - bbox.min[k]);
+    while ((extent >> minCellSizeLog2) >> kNnGridMaxCellBits)
+      minCellSizeLog2++;
+  }
+
+  // order the points by the morton code of their finest cell
+  std::vector<std::pair<int64_t, uint32_t>> codes(pointCount);
+  for (size_t i = 0; i < pointCount; i++) {
+    Vec3<int32_t> cell;
+    for (int k = 0; k < 3; k++)
+      cell[k] = uint32_t(cloud[i][k] - _origin[k]) >> minCellSizeLog2;
+    codes[i] = {mortonAddr(cell), uint32_t(i)};
+  }
+  std::sort(codes.begin(), codes.end());
+
+  // Coarsen the cells until sufficiently occupied.
+  // NB: morton order is preserved when coarsening.
+  _cellSizeLog2 = minCellSizeLog2;
+  for (int shift = 0; _cellSizeLog2 < 31; shift += 3, _cellSizeLog2++) {
+    size_t numCells = 1;
+    for (size_t i = 1; i < pointCount; i++)
+      numCells += (codes[i].first >> shift) != (codes[i - 1].first >> shift);
+
+    if (numCells * kNnGridMinPointsPerCell <= pointCount || numCells == 1)
+      break;
+  }
+
+  // build the cell index
+  const int shift = 3 * (_cellSizeLog2 - minCellSizeLog2);
+  _points.resize(pointCount);
+  for (size_t i = 0; i < pointCount; i++) {
+    int64_t cellCode = codes[i].first >> shift;
+    if (_cellCodes.empty() || _cellCodes.back() != cellCode) {
+      if (!_cellCodes.empty())
+        _cellStart.push_back(uint32_t(i));
+      _cellCodes.push_back(cellCode);
+    }
+
+    _points[i].idx = codes[i].second;
+    _points[i].pos = cloud[codes[i].second];
+  }
+  _cellStart.push_back(uint32_t(pointCount));
+
+  // the hash table is at most half full
+  int hashSizeLog2 = 1;
+  while ((size_t(1) << hashSizeLog2) < 2 * _cellCodes.size())
+    hashSizeLog2++;
+
+  _cellHashShift = 64 - hashSizeLog2;
+  _cellHash.assign(size_t(1) << hashSizeLog2, 0);
+  const size_t hashMask = _cellHash.size() - 1;
+  for (size_t i = 0; i < _cellCodes.size(); i++) {
+    size_t bucket = cellHash(_cellCodes[i], _cellHashShift);
+    while (_cellHash[bucket])
+      bucket = (bucket + 1) & hashMask;
+    _cellHash[bucket] = uint32_t(i + 1);
+  }
+
+  for (int k = 0; k < 3; k++)
+    _maxCell[k] =
+      uint32_t(int64_t(bbox.max[k]) - bbox.min[k]) >> _cellSizeLog2;
+}
+
+//----------------------------------------------------------------------------
+
+int64_t
+NearestNeighbourGrid::findCell(const Vec3<int32_t>& cell) const
+{
+  const int64_t code = mortonAddr(cell);
+  const size_t hashMask = _cellHash.size() - 1;
+  for (size_t bucket = cellHash(code, _cellHashShift); _cellHash[bucket];
+       bucket = (bucket + 1) & hashMask) {
+    const uint32_t cellIdx = _cellHash[bucket] - 1;
+    if (_cellCodes[cellIdx] == code)
+      return cellIdx;
+  }
+  return -1;
+}
+
+//----------------------------------------------------------------------------
+
+int
+NearestNeighbourGrid::findNeighbours(
+  const Vec3<double>& pos, int k, double* dist2, uint32_t* idx) const
+{
+  if (_points.empty() || k <= 0)
+    return 0;
+
+  const double cellSize = double(int64_t(1) << _cellSizeLog2);
+
+  const Vec3<double> q = pos - _origin;
+
+  // the cell containing the query position (which may be outside the grid)
+  Vec3<int64_t> qCell;
+  for (int i = 0; i < 3; i++)
+    qCell[i] = int64_t(std::floor(q[i] / cellSize));
+
+  // the first shell that intersects the grid
+  int64_t r = 0;
+  for (int i = 0; i < 3; i++)
+    r = std::max(r, std::max(-qCell[i], qCell[i] - _maxCell[i]));
+
+  int count = 0;
+  auto insert = [&](const Point& point) {
+    double d2 = 0.;
+    for (int i = 0; i < 3; i++) {
+      const double diff = pos[i] - point.pos[i];
+      d2 += diff * diff;
+    }
+
+    // insertion into the sorted list of neighbours, ordered by (d2, idx)
+    int j = count;
+    if (count == k) {
+      if (d2 > dist2[k - 1] || (d2 == dist2[k - 1] && point.idx > idx[k - 1]))
+        return;
+      j--;
+    } else {
+      count++;
+    }
+
+    for (; j > 0; j--) {
+      if (dist2[j - 1] < d2 || (dist2[j - 1] == d2 && idx[j - 1] < point.idx))
+        break;
+      dist2[j] = dist2[j - 1];
+      idx[j] = idx[j - 1];
+    }
+    dist2[j] = d2;
+    idx[j] = point.idx;
+  };
+
+  // The cell at position cell is searched unless it cannot contain a point
+  // nearer than the current kth neighbour.
+  // NB: point positions are integers, hence the last point in a cell is at
+  //     offset cellSize - 1.
+  auto visit = [&](const Vec3<int32_t>& cell) {
+    if (count == k) {
+      double d2 = 0.;
+      for (int i = 0; i < 3; i++) {
+        double lo = cell[i] * cellSize;
+        double gap = std::max(lo - q[i], q[i] - (lo + cellSize - 1.));
+        if (gap > 0.)
+          d2 += gap * gap;
+      }
+      if (d2 > dist2[k - 1])
+        return;
+    }
+
+    int64_t cellIdx = findCell(cell);
+    if (cellIdx < 0)
+      return;
+
+    for (auto i = _cellStart[cellIdx]; i < _cellStart[cellIdx + 1]; i++)
+      insert(_points[i]);
+  };
+
+  for (;; r++) {
+    // the range of cells in the shell of radius r, clipped to the grid
+    Vec3<int64_t> lo, hi;
+    bool isGridCovered = true;
+    for (int i = 0; i < 3; i++) {
+      lo[i] = std::max(qCell[i] - r, int64_t(0));
+      hi[i] = std::min(qCell[i] + r, int64_t(_maxCell[i]));
+      isGridCovered &= qCell[i] - r <= 0 && qCell[i] + r >= _maxCell[i];
+    }
+
+    Vec3<int32_t> cell;
+    for (int64_t x = lo[0]; x <= hi[0]; x++) {
+      cell[0] = int32_t(x);
+      bool xOnShell = std::abs(x - qCell[0]) == r;
+      for (int64_t y = lo[1]; y <= hi[1]; y++) {
+        cell[1] = int32_t(y);
+
+        // only the cells on the surface of the shell are visited
+        if (xOnShell || std::abs(y - qCell[1]) == r) {
+          for (int64_t z = lo[2]; z <= hi[2]; z++) {
+            cell[2] = int32_t(z);
+            visit(cell);
+          }
+          continue;
+        }
+
+        if ((cell[2] = int32_t(qCell[2] - r)) >= 0)
+          visit(cell);
+        if ((cell[2] = int32_t(qCell[2] + r)) <= _maxCell[2])
+          visit(cell);
+      }
+    }
+
+    if (isGridCovered)
+      break;
+
+    // Any point outside the visited cells is at least bound away from pos.
+    if (count == k) {
+      double bound = std::numeric_limits<double>::max();
+      for (int i = 0; i < 3; i++) {
+        if (qCell[i] - r > 0)
+          bound = std::min(bound, q[i] - ((qCell[i] - r) * cellSize - 1.));
+        if (qCell[i] + r < _maxCell[i])
+          bound = std::min(bound, (qCell[i] + r + 1) * cellSize - q[i]);
+      }
+      if (dist2[k - 1] < bound * bound)
+        break;
+    }
+  }
+
+  return count;
+}
+
+//============================================================================
+
+}  // namespace pcc
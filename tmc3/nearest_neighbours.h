@@ -0,0 +1,103 @@
+/* The copyright in this software is being made available under the BSD
+ * Licence, included below.  This software may be subject to other third
+ * party and contributor rights, including patent rights, and no such
+ * rights are granted under this licence.
+ *
+ * Copyright (c) 2020, ISO/IEC
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * * Redistributions of source code must retain the above copyright
+ *   notice, this list of conditions and the following disclaimer.
+ *
+ * * Redistributions in binary form must reproduce the above copyright
+ *   notice, this list of conditions and the following disclaimer in the
+ *   documentation and/or other materials provided with the distribution.
+ *
+ * * Neither the name of the ISO/IEC nor the names of its contributors
+ *   may be used to endorse or promote products derived from this
+ *   software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include "PCCMath.h"
+#include "PCCPointSet.h"
+
+namespace pcc {
+
+//============================================================================
+// A spatial index for k-nearest neighbour queries of integer point
+// positions.
+//
+// Points are bucketed into a uniform grid of power-of-two sized cells, the
+// occupied cells being stored in morton order and located by hashing.
+// A query examines shells of cells of increasing (Chebyshev) radius around
+// the query position until no unvisited cell may contain a nearer point
+// than those found.
+//
+// Neighbours are ordered by increasing distance, then by increasing index,
+// irrespective of the cell size.
+
+class NearestNeighbourGrid {
+public:
+  // Index the point positions of cloud.
+  explicit NearestNeighbourGrid(const PCCPointSet3& cloud);
+
+  // Find the (at most) k nearest points to pos, returning the number found.
+  // The squared distance and point index of each neighbour are written
+  // to dist2[i] and idx[i].
+  int findNeighbours(
+    const Vec3<double>& pos, int k, double* dist2, uint32_t* idx) const;
+
+private:
+  // The index of the occupied cell at position cell, or -1 if unoccupied.
+  int64_t findCell(const Vec3<int32_t>& cell) const;
+
+  // Position of the first cell
+  Vec3<int32_t> _origin;
+
+  // Log2 of the cell size
+  int _cellSizeLog2;
+
+  // Position of the last cell relative to the first
+  Vec3<int32_t> _maxCell;
+
+  // The morton code of each occupied cell, in increasing order
+  std::vector<int64_t> _cellCodes;
+
+  // The points in cell i are _points[_cellStart[i] .. _cellStart[i + 1])
+  std::vector<uint32_t> _cellStart;
+
+  // Open addressed hash table of cell index + 1, keyed by morton code
+  std::vector<uint32_t> _cellHash;
+  int _cellHashShift;
+
+  struct Point {
+    Vec3<int32_t> pos;
+    uint32_t idx;
+  };
+
+  std::vector<Point> _points;
+};
+
+//============================================================================
+
+}  // namespace pcc
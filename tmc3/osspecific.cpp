@@ -35,9 +35,13 @@
 
 #include "osspecific.h"
 
+#include <fstream>
+
 #if _POSIX_C_SOURCE
 #  include <fcntl.h>
+#  include <sys/mman.h>
 #  include <sys/stat.h>
+#  include <unistd.h>
 #endif
 
 #if _WIN32
@@ -61,3 +65,76 @@ pcc::mkdir(const char* path)
   return ::mkdir(path, 0775);
 }
 #endif
+
+#if _POSIX_C_SOURCE
+bool
+pcc::MappedFile::open(const char* path)
+{
+  close();
+
+  int fd = ::open(path, O_RDONLY);
+  if (fd < 0)
+    return false;
+
+  struct stat st;
+  if (fstat(fd, &st) || !S_ISREG(st.st_mode)) {
+    ::close(fd);
+    return false;
+  }
+
+  _size = size_t(st.st_size);
+  if (_size) {
+    void* addr = mmap(nullptr, _size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (addr == MAP_FAILED) {
+      _size = 0;
+      ::close(fd);
+      return false;
+    }
+    _data = static_cast<const char*>(addr);
+    madvise(addr, _size, MADV_WILLNEED);
+  }
+
+  // NB: the mapping remains valid after closing the file
+  ::close(fd);
+  return true;
+}
+
+void
+pcc::MappedFile::close()
+{
+  if (_data && _buf.empty())
+    munmap(const_cast<char*>(_data), _size);
+  _buf.clear();
+  _data = nullptr;
+  _size = 0;
+}
+#else
+bool
+pcc::MappedFile::open(const char* path)
+{
+  close();
+
+  std::ifstream fin(path, std::ios::binary | std::ios::ate);
+  if (!fin.is_open())
+    return false;
+
+  _buf.resize(size_t(fin.tellg()));
+  fin.seekg(0);
+  if (!fin.read(_buf.data(), _buf.size())) {
+    _buf.clear();
+    return false;
+  }
+
+  _data = _buf.data();
+  _size = _buf.size();
+  return true;
+}
+
+void
+pcc::MappedFile::close()
+{
+  _buf.clear();
+  _data = nullptr;
+  _size = 0;
+}
+#endif
@@ -35,9 +35,36 @@
 
 #pragma once
 
+#include <cstddef>
+#include <vector>
+
 namespace pcc {
 
 // Create a directory at the given path.
 int mkdir(const char* path);
 
+// A read-only view of the contents of a file.  The file is memory mapped
+// where supported, otherwise it is read into memory.
+class MappedFile {
+public:
+  MappedFile() = default;
+  MappedFile(const MappedFile&) = delete;
+  MappedFile& operator=(const MappedFile&) = delete;
+  ~MappedFile() { close(); }
+
+  // Returns false if the file cannot be opened.
+  bool open(const char* path);
+  void close();
+
+  const char* data() const { return _data; }
+  size_t size() const { return _size; }
+
+private:
+  const char* _data = nullptr;
+  size_t _size = 0;
+
+  // storage for the file contents when not mapped
+  std::vector<char> _buf;
+};
+
 } /* namespace pcc */
\ No newline at end of file
@@ -0,0 +1,106 @@
+/* The copyright in this software is being made available under the BSD
+ * Licence, included below.  This software may be subject to other third
+ * party and contributor rights, including patent rights, and no such
+ * rights are granted under this licence.
+ *
+ * Copyright (c) 2019, ISO/IEC
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * * Redistributions of source code must retain the above copyright
+ *   notice, this list of conditions and the following disclaimer.
+ *
+ * * Redistributions in binary form must reproduce the above copyright
+ *   notice, this list of conditions and the following disclaimer in the
+ *   documentation and/or other materials provided with the distribution.
+ *
+ * * Neither the name of the ISO/IEC nor the names of its contributors
+ *   may be used to endorse or promote products derived from this
+ *   software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "parallel.h"
+
+#include <atomic>
+#include <thread>
+#include <vector>
+
+namespace pcc {
+
+//============================================================================
+
+static int g_numThreads = 1;
+
+// Set in threads that are executing a parallel region
+static thread_local bool t_inParallelRegion = false;
+
+//----------------------------------------------------------------------------
+
+void
+setNumThreads(int numThreads)
+{
+  if (numThreads <= 0)
+    numThreads = int(std::thread::hardware_concurrency());
+
+  g_numThreads = std::max(1, numThreads);
+}
+
+//----------------------------------------------------------------------------
+
+int
+numThreads()
+{
+  return t_inParallelRegion ? 1 : g_numThreads;
+}
+
+//----------------------------------------------------------------------------
+
+void
+parallelInvoke(int count, const std::function<void(int)>& fn)
+{
+  const int numWorkers = std::min(count, numThreads());
+
+  if (numWorkers <= 1) {
+    for (int i = 0; i < count; i++)
+      fn(i);
+    return;
+  }
+
+  // Each worker (including the calling thread) claims the next unprocessed
+  // index until all have been processed.
+  std::atomic<int> next{0};
+  auto worker = [&]() {
+    t_inParallelRegion = true;
+    for (int i; (i = next++) < count;)
+      fn(i);
+    t_inParallelRegion = false;
+  };
+
+  std::vector<std::thread> threads;
+  threads.reserve(numWorkers - 1);
+  for (int t = 1; t < numWorkers; t++)
+    threads.emplace_back(worker);
+
+  worker();
+
+  for (auto& thread : threads)
+    thread.join();
+}
+
+//============================================================================
+
+}  // namespace pcc
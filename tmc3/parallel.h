@@ -0,0 +1,105 @@
+/* The copyright in this software is being made available under the BSD
+ * Licence, included below.  This software may be subject to other third
+ * party and contributor rights, including patent rights, and no such
+ * rights are granted under this licence.
+ *
+ * Copyright (c) 2019, ISO/IEC
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * * Redistributions of source code must retain the above copyright
+ *   notice, this list of conditions and the following disclaimer.
+ *
+ * * Redistributions in binary form must reproduce the above copyright
+ *   notice, this list of conditions and the following disclaimer in the
+ *   documentation and/or other materials provided with the distribution.
+ *
+ * * Neither the name of the ISO/IEC nor the names of its contributors
+ *   may be used to endorse or promote products derived from this
+ *   software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <functional>
+
+namespace pcc {
+
+//============================================================================
+// Configuration of the number of threads used by parallel algorithms.
+//
+// NB: the default of a single thread results in all parallel algorithms
+//     being executed serially by the calling thread.
+
+// Set the number of threads to use.  A value of 0 selects the number of
+// hardware threads.
+void setNumThreads(int numThreads);
+
+// The number of threads in use.
+int numThreads();
+
+//============================================================================
+// Invoke fn(i) for each i in [0, count), distributing the invocations over
+// the configured number of threads.  The order of invocation is undefined.
+// The call returns once all invocations have completed.
+//
+// NB: any parallel algorithm invoked by fn is executed serially in order
+//     to avoid oversubscription.
+
+void parallelInvoke(int count, const std::function<void(int)>& fn);
+
+//----------------------------------------------------------------------------
+// The number of contiguous chunks into which a range of @count elements
+// should be split such that each chunk contains at least @minGrain elements.
+
+inline int
+numParallelChunks(size_t count, size_t minGrain)
+{
+  size_t maxChunks = count / std::max(minGrain, size_t(1));
+  return int(std::max(size_t(1), std::min(size_t(numThreads()), maxChunks)));
+}
+
+//----------------------------------------------------------------------------
+// Split the range [begin, end) into contiguous chunks of at least @minGrain
+// elements and invoke fn(chunkBegin, chunkEnd) for each chunk in parallel.
+
+template<typename Fn>
+void
+parallelFor(size_t begin, size_t end, size_t minGrain, Fn fn)
+{
+  if (end <= begin)
+    return;
+
+  const size_t count = end - begin;
+  const int numChunks = numParallelChunks(count, minGrain);
+  if (numChunks == 1) {
+    fn(begin, end);
+    return;
+  }
+
+  parallelInvoke(numChunks, [&](int chunk) {
+    size_t chunkBegin = begin + count * chunk / numChunks;
+    size_t chunkEnd = begin + count * (chunk + 1) / numChunks;
+    fn(chunkBegin, chunkEnd);
+  });
+}
+
+//============================================================================
+
+}  // namespace pcc
@@ -34,19 +34,36 @@
  */
 
 #include "partitioning.h"
+#include "parallel.h"
 
 #include <algorithm>
 #include <cstdlib>
+#include <iterator>
 #include <map>
 #include <stdint.h>
 
 namespace pcc {
 
+//============================================================================
+// The minimum number of points processed by each thread when partitioning.
+
+static const size_t kPartitionMinGrain = 65536;
+
+// The maximum extent of the axis along which partitionByUniformGeom uses a
+// histogram to evaluate candidate slices.
+
+static const int kMaxUniformGeomHistogramBins = 1 << 24;
+
+// The maximum number of histogram bins per point, such that the histogram
+// of a sparse cloud does not exceed the cost of counting its points.
+
+static const size_t kMaxUniformGeomHistogramBinsPerPoint = 4;
+
 //============================================================================
 // Determine whether half of slices are smaller than maxPoints
 
 bool
-halfQualified(const std::vector<Partition> slices, int maxPoints)
+halfQualified(const std::vector<Partition>& slices, int maxPoints)
 {
   int Qualified = 0;
   for (int i = 0; i < slices.size(); i++) {
@@ -57,6 +74,21 @@ halfQualified(const std::vector<Partition> slices, int maxPoints)
   return ((double)Qualified / (double)slices.size()) > 0.5;
 }
 
+//----------------------------------------------------------------------------
+// As above, given the number of points in each slice
+
+static bool
+halfQualified(const std::vector<int64_t>& sliceCounts, int maxPoints)
+{
+  int Qualified = 0;
+  for (int i = 0; i < sliceCounts.size(); i++) {
+    if (sliceCounts[i] < maxPoints)
+      Qualified++;
+  }
+
+  return ((double)Qualified / (double)sliceCounts.size()) > 0.5;
+}
+
 //============================================================================
 
 template<typename T>
@@ -98,6 +130,11 @@ shortestAxis(const Box3<T>& curBox)
 // numPartitions describes the number of slices to produce (if zero, the
 // ratio of longest:shortest axis is used).
 // No tile metadata is generated.
+//
+// Each point belongs to the last slice that does not start after it.  The
+// number of slices is repeatedly doubled until at least half of them are
+// sufficiently small, each candidate being evaluated using a histogram of
+// point positions along the axis rather than by partitioning the points.
 
 std::vector<Partition>
 partitionByUniformGeom(
@@ -108,6 +145,10 @@ partitionByUniformGeom(
 {
   std::vector<Partition> slices;
 
+  const size_t numPoints = cloud.getPointCount();
+  if (!numPoints)
+    return slices;
+
   Box3<int32_t> bbox = cloud.computeBoundingBox();
 
   int maxEdgeAxis = longestAxis(bbox);
@@ -126,43 +167,158 @@ partitionByUniformGeom(
     sliceSize = (1 + sliceSize / partitionBoundary) * partitionBoundary;
   }
 
-  while (1) {
-    slices.clear();
-    slices.resize(sliceNum);
-
-    for (int i = 0; i < sliceNum; i++) {
-      auto& slice = slices[i];
-      slice.sliceId = i;
-      slice.tileId = tileID;
-      slice.origin = Vec3<int>{0};
+  // The position of a point along the axis relative to the bounding box
+  const int32_t axisMin = bbox.min[maxEdgeAxis];
+  auto axisPos = [&](size_t n) { return cloud[n][maxEdgeAxis] - axisMin; };
+
+  auto sliceIdx = [](int32_t pos, int sliceNum, int sliceSize) {
+    return sliceSize ? std::min(sliceNum - 1, pos / sliceSize) : sliceNum - 1;
+  };
+
+  // Points are processed in contiguous chunks, each accumulating
+  // @a numCounts counts, sized such that the total number of counts does
+  // not exceed the number of points.
+  auto numChunksFor = [&](size_t numCounts) {
+    return numParallelChunks(
+      numPoints, std::max(kPartitionMinGrain, numCounts));
+  };
+
+  auto chunkRange = [&](int chunk, int numChunks, size_t* begin, size_t* end) {
+    *begin = numPoints * chunk / numChunks;
+    *end = numPoints * (chunk + 1) / numChunks;
+  };
+
+  // Cumulative histogram of point positions along the axis.
+  // NB: a histogram is not used if the extent of the axis is too large,
+  //     either absolutely or relative to the number of points, candidate
+  //     slices being counted directly instead.
+  std::vector<uint64_t> cumulative;
+  const size_t numBins = size_t(maxEdge) + 1;
+  if (
+    maxEdge < kMaxUniformGeomHistogramBins
+    && numBins <= kMaxUniformGeomHistogramBinsPerPoint * numPoints) {
+    const int numChunks = numChunksFor(numBins);
+    std::vector<uint32_t> histograms(numChunks * numBins);
+
+    auto accumulate = [&](int chunk) {
+      size_t begin, end;
+      chunkRange(chunk, numChunks, &begin, &end);
+      uint32_t* histogram = &histograms[chunk * numBins];
+      for (size_t n = begin; n < end; n++)
+        histogram[axisPos(n)]++;
+    };
+
+    if (numChunks == 1)
+      accumulate(0);
+    else
+      parallelInvoke(numChunks, accumulate);
+
+    cumulative.resize(numBins + 1);
+    for (size_t i = 0; i < numBins; i++) {
+      uint64_t count = 0;
+      for (int chunk = 0; chunk < numChunks; chunk++)
+        count += histograms[chunk * numBins + i];
+      cumulative[i + 1] = cumulative[i] + count;
     }
+  }
 
-    for (int n = 0; n < cloud.getPointCount(); n++) {
-      for (int p = sliceNum - 1; p >= 0; p--) {
-        if (
-          cloud[n][maxEdgeAxis]
-          >= int(p * sliceSize + bbox.min[maxEdgeAxis])) {
-          auto& slice = slices[p];
-
-          slice.pointIndexes.push_back(n);
-          break;
-        }
+  // Count the points of each slice in each chunk
+  auto countChunks = [&](int sliceNum, int sliceSize, int numChunks) {
+    std::vector<int64_t> counts(numChunks * sliceNum);
+    auto count = [&](int chunk) {
+      size_t begin, end;
+      chunkRange(chunk, numChunks, &begin, &end);
+      int64_t* chunkCounts = &counts[chunk * sliceNum];
+      for (size_t n = begin; n < end; n++)
+        chunkCounts[sliceIdx(axisPos(n), sliceNum, sliceSize)]++;
+    };
+
+    if (numChunks == 1)
+      count(0);
+    else
+      parallelInvoke(numChunks, count);
+
+    return counts;
+  };
+
+  // Determine the number of points in each candidate slice
+  auto countSlices = [&](int sliceNum, int sliceSize) {
+    std::vector<int64_t> counts(sliceNum);
+    if (!cumulative.empty()) {
+      const int64_t binCount = int64_t(numBins);
+      for (int p = 0; p < sliceNum; p++) {
+        int64_t begin = std::min(binCount, int64_t(p) * sliceSize);
+        int64_t end = p == sliceNum - 1
+          ? binCount
+          : std::min(binCount, int64_t(p + 1) * sliceSize);
+        counts[p] = cumulative[end] - cumulative[begin];
       }
+      return counts;
     }
 
-    if (halfQualified(slices, params.sliceMaxPoints))
+    const int numChunks = numChunksFor(sliceNum);
+    auto chunkCounts = countChunks(sliceNum, sliceSize, numChunks);
+    for (int chunk = 0; chunk < numChunks; chunk++)
+      for (int p = 0; p < sliceNum; p++)
+        counts[p] += chunkCounts[chunk * sliceNum + p];
+    return counts;
+  };
+
+  std::vector<int64_t> sliceCounts;
+  while (1) {
+    sliceCounts = countSlices(sliceNum, sliceSize);
+    if (halfQualified(sliceCounts, params.sliceMaxPoints))
       break;
 
     sliceNum *= 2;
     sliceSize = maxEdge / sliceNum;
   }
 
-  // Delete the slice that with no points
-  slices.erase(
-    std::remove_if(
-      slices.begin(), slices.end(),
-      [](const Partition& p) { return p.pointIndexes.empty(); }),
-    slices.end());
+  // Distribute the points to the non-empty slices, retaining their order.
+  // Each chunk of points is written at offsets determined by the number
+  // of points of each slice in the preceding chunks.
+  std::vector<int> sliceMap(sliceNum, -1);
+  for (int p = 0; p < sliceNum; p++) {
+    if (!sliceCounts[p])
+      continue;
+
+    sliceMap[p] = slices.size();
+    slices.emplace_back();
+    auto& slice = slices.back();
+    slice.sliceId = p;
+    slice.tileId = tileID;
+    slice.origin = Vec3<int>{0};
+    slice.pointIndexes.resize(sliceCounts[p]);
+  }
+
+  const int numChunks = numChunksFor(sliceNum);
+  std::vector<int64_t> offsets(sliceNum);
+  if (numChunks > 1) {
+    offsets = countChunks(sliceNum, sliceSize, numChunks);
+    for (int p = 0; p < sliceNum; p++) {
+      int64_t offset = 0;
+      for (int chunk = 0; chunk < numChunks; chunk++) {
+        int64_t count = offsets[chunk * sliceNum + p];
+        offsets[chunk * sliceNum + p] = offset;
+        offset += count;
+      }
+    }
+  }
+
+  auto distribute = [&](int chunk) {
+    size_t begin, end;
+    chunkRange(chunk, numChunks, &begin, &end);
+    int64_t* chunkOffsets = &offsets[chunk * sliceNum];
+    for (size_t n = begin; n < end; n++) {
+      int p = sliceIdx(axisPos(n), sliceNum, sliceSize);
+      slices[sliceMap[p]].pointIndexes[chunkOffsets[p]++] = n;
+    }
+  };
+
+  if (numChunks == 1)
+    distribute(0);
+  else
+    parallelInvoke(numChunks, distribute);
 
   return slices;
 }
@@ -248,6 +404,186 @@ partitionByOctreeDepth(
   return slices;
 }
 
+//=============================================================================
+// Sort the points of @cloud into morton order, returning (code, index)
+// pairs.  Ties are broken by point index so that the order does not depend
+// upon the number of threads.
+
+static std::vector<std::pair<int64_t, int32_t>>
+sortByMortonCode(const PCCPointSet3& cloud)
+{
+  const size_t numPoints = cloud.getPointCount();
+  std::vector<std::pair<int64_t, int32_t>> order(numPoints);
+
+  // each chunk is sorted independently, then pairs of chunks are merged
+  const int numChunks = numParallelChunks(numPoints, kPartitionMinGrain);
+  std::vector<size_t> bounds(numChunks + 1);
+  for (int chunk = 0; chunk <= numChunks; chunk++)
+    bounds[chunk] = numPoints * chunk / numChunks;
+
+  parallelInvoke(numChunks, [&](int chunk) {
+    for (size_t i = bounds[chunk]; i < bounds[chunk + 1]; i++)
+      order[i] = {mortonAddr(cloud[i]), int32_t(i)};
+    auto first = order.begin() + bounds[chunk];
+    std::sort(first, order.begin() + bounds[chunk + 1]);
+  });
+
+  for (int width = 1; width < numChunks; width *= 2) {
+    int numMerges = (numChunks + 2 * width - 1) / (2 * width);
+    parallelInvoke(numMerges, [&](int merge) {
+      int first = 2 * width * merge;
+      int middle = std::min(first + width, numChunks);
+      int last = std::min(first + 2 * width, numChunks);
+      std::inplace_merge(
+        order.begin() + bounds[first], order.begin() + bounds[middle],
+        order.begin() + bounds[last]);
+    });
+  }
+
+  return order;
+}
+
+//----------------------------------------------------------------------------
+// The cost of each point is modelled as a fixed attribute coding cost plus
+// the geometry coding cost of the octree nodes first visited by the point
+// when traversing the points in morton order.  The cloud is cut into runs
+// of equal total cost.
+
+std::vector<Partition>
+partitionByCost(
+  const PartitionParams& params,
+  const PCCPointSet3& cloud,
+  int tileID,
+  int partitionBoundaryLog2)
+{
+  std::vector<Partition> slices;
+
+  const size_t numPoints = cloud.getPointCount();
+  if (!numPoints)
+    return slices;
+
+  auto order = sortByMortonCode(cloud);
+
+  Box3<int32_t> bbox = cloud.computeBoundingBox();
+  int maxBb = std::max({bbox.max[0], bbox.max[1], bbox.max[2]});
+  int depth = std::max(1, int(ceillog2(uint32_t(maxBb) + 1)));
+
+  // The number of octree nodes first visited by each point: the levels
+  // below the most significant level at which the point's code differs
+  // from that of the previous point.
+  std::vector<int8_t> newNodes(numPoints);
+  newNodes[0] = depth;
+  parallelFor(1, numPoints, kPartitionMinGrain, [&](size_t b, size_t e) {
+    for (size_t i = b; i < e; i++) {
+      uint64_t diff = order[i].first ^ order[i - 1].first;
+      newNodes[i] = diff ? ilog2(diff) / 3 + 1 : 0;
+    }
+  });
+
+  // cumulative cost of all points up to and including each point
+  std::vector<double> cumCost(numPoints);
+  double cost = 0.;
+  for (size_t i = 0; i < numPoints; i++) {
+    cost += params.nodeCost * newNodes[i] + params.pointCost;
+    cumCost[i] = cost;
+  }
+
+  // In order to avoid issues with trisoup, don't partition points within
+  // a trisoup node: cuts are advanced to the next node boundary.
+  const int boundaryShift = 3 * partitionBoundaryLog2;
+  auto alignCut = [&](size_t cut) {
+    while (cut > 0 && cut < numPoints
+           && (order[cut].first >> boundaryShift)
+             == (order[cut - 1].first >> boundaryShift))
+      cut++;
+    return cut;
+  };
+
+  size_t maxPoints = std::max(1, params.sliceMaxPoints);
+  size_t sliceNum = params.sliceCount;
+  if (!sliceNum)
+    sliceNum = (numPoints + maxPoints - 1) / maxPoints;
+  sliceNum = std::min(sliceNum, numPoints);
+
+  // cut at equal cost intervals
+  std::vector<size_t> cuts{0};
+  for (size_t k = 1; k < sliceNum; k++) {
+    double target = cost * k / sliceNum;
+    size_t cut = std::lower_bound(cumCost.begin(), cumCost.end(), target)
+      - cumCost.begin() + 1;
+    cut = alignCut(std::max(cut, cuts.back() + 1));
+    if (cut >= numPoints)
+      break;
+    cuts.push_back(cut);
+  }
+  cuts.push_back(numPoints);
+
+  // split any slice exceeding the maximum number of points into equal parts
+  std::vector<size_t> sliceCuts{0};
+  for (int k = 1; k < cuts.size(); k++) {
+    size_t begin = cuts[k - 1];
+    size_t count = cuts[k] - begin;
+    size_t numParts = (count + maxPoints - 1) / maxPoints;
+    for (size_t p = 1; p < numParts; p++) {
+      size_t cut = alignCut(begin + count * p / numParts);
+      if (cut > sliceCuts.back() && cut < cuts[k])
+        sliceCuts.push_back(cut);
+    }
+    sliceCuts.push_back(cuts[k]);
+  }
+
+  slices.resize(sliceCuts.size() - 1);
+  for (int k = 0; k < slices.size(); k++) {
+    auto& slice = slices[k];
+    slice.sliceId = k;
+    slice.tileId = tileID;
+    slice.origin = Vec3<int>{0};
+
+    size_t begin = sliceCuts[k];
+    size_t end = sliceCuts[k + 1];
+    slice.pointIndexes.resize(end - begin);
+    for (size_t i = begin; i < end; i++)
+      slice.pointIndexes[i - begin] = order[i].second;
+
+    // the first point of each slice begins a new octree
+    slice.numNodesEstimate = depth;
+    for (size_t i = begin + 1; i < end; i++)
+      slice.numNodesEstimate += newNodes[i];
+  }
+
+  return slices;
+}
+
+//----------------------------------------------------------------------------
+
+double
+expectedCost(const PartitionParams& params, const Partition& slice)
+{
+  return params.nodeCost * slice.numNodesEstimate
+    + params.pointCost * slice.pointIndexes.size();
+}
+
+//=============================================================================
+// let tile_origin = floor(pos / tile_size)
+
+uint64_t
+tileMortonCode(const point_t& pos, int tileSize)
+{
+  uint8_t tilePos[3];
+  for (int k = 0; k < 3; k++) {
+    tilePos[k] = std::floor(pos[k] / tileSize);
+  }
+
+  uint64_t mortonTileID = 0;
+  for (int p = 0; p < 8; p++) {
+    mortonTileID |= ((tilePos[0] >> p) & 1) << (3 * p + 2);
+    mortonTileID |= ((tilePos[1] >> p) & 1) << (3 * p + 1);
+    mortonTileID |= ((tilePos[2] >> p) & 1) << (3 * p);
+  }
+
+  return mortonTileID;
+}
+
 //=============================================================================
 // Split point cloud into several tiles according to tileSize
 
@@ -261,8 +597,9 @@ tilePartition(const PartitionParams& params, const PCCPointSet3& cloud)
   // let tile_origin = floor(pos / tile_size)
   // append pointIdx to tileMap[tile_origin]
   Box3<int32_t> bbox = cloud.computeBoundingBox();
+  // NB: the number of tiles includes that containing the maximum position
   int maxtileNum =
-    std::ceil(std::max({bbox.max[0], bbox.max[1], bbox.max[2]}) / tileSize);
+    std::max({bbox.max[0], bbox.max[1], bbox.max[2]}) / tileSize + 1;
   int tileNumlog2 = ceillog2(maxtileNum);
   std::vector<int> partMap(1 << (3 * tileNumlog2));
 
@@ -270,20 +607,8 @@ tilePartition(const PartitionParams& params, const PCCPointSet3& cloud)
   std::vector<uint64_t> pointToPartId(cloud.getPointCount());
 
   // for each point, determine a partition based upon the position
-  std::vector<uint8_t> tilePos(3);
-  uint64_t mortonTileID;
   for (int32_t i = 0, last = cloud.getPointCount(); i < last; i++) {
-    mortonTileID = 0;
-    for (int k = 0; k < 3; k++) {
-      tilePos[k] = std::floor(cloud[i][k] / tileSize);
-    }
-
-    for (int p = 0; p < 8; p++) {
-      mortonTileID |= ((tilePos[0] >> p) & 1) << (3 * p + 2);
-      mortonTileID |= ((tilePos[1] >> p) & 1) << (3 * p + 1);
-      mortonTileID |= ((tilePos[2] >> p) & 1) << (3 * p);
-    }
-
+    uint64_t mortonTileID = tileMortonCode(cloud[i], tileSize);
     partMap[mortonTileID]++;
     pointToPartId[i] = mortonTileID;
   }
@@ -400,7 +725,8 @@ splitSlice(
   AIndexes.erase(AIndexes.begin() + splitsize, AIndexes.end());
 
   toBeSplit = slices.insert(
-    toBeSplit + 1, splitPartitions.begin() + 1, splitPartitions.end());
+    toBeSplit + 1, std::make_move_iterator(splitPartitions.begin() + 1),
+    std::make_move_iterator(splitPartitions.end()));
 
   return toBeSplit + (numSplit - 1);
 }
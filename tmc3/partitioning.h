@@ -56,6 +56,9 @@ enum class PartitionMethod
 
   // Partition according to the depth of octree
   kOctreeUniform = 3,
+
+  // Partition into slices of near-equal estimated coding cost
+  kCostBalanced = 4,
 };
 
 //============================================================================
@@ -75,6 +78,15 @@ struct PartitionParams {
 
   // Baseline tile width. (0 => disabled)
   int tileSize;
+
+  // Number of slices per tile produced by cost balanced partitioning.
+  // (0 => derived from sliceMaxPoints)
+  int sliceCount;
+
+  // Cost model used by cost balanced partitioning: the expected geometry
+  // coding time per octree node and attribute coding time per point (us).
+  double nodeCost;
+  double pointCost;
 };
 
 //============================================================================
@@ -94,6 +106,10 @@ struct Partition {
 
   // Point indexes of the source point cloud that form this partition.
   std::vector<int32_t> pointIndexes;
+
+  // The number of octree nodes estimated to code this partition, or -1
+  // if no estimate was made.
+  int64_t numNodesEstimate = -1;
 };
 
 //----------------------------------------------------------------------------
@@ -117,11 +133,27 @@ std::vector<Partition> partitionByOctreeDepth(
   int tileID,
   bool splitByDepth = false);
 
+// Partition into contiguous runs of points in morton order such that each
+// slice has a near-equal expected coding cost.  Slices are not subject to
+// refinement by refineSlices.
+std::vector<Partition> partitionByCost(
+  const PartitionParams& params,
+  const PCCPointSet3& cloud,
+  int tileID,
+  int partitionBoundaryLog2);
+
+// The expected time (us) to code a partition according to the cost model.
+double expectedCost(const PartitionParams& params, const Partition& slice);
+
 //============================================================================
 
 std::vector<std::vector<int32_t>>
 tilePartition(const PartitionParams& params, const PCCPointSet3& cloud);
 
+// The morton code of the tile containing @a pos.  tilePartition numbers
+// the occupied tiles in increasing order of this code.
+uint64_t tileMortonCode(const point_t& pos, int tileSize);
+
 //============================================================================
 
 void refineSlices(
@@ -37,8 +37,16 @@
 
 #include "PCCMisc.h"
 #include "PCCPointSet.h"
+#include "osspecific.h"
+#include "parallel.h"
 
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
 #include <fstream>
+#include <limits>
 #include <string>
 #include <vector>
 
@@ -83,6 +91,173 @@ getTokens(
   return !tokens.empty();
 }
 
+//============================================================================
+// The number of points formatted as a unit when writing a ply file.
+
+static const size_t kPlyWriteBlockPoints = 65536;
+
+//----------------------------------------------------------------------------
+// The representation of point positions in a written ply file.
+
+enum class PlyPositionType
+{
+  kInt32,
+  kFloat32,
+  kFloat64,
+};
+
+//----------------------------------------------------------------------------
+// Select the most compact representation that exactly represents each
+// output position, pt * positionScale + positionOffset:
+//  - int32 if the scale is integral and the positions are in range,
+//  - float32 if the scale is 2^-n and the positions have at most 24
+//    significant bits,
+//  - float64 otherwise.
+
+static PlyPositionType
+selectPlyPositionType(
+  const PCCPointSet3& cloud, double positionScale, Vec3<int32_t> offset)
+{
+  const Box3<int32_t> bbox = cloud.computeBoundingBox();
+  if (!cloud.getPointCount())
+    return PlyPositionType::kInt32;
+
+  if (positionScale == std::floor(positionScale)) {
+    bool isInRange = true;
+    for (int k = 0; k < 3; k++) {
+      for (double pos : {double(bbox.min[k]), double(bbox.max[k])}) {
+        double val = pos * positionScale + offset[k];
+        isInRange &= val >= std::numeric_limits<int32_t>::min();
+        isInRange &= val <= std::numeric_limits<int32_t>::max();
+      }
+    }
+    if (isInRange)
+      return PlyPositionType::kInt32;
+  }
+
+  int exp;
+  if (std::frexp(positionScale, &exp) == 0.5 && exp <= 0) {
+    // scale = 2^-n, n > 0: each output is m * 2^-n for an integer m
+    const double invScale = std::ldexp(1., 1 - exp);
+    bool isExact = true;
+    for (int k = 0; k < 3; k++) {
+      for (double pos : {double(bbox.min[k]), double(bbox.max[k])})
+        isExact &= std::abs(pos + offset[k] * invScale) < double(1 << 24);
+    }
+    if (isExact)
+      return PlyPositionType::kFloat32;
+  }
+
+  return PlyPositionType::kFloat64;
+}
+
+//----------------------------------------------------------------------------
+// Append the decimal representation of val to buf.
+
+static inline void
+appendInt(std::vector<char>& buf, int64_t val)
+{
+  char tmp[24];
+  char* ptr = tmp + sizeof(tmp);
+  uint64_t mag = val < 0 ? 0 - uint64_t(val) : uint64_t(val);
+  do {
+    *--ptr = char('0' + mag % 10);
+    mag /= 10;
+  } while (mag);
+  if (val < 0)
+    *--ptr = '-';
+  buf.insert(buf.end(), ptr, tmp + sizeof(tmp));
+}
+
+//----------------------------------------------------------------------------
+// Format the points [begin, end) of cloud as ply vertex records in buf.
+
+static void
+formatPlyRecords(
+  const PCCPointSet3& cloud,
+  size_t begin,
+  size_t end,
+  double positionScale,
+  Vec3<int32_t> positionOffset,
+  PlyPositionType positionType,
+  bool asAscii,
+  std::vector<char>& buf)
+{
+  buf.clear();
+
+  if (asAscii) {
+    char tmp[64];
+    for (size_t i = begin; i < end; ++i) {
+      Vec3<double> position = cloud[i] * positionScale + positionOffset;
+      for (int k = 0; k < 3; k++) {
+        if (k)
+          buf.push_back(' ');
+        if (positionType == PlyPositionType::kInt32) {
+          appendInt(buf, int64_t(position[k]));
+        } else {
+          // NB: equivalent to std::fixed with a precision of 5
+          int len = snprintf(tmp, sizeof(tmp), "%.5f", position[k]);
+          buf.insert(buf.end(), tmp, tmp + len);
+        }
+      }
+      if (cloud.hasColors()) {
+        const Vec3<attr_t>& color = cloud.getColor(i);
+        for (int k = 0; k < 3; k++) {
+          buf.push_back(' ');
+          appendInt(buf, color[k]);
+        }
+      }
+      if (cloud.hasReflectances()) {
+        buf.push_back(' ');
+        appendInt(buf, cloud.getReflectance(i));
+      }
+      if (cloud.hasFrameIndex()) {
+        buf.push_back(' ');
+        appendInt(buf, cloud.getFrameIndex(i));
+      }
+      buf.push_back('\n');
+    }
+    return;
+  }
+
+  const size_t positionSize = positionType == PlyPositionType::kInt32
+    ? sizeof(int32_t)
+    : positionType == PlyPositionType::kFloat32 ? sizeof(float)
+                                                : sizeof(double);
+
+  const size_t recordSize = 3 * positionSize + 3 * cloud.hasColors()
+    + sizeof(uint16_t) * cloud.hasReflectances() + cloud.hasFrameIndex();
+
+  buf.resize((end - begin) * recordSize);
+  char* ptr = buf.data();
+  for (size_t i = begin; i < end; ++i) {
+    Vec3<double> position = cloud[i] * positionScale + positionOffset;
+    for (int k = 0; k < 3; k++, ptr += positionSize) {
+      if (positionType == PlyPositionType::kInt32) {
+        int32_t val = int32_t(position[k]);
+        std::memcpy(ptr, &val, sizeof(val));
+      } else if (positionType == PlyPositionType::kFloat32) {
+        float val = float(position[k]);
+        std::memcpy(ptr, &val, sizeof(val));
+      } else {
+        std::memcpy(ptr, &position[k], sizeof(double));
+      }
+    }
+    if (cloud.hasColors()) {
+      const Vec3<attr_t>& c = cloud.getColor(i);
+      for (int k = 0; k < 3; k++)
+        *ptr++ = char(uint8_t(c[k]));
+    }
+    if (cloud.hasReflectances()) {
+      const uint16_t reflectance = cloud.getReflectance(i);
+      std::memcpy(ptr, &reflectance, sizeof(reflectance));
+      ptr += sizeof(reflectance);
+    }
+    if (cloud.hasFrameIndex())
+      *ptr++ = char(cloud.getFrameIndex(i));
+  }
+}
+
 //============================================================================
 
 bool
@@ -92,7 +267,8 @@ ply::write(
   double positionScale,
   Vec3<int32_t> positionOffset,
   const std::string& fileName,
-  bool asAscii)
+  bool asAscii,
+  bool compactPositions)
 {
   std::ofstream fout(fileName, std::ofstream::out);
   if (!fout.is_open()) {
@@ -100,6 +276,11 @@ ply::write(
   }
 
   const size_t pointCount = cloud.getPointCount();
+  // NB: ascii output of float64 positions is declared as float
+  const PlyPositionType positionType = compactPositions
+    ? selectPlyPositionType(cloud, positionScale, positionOffset)
+    : PlyPositionType::kFloat64;
+
   fout << "ply" << std::endl;
 
   if (asAscii) {
@@ -113,14 +294,16 @@ ply::write(
     }
   }
   fout << "element vertex " << pointCount << std::endl;
-  if (asAscii) {
-    fout << "property float " << attributeNames.position[0] << std::endl;
-    fout << "property float " << attributeNames.position[1] << std::endl;
-    fout << "property float " << attributeNames.position[2] << std::endl;
-  } else {
-    fout << "property float64 " << attributeNames.position[0] << std::endl;
-    fout << "property float64 " << attributeNames.position[1] << std::endl;
-    fout << "property float64 " << attributeNames.position[2] << std::endl;
+
+  const char* positionTypeName = "float64";
+  if (positionType == PlyPositionType::kInt32)
+    positionTypeName = "int32";
+  else if (positionType == PlyPositionType::kFloat32 || asAscii)
+    positionTypeName = "float";
+
+  for (int k = 0; k < 3; k++) {
+    fout << "property " << positionTypeName << ' '
+         << attributeNames.position[k] << std::endl;
   }
 
   if (cloud.hasColors()) {
@@ -137,51 +320,274 @@ ply::write(
   fout << "element face 0" << std::endl;
   fout << "property list uint8 int32 vertex_index" << std::endl;
   fout << "end_header" << std::endl;
-  if (asAscii) {
-    //      fout << std::setprecision(std::numeric_limits<double>::max_digits10);
-    fout << std::fixed << std::setprecision(5);
-    for (size_t i = 0; i < pointCount; ++i) {
-      Vec3<double> position = cloud[i] * positionScale + positionOffset;
-      fout << position.x() << " " << position.y() << " " << position.z();
-      if (cloud.hasColors()) {
-        const Vec3<attr_t>& color = cloud.getColor(i);
-        fout << " " << static_cast<int>(color[0]) << " "
-             << static_cast<int>(color[1]) << " "
-             << static_cast<int>(color[2]);
-      }
-      if (cloud.hasReflectances()) {
-        fout << " " << static_cast<int>(cloud.getReflectance(i));
-      }
-      if (cloud.hasFrameIndex()) {
-        fout << " " << static_cast<int>(cloud.getFrameIndex(i));
-      }
-      fout << std::endl;
-    }
-  } else {
+
+  if (!asAscii) {
     fout.clear();
     fout.close();
     fout.open(fileName, std::ofstream::binary | std::ofstream::app);
-    for (size_t i = 0; i < pointCount; ++i) {
-      Vec3<double> position = cloud[i] * positionScale + positionOffset;
-      fout.write(
-        reinterpret_cast<const char* const>(&position), sizeof(double) * 3);
-      if (cloud.hasColors()) {
-        const Vec3<attr_t>& c = cloud.getColor(i);
-        Vec3<uint8_t> val8b{uint8_t(c[0]), uint8_t(c[1]), uint8_t(c[2])};
-        fout.write(reinterpret_cast<const char*>(&val8b), sizeof(uint8_t) * 3);
-      }
-      if (cloud.hasReflectances()) {
-        const attr_t& reflectance = cloud.getReflectance(i);
-        fout.write(
-          reinterpret_cast<const char*>(&reflectance), sizeof(uint16_t));
-      }
-      if (cloud.hasFrameIndex()) {
-        const uint16_t& findex = cloud.getFrameIndex(i);
-        fout.write(reinterpret_cast<const char*>(&findex), sizeof(uint16_t));
+  }
+
+  // The body is formatted in blocks, a batch of blocks at a time
+  // (in parallel), each batch being written in block order.
+  const size_t numBlocks =
+    (pointCount + kPlyWriteBlockPoints - 1) / kPlyWriteBlockPoints;
+  const size_t batchSize = size_t(std::max(1, numThreads()));
+  std::vector<std::vector<char>> bufs(std::min(batchSize, numBlocks));
+
+  for (size_t first = 0; first < numBlocks; first += batchSize) {
+    const int count = int(std::min(batchSize, numBlocks - first));
+    parallelInvoke(count, [&](int j) {
+      size_t begin = (first + j) * kPlyWriteBlockPoints;
+      size_t end = std::min(pointCount, begin + kPlyWriteBlockPoints);
+      formatPlyRecords(
+        cloud, begin, end, positionScale, positionOffset, positionType,
+        asAscii, bufs[j]);
+    });
+
+    for (int j = 0; j < count; j++)
+      fout.write(bufs[j].data(), bufs[j].size());
+  }
+
+  fout.close();
+  return bool(fout);
+}
+
+//============================================================================
+// The representation of a ply property value.
+
+enum class PlyType
+{
+  kFloat64,
+  kFloat32,
+  kUint64,
+  kUint32,
+  kUint16,
+  kUint8,
+  kInt64,
+  kInt32,
+  kInt16,
+  kInt8,
+};
+
+//----------------------------------------------------------------------------
+// The point cloud field into which a ply property is converted.
+
+enum class PlyField
+{
+  kPosX,
+  kPosY,
+  kPosZ,
+  kColourG,
+  kColourB,
+  kColourR,
+  kReflectance,
+  kFrameIndex,
+};
+
+//----------------------------------------------------------------------------
+// The conversion of a single property of a vertex record.
+
+struct PlyFieldConversion {
+  PlyField field;
+  PlyType type;
+  int byteCount;
+
+  // The byte offset (binary) or token index (ascii) of the property
+  size_t pos;
+};
+
+//----------------------------------------------------------------------------
+// The minimum number of vertex records (binary) or bytes (ascii) processed
+// by each thread while reading a ply file.
+
+static const size_t kPlyBinaryMinGrain = 65536;
+static const size_t kPlyAsciiMinGrain = 1 << 20;
+
+//============================================================================
+// Load a value of type T from an unaligned address.
+
+template<typename T>
+static inline T
+loadUnaligned(const char* ptr)
+{
+  T val;
+  std::memcpy(&val, ptr, sizeof(T));
+  return val;
+}
+
+//----------------------------------------------------------------------------
+// Convert a binary position property to an integer position.
+// NB: floating point values are truncated.
+
+static inline int32_t
+convertBinaryPosition(const PlyFieldConversion& conv, const char* ptr)
+{
+  switch (conv.type) {
+  case PlyType::kFloat64: return int32_t(loadUnaligned<double>(ptr));
+  case PlyType::kFloat32: return int32_t(loadUnaligned<float>(ptr));
+  case PlyType::kUint64: return int32_t(loadUnaligned<uint64_t>(ptr));
+  case PlyType::kUint32: return int32_t(loadUnaligned<uint32_t>(ptr));
+  case PlyType::kInt64: return int32_t(loadUnaligned<int64_t>(ptr));
+  case PlyType::kInt32: return loadUnaligned<int32_t>(ptr);
+  default: return 0;
+  }
+}
+
+//----------------------------------------------------------------------------
+// The bit pattern of a binary attribute property of at most two bytes.
+
+static inline uint16_t
+convertBinaryAttribute(const PlyFieldConversion& conv, const char* ptr)
+{
+  if (conv.byteCount == 1)
+    return uint8_t(*ptr);
+  return loadUnaligned<uint16_t>(ptr);
+}
+
+//============================================================================
+// Parse an integer from the token [ptr, end) as per atoi().
+
+static int
+parseAsciiInt(const char* ptr, const char* end)
+{
+  bool isNegative = false;
+  if (ptr != end && (*ptr == '-' || *ptr == '+'))
+    isNegative = *ptr++ == '-';
+
+  int64_t val = 0;
+  for (; ptr != end && *ptr >= '0' && *ptr <= '9'; ptr++)
+    val = val * 10 + (*ptr - '0');
+
+  return int(isNegative ? -val : val);
+}
+
+//----------------------------------------------------------------------------
+// Parse a position from the token [ptr, end), truncating the value as per
+// int32_t(atof()).
+//
+// Plain decimal values with at most 15 significant digits cannot be rounded
+// to an integer when converted to double precision: their truncated value
+// is the integer part.  Other forms are parsed by strtod().
+
+static int32_t
+parseAsciiPosition(const char* const begin, const char* const end)
+{
+  const char* ptr = begin;
+  bool isNegative = false;
+  if (ptr != end && (*ptr == '-' || *ptr == '+'))
+    isNegative = *ptr++ == '-';
+
+  int64_t intPart = 0;
+  int numDigits = 0;
+  for (; ptr != end && *ptr >= '0' && *ptr <= '9'; ptr++, numDigits++)
+    intPart = intPart * 10 + (*ptr - '0');
+
+  if (ptr != end && *ptr == '.') {
+    for (ptr++; ptr != end && *ptr >= '0' && *ptr <= '9'; ptr++)
+      numDigits++;
+  }
+
+  if (ptr == end && numDigits && numDigits <= 15)
+    return int32_t(isNegative ? -intPart : intPart);
+
+  char buf[64];
+  size_t len = std::min(size_t(end - begin), sizeof(buf) - 1);
+  std::memcpy(buf, begin, len);
+  buf[len] = '\0';
+  return int32_t(std::strtod(buf, nullptr));
+}
+
+//----------------------------------------------------------------------------
+// Convert the ascii vertex records in [ptr, end), storing at most
+// maxPoints points in cloud starting at pointIdx.  The number of records
+// converted is written to numRecords.  Returns false if a record has fewer
+// than numProperties tokens.
+//
+// When cloud is null, the records are only counted.
+
+static bool
+readAsciiRecords(
+  const char* ptr,
+  const char* const end,
+  const std::vector<PlyFieldConversion>& plan,
+  size_t numProperties,
+  PCCPointSet3* cloud,
+  size_t pointIdx,
+  size_t maxPoints,
+  size_t* numRecords)
+{
+  const auto isSep = [](char c) { return c == ' ' || c == '\t' || c == '\r'; };
+
+  // start and end of each token in the current record
+  std::vector<std::pair<const char*, const char*>> tokens(numProperties);
+
+  size_t count = 0;
+  while (ptr != end && count < maxPoints) {
+    const char* eol = static_cast<const char*>(
+      std::memchr(ptr, '\n', size_t(end - ptr)));
+    if (!eol)
+      eol = end;
+
+    size_t numTokens = 0;
+    while (ptr != eol) {
+      while (ptr != eol && isSep(*ptr))
+        ptr++;
+      if (ptr == eol)
+        break;
+
+      const char* tokenStart = ptr;
+      while (ptr != eol && !isSep(*ptr))
+        ptr++;
+      if (numTokens < numProperties)
+        tokens[numTokens] = {tokenStart, ptr};
+      numTokens++;
+    }
+    ptr = eol == end ? end : eol + 1;
+
+    // empty lines are ignored
+    if (!numTokens)
+      continue;
+
+    if (numTokens < numProperties) {
+      *numRecords = count;
+      return false;
+    }
+
+    if (cloud) {
+      const size_t idx = pointIdx + count;
+      for (const auto& conv : plan) {
+        const auto& token = tokens[conv.pos];
+        switch (conv.field) {
+        case PlyField::kPosX:
+        case PlyField::kPosY:
+        case PlyField::kPosZ:
+          (*cloud)[idx][int(conv.field) - int(PlyField::kPosX)] =
+            parseAsciiPosition(token.first, token.second);
+          break;
+
+        case PlyField::kColourG:
+        case PlyField::kColourB:
+        case PlyField::kColourR:
+          cloud->getColor(idx)[int(conv.field) - int(PlyField::kColourG)] =
+            attr_t(parseAsciiInt(token.first, token.second));
+          break;
+
+        case PlyField::kReflectance:
+          cloud->getReflectance(idx) =
+            uint16_t(parseAsciiInt(token.first, token.second));
+          break;
+
+        case PlyField::kFrameIndex:
+          cloud->getFrameIndex(idx) =
+            uint8_t(parseAsciiInt(token.first, token.second));
+          break;
+        }
       }
     }
+    count++;
   }
-  fout.close();
+
+  *numRecords = count;
   return true;
 }
 
@@ -193,26 +599,16 @@ ply::read(
   const PropertyNameMap& attributeNames,
   PCCPointSet3& cloud)
 {
-  std::ifstream ifs(fileName, std::ifstream::in | std::ifstream::binary);
-  if (!ifs.is_open()) {
+  MappedFile file;
+  if (!file.open(fileName.c_str())) {
     return false;
   }
-  enum AttributeType
-  {
-    ATTRIBUTE_TYPE_FLOAT64 = 0,
-    ATTRIBUTE_TYPE_FLOAT32 = 1,
-    ATTRIBUTE_TYPE_UINT64 = 2,
-    ATTRIBUTE_TYPE_UINT32 = 3,
-    ATTRIBUTE_TYPE_UINT16 = 4,
-    ATTRIBUTE_TYPE_UINT8 = 5,
-    ATTRIBUTE_TYPE_INT64 = 6,
-    ATTRIBUTE_TYPE_INT32 = 7,
-    ATTRIBUTE_TYPE_INT16 = 8,
-    ATTRIBUTE_TYPE_INT8 = 9,
-  };
+  const char* ptr = file.data();
+  const char* const end = file.data() + file.size();
+
   struct AttributeInfo {
     std::string name;
-    AttributeType type;
+    PlyType type;
     size_t byteCount;
   };
 
@@ -223,7 +619,20 @@ ply::read(
   const char* sep = " \t\r";
   std::vector<std::string> tokens;
 
-  ifs.getline(tmp, MAX_BUFFER_SIZE);
+  // Copy the next line of the header to tmp
+  const auto getline = [&]() {
+    size_t len = 0;
+    while (ptr != end && *ptr != '\n') {
+      if (len < MAX_BUFFER_SIZE - 1)
+        tmp[len++] = *ptr;
+      ptr++;
+    }
+    if (ptr != end)
+      ptr++;
+    tmp[len] = '\0';
+  };
+
+  getline();
   getTokens(tmp, sep, tokens);
   if (tokens.empty() || tokens[0] != "ply") {
     std::cout << "Error: corrupted file!" << std::endl;
@@ -234,11 +643,11 @@ ply::read(
   size_t pointCount = 0;
   bool isVertexProperty = true;
   while (1) {
-    if (ifs.eof()) {
+    if (ptr == end) {
       std::cout << "Error: corrupted header!" << std::endl;
       return false;
     }
-    ifs.getline(tmp, MAX_BUFFER_SIZE);
+    getline();
     getTokens(tmp, sep, tokens);
     if (tokens.empty() || tokens[0] == "comment") {
       continue;
@@ -271,36 +680,39 @@ ply::read(
       attributesInfo.resize(attributeIndex + 1);
       AttributeInfo& attributeInfo = attributesInfo[attributeIndex];
       attributeInfo.name = propertyName;
-      if (propertyType == "float64") {
-        attributeInfo.type = ATTRIBUTE_TYPE_FLOAT64;
+      if (propertyType == "float64" || propertyType == "double") {
+        attributeInfo.type = PlyType::kFloat64;
         attributeInfo.byteCount = 8;
       } else if (propertyType == "float" || propertyType == "float32") {
-        attributeInfo.type = ATTRIBUTE_TYPE_FLOAT32;
+        attributeInfo.type = PlyType::kFloat32;
         attributeInfo.byteCount = 4;
       } else if (propertyType == "uint64") {
-        attributeInfo.type = ATTRIBUTE_TYPE_UINT64;
+        attributeInfo.type = PlyType::kUint64;
         attributeInfo.byteCount = 8;
-      } else if (propertyType == "uint32") {
-        attributeInfo.type = ATTRIBUTE_TYPE_UINT32;
+      } else if (propertyType == "uint32" || propertyType == "uint") {
+        attributeInfo.type = PlyType::kUint32;
         attributeInfo.byteCount = 4;
-      } else if (propertyType == "uint16") {
-        attributeInfo.type = ATTRIBUTE_TYPE_UINT16;
+      } else if (propertyType == "uint16" || propertyType == "ushort") {
+        attributeInfo.type = PlyType::kUint16;
         attributeInfo.byteCount = 2;
       } else if (propertyType == "uchar" || propertyType == "uint8") {
-        attributeInfo.type = ATTRIBUTE_TYPE_UINT8;
+        attributeInfo.type = PlyType::kUint8;
         attributeInfo.byteCount = 1;
       } else if (propertyType == "int64") {
-        attributeInfo.type = ATTRIBUTE_TYPE_INT64;
+        attributeInfo.type = PlyType::kInt64;
         attributeInfo.byteCount = 8;
-      } else if (propertyType == "int32") {
-        attributeInfo.type = ATTRIBUTE_TYPE_INT32;
+      } else if (propertyType == "int32" || propertyType == "int") {
+        attributeInfo.type = PlyType::kInt32;
         attributeInfo.byteCount = 4;
-      } else if (propertyType == "int16") {
-        attributeInfo.type = ATTRIBUTE_TYPE_INT16;
+      } else if (propertyType == "int16" || propertyType == "short") {
+        attributeInfo.type = PlyType::kInt16;
         attributeInfo.byteCount = 2;
       } else if (propertyType == "char" || propertyType == "int8") {
-        attributeInfo.type = ATTRIBUTE_TYPE_INT8;
+        attributeInfo.type = PlyType::kInt8;
         attributeInfo.byteCount = 1;
+      } else {
+        std::cout << "Error: unsupported property type!" << std::endl;
+        return false;
       }
     } else if (tokens[0] == "end_header") {
       break;
@@ -319,9 +731,6 @@ ply::read(
   size_t indexB = PCC_UNDEFINED_INDEX;
   size_t indexReflectance = PCC_UNDEFINED_INDEX;
   size_t indexFrame = PCC_UNDEFINED_INDEX;
-  size_t indexNX = PCC_UNDEFINED_INDEX;
-  size_t indexNY = PCC_UNDEFINED_INDEX;
-  size_t indexNZ = PCC_UNDEFINED_INDEX;
   const size_t attributeCount = attributesInfo.size();
   for (size_t a = 0; a < attributeCount; ++a) {
     const auto& attributeInfo = attributesInfo[a];
@@ -350,18 +759,6 @@ ply::read(
     } else if (
       attributeInfo.name == "frameindex" && attributeInfo.byteCount <= 2) {
       indexFrame = a;
-    } else if (
-      attributeInfo.name == "nx"
-      && (attributeInfo.byteCount == 8 || attributeInfo.byteCount == 4)) {
-      indexNX = a;
-    } else if (
-      attributeInfo.name == "ny"
-      && (attributeInfo.byteCount == 8 || attributeInfo.byteCount == 4)) {
-      indexNY = a;
-    } else if (
-      attributeInfo.name == "nz"
-      && (attributeInfo.byteCount == 8 || attributeInfo.byteCount == 4)) {
-      indexNZ = a;
     }
   }
   if (
@@ -382,109 +779,124 @@ ply::read(
     cloud.removeFrameIndex();
 
   cloud.resize(pointCount);
+
+  // The conversion plan for each vertex record, with the byte offset of
+  // each property within a binary record.
+  std::vector<PlyFieldConversion> plan;
+  std::vector<size_t> byteOffsets(attributeCount + 1);
+  for (size_t a = 0; a < attributeCount; ++a)
+    byteOffsets[a + 1] = byteOffsets[a] + attributesInfo[a].byteCount;
+  const size_t recordSize = byteOffsets[attributeCount];
+
+  const auto addConversion = [&](PlyField field, size_t a) {
+    const size_t pos = isAscii ? a : byteOffsets[a];
+    const auto& info = attributesInfo[a];
+    plan.push_back({field, info.type, int(info.byteCount), pos});
+  };
+
+  addConversion(PlyField::kPosX, indexX);
+  addConversion(PlyField::kPosY, indexY);
+  addConversion(PlyField::kPosZ, indexZ);
+  if (withColors) {
+    addConversion(PlyField::kColourG, indexG);
+    addConversion(PlyField::kColourB, indexB);
+    addConversion(PlyField::kColourR, indexR);
+  }
+  if (withReflectances)
+    addConversion(PlyField::kReflectance, indexReflectance);
+  if (withFrameIndex)
+    addConversion(PlyField::kFrameIndex, indexFrame);
+
   if (isAscii) {
-    size_t pointCounter = 0;
-    while (!ifs.eof() && pointCounter < pointCount) {
-      ifs.getline(tmp, MAX_BUFFER_SIZE);
-      getTokens(tmp, sep, tokens);
-      if (tokens.empty()) {
-        continue;
-      }
-      if (tokens.size() < attributeCount) {
+    // Split the body into chunks of whole lines, count the records in each
+    // chunk to determine the index of its first point, then convert them.
+    const size_t bodySize = size_t(end - ptr);
+    const int numChunks = numParallelChunks(bodySize, kPlyAsciiMinGrain);
+    std::vector<const char*> chunkStart(numChunks + 1, end);
+    chunkStart[0] = ptr;
+    for (int i = 1; i < numChunks; i++) {
+      const char* pos = ptr + bodySize * i / numChunks;
+      pos = std::max(pos, chunkStart[i - 1]);
+      const char* eol =
+        static_cast<const char*>(std::memchr(pos, '\n', size_t(end - pos)));
+      chunkStart[i] = eol ? eol + 1 : end;
+    }
+
+    // NB: a single chunk does not need to be counted
+    std::vector<size_t> chunkPointIdx(numChunks + 1);
+    std::vector<size_t> chunkNumRecords(numChunks, 0);
+    std::vector<char> chunkOk(numChunks, 1);
+    parallelInvoke(numChunks - 1, [&](int i) {
+      readAsciiRecords(
+        chunkStart[i], chunkStart[i + 1], plan, attributeCount, nullptr, 0,
+        pointCount, &chunkPointIdx[i + 1]);
+    });
+
+    for (int i = 0; i < numChunks; i++)
+      chunkPointIdx[i + 1] += chunkPointIdx[i];
+
+    parallelInvoke(numChunks, [&](int i) {
+      size_t pointIdx = chunkPointIdx[i];
+      if (pointIdx < pointCount)
+        chunkOk[i] = readAsciiRecords(
+          chunkStart[i], chunkStart[i + 1], plan, attributeCount, &cloud,
+          pointIdx, pointCount - pointIdx, &chunkNumRecords[i]);
+    });
+
+    // NB: an error after the last point is not significant
+    size_t numRecords = 0;
+    for (int i = 0; i < numChunks && chunkPointIdx[i] < pointCount; i++) {
+      if (!chunkOk[i])
         return false;
-      }
-      auto& position = cloud[pointCounter];
-      position[0] = atof(tokens[indexX].c_str());
-      position[1] = atof(tokens[indexY].c_str());
-      position[2] = atof(tokens[indexZ].c_str());
-      if (cloud.hasColors()) {
-        auto& color = cloud.getColor(pointCounter);
-        color[0] = atoi(tokens[indexG].c_str());
-        color[1] = atoi(tokens[indexB].c_str());
-        color[2] = atoi(tokens[indexR].c_str());
-      }
-      if (cloud.hasReflectances()) {
-        cloud.getReflectance(pointCounter) =
-          uint16_t(atoi(tokens[indexReflectance].c_str()));
-      }
-      if (cloud.hasFrameIndex()) {
-        cloud.getFrameIndex(pointCounter) =
-          uint8_t(atoi(tokens[indexFrame].c_str()));
-      }
-      ++pointCounter;
+      numRecords += chunkNumRecords[i];
+    }
+
+    if (numRecords < pointCount) {
+      std::cout << "Error: truncated ply file!" << std::endl;
+      return false;
     }
   } else {
-    for (size_t pointCounter = 0; pointCounter < pointCount && !ifs.eof();
-         ++pointCounter) {
-      auto& position = cloud[pointCounter];
-      for (size_t a = 0; a < attributeCount && !ifs.eof(); ++a) {
-        const auto& attributeInfo = attributesInfo[a];
-        if (a == indexX) {
-          if (attributeInfo.byteCount == 4) {
-            float x;
-            ifs.read(reinterpret_cast<char*>(&x), sizeof(float));
-            position[0] = x;
-          } else {
-            double x;
-            ifs.read(reinterpret_cast<char*>(&x), sizeof(double));
-            position[0] = x;
-          }
-        } else if (a == indexY) {
-          if (attributeInfo.byteCount == 4) {
-            float y;
-            ifs.read(reinterpret_cast<char*>(&y), sizeof(float));
-            position[1] = y;
-          } else {
-            double y;
-            ifs.read(reinterpret_cast<char*>(&y), sizeof(double));
-            position[1] = y;
-          }
-        } else if (a == indexZ) {
-          if (attributeInfo.byteCount == 4) {
-            float z;
-            ifs.read(reinterpret_cast<char*>(&z), sizeof(float));
-            position[2] = z;
-          } else {
-            double z;
-            ifs.read(reinterpret_cast<char*>(&z), sizeof(double));
-            position[2] = z;
-          }
-        } else if (a == indexR && attributeInfo.byteCount == 1) {
-          uint8_t val8b;
-          ifs.read(reinterpret_cast<char*>(&val8b), sizeof(uint8_t));
-          cloud.getColor(pointCounter)[2] = val8b;
-        } else if (a == indexG && attributeInfo.byteCount == 1) {
-          uint8_t val8b;
-          ifs.read(reinterpret_cast<char*>(&val8b), sizeof(uint8_t));
-          cloud.getColor(pointCounter)[0] = val8b;
-        } else if (a == indexB && attributeInfo.byteCount == 1) {
-          uint8_t val8b;
-          ifs.read(reinterpret_cast<char*>(&val8b), sizeof(uint8_t));
-          cloud.getColor(pointCounter)[1] = val8b;
-        } else if (a == indexReflectance && attributeInfo.byteCount <= 2) {
-          if (attributeInfo.byteCount == 1) {
-            uint8_t reflectance;
-            ifs.read(reinterpret_cast<char*>(&reflectance), sizeof(uint8_t));
-            cloud.getReflectance(pointCounter) = reflectance;
-          } else {
-            auto& reflectance = cloud.getReflectance(pointCounter);
-            ifs.read(reinterpret_cast<char*>(&reflectance), sizeof(uint16_t));
-          }
-        } else if (a == indexFrame && attributeInfo.byteCount <= 2) {
-          if (attributeInfo.byteCount == 1) {
-            auto& findex = cloud.getFrameIndex(pointCounter);
-            ifs.read(reinterpret_cast<char*>(&findex), sizeof(uint8_t));
-          } else {
-            uint16_t findex;
-            ifs.read(reinterpret_cast<char*>(&findex), sizeof(uint16_t));
-            cloud.getFrameIndex(pointCounter) = uint8_t(findex);
+    const size_t numRecords =
+      std::min(pointCount, recordSize ? size_t(end - ptr) / recordSize : 0);
+
+    if (numRecords < pointCount) {
+      std::cout << "Error: truncated ply file!" << std::endl;
+      return false;
+    }
+
+    const char* const body = ptr;
+    parallelFor(0, numRecords, kPlyBinaryMinGrain, [&](size_t b, size_t e) {
+      for (size_t i = b; i < e; i++) {
+        const char* record = body + i * recordSize;
+        for (const auto& conv : plan) {
+          const char* field = record + conv.pos;
+          switch (conv.field) {
+          case PlyField::kPosX:
+          case PlyField::kPosY:
+          case PlyField::kPosZ:
+            cloud[i][int(conv.field) - int(PlyField::kPosX)] =
+              convertBinaryPosition(conv, field);
+            break;
+
+          case PlyField::kColourG:
+          case PlyField::kColourB:
+          case PlyField::kColourR:
+            cloud.getColor(i)[int(conv.field) - int(PlyField::kColourG)] =
+              uint8_t(*field);
+            break;
+
+          case PlyField::kReflectance:
+            cloud.getReflectance(i) = convertBinaryAttribute(conv, field);
+            break;
+
+          case PlyField::kFrameIndex:
+            cloud.getFrameIndex(i) =
+              uint8_t(convertBinaryAttribute(conv, field));
+            break;
           }
-        } else {
-          char buffer[128];
-          ifs.read(buffer, attributeInfo.byteCount);
         }
       }
-    }
+    });
   }
   return true;
 }
@@ -66,13 +66,16 @@ namespace ply {
   // @param positionOffset  offset for positions (after scaling).
   // @param fileName  output filename.
   // @param asAscii  PLY writing format (true => ascii, false => binary).
+  // @param compactPositions  write positions using the most compact exact
+  //                          type rather than always as floating point.
   bool write(
     const PCCPointSet3& pointCloud,
     const PropertyNameMap& propertyNames,
     double positionScale,
     Vec3<int32_t> positionOffset,
     const std::string& fileName,
-    bool asAscii);
+    bool asAscii,
+    bool compactPositions);
 
   bool read(
     const std::string& fileName,
@@ -37,8 +37,10 @@
 
 #include "colourspace.h"
 #include "hls.h"
-#include "KDTreeVectorOfVectorsAdaptor.h"
+#include "nearest_neighbours.h"
+#include "parallel.h"
 
+#include <algorithm>
 #include <cstddef>
 #include <set>
 #include <vector>
@@ -56,7 +58,7 @@ namespace pcc {
 //
 // NB: attributes are not processed.
 
-void
+Box3<int32_t>
 quantizePositionsUniq(
   const float scaleFactor,
   const Vec3<int> offset,
@@ -68,6 +70,8 @@ quantizePositionsUniq(
   // Determine the set of unique quantised points
   std::multimap<Vec3<int32_t>, int32_t> intQuantizedToOrigin;
   std::set<Vec3<int32_t>> uniquePoints;
+  Box3<int32_t> bbox = {std::numeric_limits<int32_t>::max(),
+                        std::numeric_limits<int32_t>::lowest()};
   int numSrcPoints = src.getPointCount();
   for (int i = 0; i < numSrcPoints; ++i) {
     const auto& point = src[i];
@@ -76,6 +80,8 @@ quantizePositionsUniq(
     for (int k = 0; k < 3; k++) {
       double k_pos = std::round((point[k] - offset[k]) * scaleFactor);
       quantizedPoint[k] = PCCClip(int32_t(k_pos), clamp.min[k], clamp.max[k]);
+      bbox.min[k] = std::min(bbox.min[k], quantizedPoint[k]);
+      bbox.max[k] = std::max(bbox.max[k], quantizedPoint[k]);
     }
 
     uniquePoints.insert(quantizedPoint);
@@ -94,6 +100,53 @@ quantizePositionsUniq(
   int idx = 0;
   for (const auto& point : uniquePoints)
     (*dst)[idx++] = point;
+
+  return bbox;
+}
+
+//============================================================================
+// The minimum number of points processed by each thread when transforming
+// point positions.
+
+static const size_t kPositionsMinGrain = 16384;
+
+//----------------------------------------------------------------------------
+// Set the position of each point i in [0, count) of @dst to fn(i),
+// distributing the work over the configured number of threads.  Returns the
+// bounding box of the updated positions.
+
+template<typename Fn>
+static Box3<int32_t>
+transformPositions(size_t count, PCCPointSet3* dst, Fn fn)
+{
+  const int numChunks = numParallelChunks(count, kPositionsMinGrain);
+  std::vector<Box3<int32_t>> chunkBboxes(
+    numChunks,
+    {std::numeric_limits<int32_t>::max(),
+     std::numeric_limits<int32_t>::lowest()});
+
+  parallelInvoke(numChunks, [&](int chunk) {
+    auto& bbox = chunkBboxes[chunk];
+    size_t begin = count * chunk / numChunks;
+    size_t end = count * (chunk + 1) / numChunks;
+    for (size_t i = begin; i < end; ++i) {
+      const point_t point = ((*dst)[i] = fn(i));
+      for (int k = 0; k < 3; ++k) {
+        bbox.min[k] = std::min(bbox.min[k], point[k]);
+        bbox.max[k] = std::max(bbox.max[k], point[k]);
+      }
+    }
+  });
+
+  Box3<int32_t> bbox = chunkBboxes[0];
+  for (const auto& chunkBbox : chunkBboxes) {
+    for (int k = 0; k < 3; ++k) {
+      bbox.min[k] = std::min(bbox.min[k], chunkBbox.min[k]);
+      bbox.max[k] = std::max(bbox.max[k], chunkBbox.max[k]);
+    }
+  }
+
+  return bbox;
 }
 
 //============================================================================
@@ -105,7 +158,7 @@ quantizePositionsUniq(
 //
 // NB: attributes are preserved
 
-void
+Box3<int32_t>
 quantizePositions(
   const float scaleFactor,
   const Vec3<int> offset,
@@ -116,34 +169,97 @@ quantizePositions(
   int numSrcPoints = src.getPointCount();
 
   // In case dst and src point clouds are the same, don't destroy src.
-  if (&src != dst) {
+  const bool copyAttributes = &src != dst;
+  if (copyAttributes) {
     dst->clear();
     dst->addRemoveAttributes(src.hasColors(), src.hasReflectances());
     dst->resize(numSrcPoints);
   }
 
-  for (int i = 0; i < numSrcPoints; ++i) {
-    const auto point = src[i];
-    auto& dstPoint = (*dst)[i];
+  const bool copyColours = copyAttributes && src.hasColors();
+  const bool copyReflectances = copyAttributes && src.hasReflectances();
+
+  return transformPositions(numSrcPoints, dst, [&](size_t i) {
+    if (copyColours)
+      dst->setColor(i, src.getColor(i));
+
+    if (copyReflectances)
+      dst->setReflectance(i, src.getReflectance(i));
+
+    const point_t point = src[i];
+    point_t dstPoint;
     for (int k = 0; k < 3; ++k) {
       double k_pos = std::round((point[k] - offset[k]) * scaleFactor);
       dstPoint[k] = PCCClip(int32_t(k_pos), clamp.min[k], clamp.max[k]);
     }
+    return dstPoint;
+  });
+}
+
+//============================================================================
+
+Box3<int32_t>
+translatePositions(const Vec3<int> offset, PCCPointSet3* cloud)
+{
+  return transformPositions(
+    cloud->getPointCount(), cloud,
+    [&](size_t i) -> point_t { return (*cloud)[i] - offset; });
+}
+
+//============================================================================
+
+void
+splitFrames(const PCCPointSet3& cloud, std::vector<PCCPointSet3>* frames)
+{
+  assert(cloud.hasFrameIndex());
+  const size_t pointCount = cloud.getPointCount();
+
+  // Count the points of each frame, allocate, then distribute the points
+  std::vector<size_t> frameSizes;
+  for (size_t i = 0; i < pointCount; i++) {
+    int frameIdx = cloud.getFrameIndex(i);
+    if (frameIdx >= frameSizes.size())
+      frameSizes.resize(frameIdx + 1);
+    frameSizes[frameIdx]++;
   }
 
-  // don't copy attributes if dst already has them
-  if (&src == dst)
-    return;
+  frames->clear();
+  frames->resize(frameSizes.size());
+  for (int j = 0; j < frameSizes.size(); j++) {
+    auto& frame = (*frames)[j];
+    frame.addRemoveAttributes(cloud.hasColors(), cloud.hasReflectances());
+    frame.resize(frameSizes[j]);
+    frameSizes[j] = 0;
+  }
 
-  if (src.hasColors()) {
-    for (int i = 0; i < numSrcPoints; ++i)
-      dst->setColor(i, src.getColor(i));
+  for (size_t i = 0; i < pointCount; i++) {
+    int frameIdx = cloud.getFrameIndex(i);
+    auto& frame = (*frames)[frameIdx];
+    size_t dstIdx = frameSizes[frameIdx]++;
+
+    frame[dstIdx] = cloud[i];
+    if (cloud.hasColors())
+      frame.setColor(dstIdx, cloud.getColor(i));
+    if (cloud.hasReflectances())
+      frame.setReflectance(dstIdx, cloud.getReflectance(i));
   }
+}
 
-  if (src.hasReflectances()) {
-    for (int i = 0; i < numSrcPoints; ++i)
-      dst->setReflectance(i, src.getReflectance(i));
+//----------------------------------------------------------------------------
+
+void
+appendFrame(const PCCPointSet3& frame, int frameIdx, PCCPointSet3* merged)
+{
+  if (!merged->getPointCount()) {
+    merged->addRemoveAttributes(frame.hasColors(), frame.hasReflectances());
+    merged->addFrameIndex();
   }
+
+  size_t dstIdx = merged->getPointCount();
+  merged->append(frame);
+
+  for (size_t i = 0; i < frame.getPointCount(); i++, dstIdx++)
+    merged->setFrameIndex(dstIdx, frameIdx);
 }
 
 //============================================================================
@@ -161,6 +277,132 @@ clampVolume(Box3<double> bbox, PCCPointSet3* cloud)
   }
 }
 
+//============================================================================
+// The minimum number of target/source points processed by each thread
+// during recolouring.
+
+static const size_t kRecolourMinGrain = 1024;
+
+//============================================================================
+// Find the forward and backward nearest neighbours used to recolour target
+// from source.
+
+RecolourNeighbours
+findRecolourNeighbours(
+  const RecolourParams& cfg,
+  const PCCPointSet3& source,
+  double sourceToTargetScaleFactor,
+  Vec3<double> targetToSourceOffset,
+  const PCCPointSet3& target)
+{
+  double targetToSourceScaleFactor = 1.0 / sourceToTargetScaleFactor;
+
+  const size_t pointCountSource = source.getPointCount();
+  const size_t pointCountTarget = target.getPointCount();
+
+  RecolourNeighbours nbrs;
+  nbrs.numFwd = 0;
+  nbrs.fwdNearestOnlyIdx = pointCountTarget;
+  nbrs.bwdStart.assign(pointCountTarget + 1, 0);
+  if (!pointCountSource || !pointCountTarget)
+    return nbrs;
+
+  NearestNeighbourGrid gridTarget(target);
+  NearestNeighbourGrid gridSource(source);
+
+  double maxGeometryDist2Fwd = cfg.maxGeometryDist2Fwd < 512
+    ? cfg.maxGeometryDist2Fwd
+    : std::numeric_limits<double>::max();
+  double maxGeometryDist2Bwd = cfg.maxGeometryDist2Bwd < 512
+    ? cfg.maxGeometryDist2Bwd
+    : std::numeric_limits<double>::max();
+
+  // Forward direction
+  // NB: a search cannot find more neighbours than there are points
+  const int numFwd =
+    std::max(1, int(std::min(size_t(cfg.numNeighboursFwd), pointCountSource)));
+  nbrs.numFwd = numFwd;
+  nbrs.fwd.resize(pointCountTarget * numFwd);
+
+  parallelFor(0, pointCountTarget, kRecolourMinGrain, [&](size_t b, size_t e) {
+    std::vector<uint32_t> indices(numFwd);
+    std::vector<double> sqrDist(numFwd);
+    for (size_t index = b; index < e; ++index) {
+      Vec3<double> posInSrc =
+        target[index] * targetToSourceScaleFactor + targetToSourceOffset;
+
+      gridSource.findNeighbours(posInSrc, numFwd, &sqrDist[0], &indices[0]);
+
+      auto* fwd = &nbrs.fwd[index * numFwd];
+      for (int i = 0; i < numFwd; i++)
+        fwd[i] = {sqrDist[i], indices[i]};
+    }
+  });
+
+  // The first target point with a furthest neighbour beyond
+  // maxGeometryDist2Fwd limits it and all subsequent points to their
+  // nearest neighbour (as per the original sequential implementation).
+  for (size_t index = 0; index < pointCountTarget && numFwd > 1; ++index) {
+    if (nbrs.fwd[(index + 1) * numFwd - 1].dist2 > maxGeometryDist2Fwd) {
+      nbrs.fwdNearestOnlyIdx = index;
+      break;
+    }
+  }
+
+  // Backward direction
+  const int numBwd =
+    std::max(1, int(std::min(size_t(cfg.numNeighboursBwd), pointCountTarget)));
+  std::vector<RecolourNeighbours::Neighbour> bwdQueries;
+  bwdQueries.resize(pointCountSource * numBwd);
+
+  parallelFor(0, pointCountSource, kRecolourMinGrain, [&](size_t b, size_t e) {
+    std::vector<uint32_t> indices(numBwd);
+    std::vector<double> sqrDist(numBwd);
+    for (size_t index = b; index < e; ++index) {
+      Vec3<double> posInTgt =
+        (source[index] - targetToSourceOffset) * sourceToTargetScaleFactor;
+
+      gridTarget.findNeighbours(posInTgt, numBwd, &sqrDist[0], &indices[0]);
+
+      auto* bwd = &bwdQueries[index * numBwd];
+      for (int i = 0; i < numBwd; i++)
+        bwd[i] = {sqrDist[i], indices[i]};
+    }
+  });
+
+  // Invert the backward queries: gather, in source point order, the source
+  // points that have each target point as a neighbour.
+  for (const auto& query : bwdQueries) {
+    if (query.dist2 <= maxGeometryDist2Bwd)
+      nbrs.bwdStart[query.idx + 1]++;
+  }
+
+  for (size_t index = 0; index < pointCountTarget; ++index)
+    nbrs.bwdStart[index + 1] += nbrs.bwdStart[index];
+
+  nbrs.bwd.resize(nbrs.bwdStart.back());
+  std::vector<uint32_t> bwdEnd(nbrs.bwdStart.begin(), nbrs.bwdStart.end() - 1);
+  for (size_t i = 0; i < bwdQueries.size(); ++i) {
+    const auto& query = bwdQueries[i];
+    if (query.dist2 <= maxGeometryDist2Bwd)
+      nbrs.bwd[bwdEnd[query.idx]++] = {query.dist2, uint32_t(i / numBwd)};
+  }
+
+  parallelFor(0, pointCountTarget, kRecolourMinGrain, [&](size_t b, size_t e) {
+    for (size_t index = b; index < e; ++index) {
+      std::sort(
+        nbrs.bwd.begin() + nbrs.bwdStart[index],
+        nbrs.bwd.begin() + nbrs.bwdStart[index + 1],
+        [](const RecolourNeighbours::Neighbour& a,
+           const RecolourNeighbours::Neighbour& b) {
+          return a.dist2 < b.dist2;
+        });
+    }
+  });
+
+  return nbrs;
+}
+
 //============================================================================
 // Determine colour attribute values from a reference/source point cloud.
 // For each point of the target p_t:
@@ -187,23 +429,15 @@ recolourColour(
   const AttributeDescription& attrDesc,
   const RecolourParams& params,
   const PCCPointSet3& source,
-  double sourceToTargetScaleFactor,
-  Vec3<double> targetToSourceOffset,
+  const RecolourNeighbours& nbrs,
   PCCPointSet3& target)
 {
-  double targetToSourceScaleFactor = 1.0 / sourceToTargetScaleFactor;
-
   const size_t pointCountSource = source.getPointCount();
   const size_t pointCountTarget = target.getPointCount();
   if (!pointCountSource || !pointCountTarget || !source.hasColors()) {
     return false;
   }
 
-  KDTreeVectorOfVectorsAdaptor<PCCPointSet3, double> kdtreeTarget(
-    3, target, 10);
-  KDTreeVectorOfVectorsAdaptor<PCCPointSet3, double> kdtreeSource(
-    3, source, 10);
-
   target.addColors();
   std::vector<Vec3<attr_t>> refinedColors1;
   refinedColors1.resize(pointCountTarget);
@@ -212,12 +446,6 @@ recolourColour(
                        double((1 << attrDesc.attr_bitdepth_secondary) - 1),
                        double((1 << attrDesc.attr_bitdepth_secondary) - 1)};
 
-  double maxGeometryDist2Fwd = params.maxGeometryDist2Fwd < 512
-    ? params.maxGeometryDist2Fwd
-    : std::numeric_limits<double>::max();
-  double maxGeometryDist2Bwd = params.maxGeometryDist2Bwd < 512
-    ? params.maxGeometryDist2Bwd
-    : std::numeric_limits<double>::max();
   double maxAttributeDist2Fwd = params.maxAttributeDist2Fwd < 512
     ? params.maxAttributeDist2Fwd
     : std::numeric_limits<double>::max();
@@ -226,162 +454,100 @@ recolourColour(
     : std::numeric_limits<double>::max();
 
   // Forward direction
-  const int num_resultsFwd = params.numNeighboursFwd;
-  nanoflann::KNNResultSet<double> resultSetFwd(num_resultsFwd);
-  std::vector<size_t> indicesFwd(num_resultsFwd);
-  std::vector<double> sqrDistFwd(num_resultsFwd);
-  for (size_t index = 0; index < pointCountTarget; ++index) {
-    resultSetFwd.init(&indicesFwd[0], &sqrDistFwd[0]);
-
-    Vec3<double> posInSrc =
-      target[index] * targetToSourceScaleFactor + targetToSourceOffset;
-
-    kdtreeSource.index->findNeighbors(
-      resultSetFwd, &posInSrc[0], nanoflann::SearchParams(10));
-
-    while (1) {
-      if (indicesFwd.size() == 1)
-        break;
-
-      if (sqrDistFwd[int(resultSetFwd.size()) - 1] <= maxGeometryDist2Fwd)
-        break;
-
-      sqrDistFwd.pop_back();
-      indicesFwd.pop_back();
-    }
-
-    bool isDone = false;
-    if (params.skipAvgIfIdenticalSourcePointPresentFwd) {
-      if (sqrDistFwd[0] < 0.0001) {
-        refinedColors1[index] = source.getColor(indicesFwd[0]);
-        isDone = true;
-      }
-    }
-
-    if (isDone)
-      continue;
-
-    int nNN = indicesFwd.size();
-    while (nNN > 0 && !isDone) {
-      if (nNN == 1) {
-        refinedColors1[index] = source.getColor(indicesFwd[0]);
-        isDone = true;
-        break;
+  parallelFor(0, pointCountTarget, kRecolourMinGrain, [&](size_t b, size_t e) {
+    std::vector<Vec3<attr_t>> colors;
+    for (size_t index = b; index < e; ++index) {
+      const auto* nbrFwd = &nbrs.fwd[index * nbrs.numFwd];
+
+      if (params.skipAvgIfIdenticalSourcePointPresentFwd) {
+        if (nbrFwd[0].dist2 < 0.0001) {
+          refinedColors1[index] = source.getColor(nbrFwd[0].idx);
+          continue;
+        }
       }
 
-      std::vector<Vec3<attr_t>> colors;
-      colors.resize(0);
-      colors.resize(nNN);
-      for (int i = 0; i < nNN; ++i) {
-        for (int k = 0; k < 3; ++k) {
-          colors[i][k] = double(source.getColor(indicesFwd[i])[k]);
+      bool isDone = false;
+      int nNN = index < nbrs.fwdNearestOnlyIdx ? nbrs.numFwd : 1;
+      while (nNN > 0 && !isDone) {
+        if (nNN == 1) {
+          refinedColors1[index] = source.getColor(nbrFwd[0].idx);
+          isDone = true;
+          break;
         }
-      }
-      double maxAttributeDist2 = std::numeric_limits<double>::min();
-      for (int i = 0; i < nNN; ++i) {
-        for (int j = 0; j < nNN; ++j) {
-          const double dist2 = (colors[i] - colors[j]).getNorm2<double>();
-          if (dist2 > maxAttributeDist2) {
-            maxAttributeDist2 = dist2;
+
+        colors.resize(nNN);
+        for (int i = 0; i < nNN; ++i) {
+          for (int k = 0; k < 3; ++k) {
+            colors[i][k] = double(source.getColor(nbrFwd[i].idx)[k]);
           }
         }
-      }
-      if (maxAttributeDist2 > maxAttributeDist2Fwd) {
-        --nNN;
-      } else {
-        Vec3<double> refinedColor(0.0);
-        if (params.useDistWeightedAvgFwd) {
-          double sumWeights{0.0};
-          for (int i = 0; i < nNN; ++i) {
-            const double weight = 1 / (sqrDistFwd[i] + params.distOffsetFwd);
-            for (int k = 0; k < 3; ++k) {
-              refinedColor[k] += source.getColor(indicesFwd[i])[k] * weight;
+        double maxAttributeDist2 = std::numeric_limits<double>::min();
+        for (int i = 0; i < nNN; ++i) {
+          for (int j = 0; j < nNN; ++j) {
+            const double dist2 = (colors[i] - colors[j]).getNorm2<double>();
+            if (dist2 > maxAttributeDist2) {
+              maxAttributeDist2 = dist2;
             }
-            sumWeights += weight;
           }
-          refinedColor /= sumWeights;
+        }
+        if (maxAttributeDist2 > maxAttributeDist2Fwd) {
+          --nNN;
         } else {
-          for (int i = 0; i < nNN; ++i) {
-            for (int k = 0; k < 3; ++k) {
-              refinedColor[k] += source.getColor(indicesFwd[i])[k];
+          Vec3<double> refinedColor(0.0);
+          if (params.useDistWeightedAvgFwd) {
+            double sumWeights{0.0};
+            for (int i = 0; i < nNN; ++i) {
+              const double weight =
+                1 / (nbrFwd[i].dist2 + params.distOffsetFwd);
+              for (int k = 0; k < 3; ++k) {
+                refinedColor[k] += source.getColor(nbrFwd[i].idx)[k] * weight;
+              }
+              sumWeights += weight;
             }
+            refinedColor /= sumWeights;
+          } else {
+            for (int i = 0; i < nNN; ++i) {
+              for (int k = 0; k < 3; ++k) {
+                refinedColor[k] += source.getColor(nbrFwd[i].idx)[k];
+              }
+            }
+            refinedColor /= nNN;
           }
-          refinedColor /= nNN;
-        }
-        for (int k = 0; k < 3; ++k) {
-          refinedColors1[index][k] =
-            attr_t(PCCClip(round(refinedColor[k]), 0.0, clipMax[k]));
+          for (int k = 0; k < 3; ++k) {
+            refinedColors1[index][k] =
+              attr_t(PCCClip(round(refinedColor[k]), 0.0, clipMax[k]));
+          }
+          isDone = true;
         }
-        isDone = true;
       }
     }
-  }
+  });
 
   // Backward direction
-  const size_t num_resultsBwd = params.numNeighboursBwd;
-  std::vector<size_t> indicesBwd(num_resultsBwd);
-  std::vector<double> sqrDistBwd(num_resultsBwd);
-  nanoflann::KNNResultSet<double> resultSetBwd(num_resultsBwd);
-
   struct DistColor {
     double dist;
     Vec3<attr_t> color;
   };
-  std::vector<std::vector<DistColor>> refinedColorsDists2;
-  refinedColorsDists2.resize(pointCountTarget);
 
-  for (size_t index = 0; index < pointCountSource; ++index) {
-    const Vec3<attr_t> color = source.getColor(index);
-    resultSetBwd.init(&indicesBwd[0], &sqrDistBwd[0]);
-
-    Vec3<double> posInTgt =
-      (source[index] - targetToSourceOffset) * sourceToTargetScaleFactor;
-
-    kdtreeTarget.index->findNeighbors(
-      resultSetBwd, &posInTgt[0], nanoflann::SearchParams(10));
-
-    for (int i = 0; i < num_resultsBwd; ++i) {
-      if (sqrDistBwd[i] <= maxGeometryDist2Bwd) {
-        refinedColorsDists2[indicesBwd[i]].push_back(
-          DistColor{sqrDistBwd[i], color});
-      }
-    }
-  }
-
-  for (size_t index = 0; index < pointCountTarget; ++index) {
-    std::sort(
-      refinedColorsDists2[index].begin(), refinedColorsDists2[index].end(),
-      [](DistColor& dc1, DistColor& dc2) { return dc1.dist < dc2.dist; });
-  }
-
-  for (size_t index = 0; index < pointCountTarget; ++index) {
-    const Vec3<attr_t> color1 = refinedColors1[index];
-    auto& colorsDists2 = refinedColorsDists2[index];
-    if (colorsDists2.empty()) {
-      target.setColor(index, color1);
-      continue;
-    }
-
-    bool isDone = false;
-    const Vec3<double> centroid1(color1[0], color1[1], color1[2]);
-    Vec3<double> centroid2(0.0);
-    if (params.skipAvgIfIdenticalSourcePointPresentBwd) {
-      if (colorsDists2[0].dist < 0.0001) {
-        auto temp = colorsDists2[0];
-        colorsDists2.clear();
-        colorsDists2.push_back(temp);
-        for (int k = 0; k < 3; ++k) {
-          centroid2[k] = colorsDists2[0].color[k];
-        }
-        isDone = true;
+  parallelFor(0, pointCountTarget, kRecolourMinGrain, [&](size_t b, size_t e) {
+    std::vector<DistColor> colorsDists2;
+    for (size_t index = b; index < e; ++index) {
+      const Vec3<attr_t> color1 = refinedColors1[index];
+      colorsDists2.clear();
+      for (auto i = nbrs.bwdStart[index]; i < nbrs.bwdStart[index + 1]; i++)
+        colorsDists2.push_back(
+          {nbrs.bwd[i].dist2, source.getColor(nbrs.bwd[i].idx)});
+
+      if (colorsDists2.empty()) {
+        target.setColor(index, color1);
+        continue;
       }
-    }
 
-    if (!isDone) {
-      int nNN = colorsDists2.size();
-      while (nNN > 0 && !isDone) {
-        nNN = colorsDists2.size();
-        if (nNN == 1) {
+      bool isDone = false;
+      const Vec3<double> centroid1(color1[0], color1[1], color1[2]);
+      Vec3<double> centroid2(0.0);
+      if (params.skipAvgIfIdenticalSourcePointPresentBwd) {
+        if (colorsDists2[0].dist < 0.0001) {
           auto temp = colorsDists2[0];
           colorsDists2.clear();
           colorsDists2.push_back(temp);
@@ -390,139 +556,159 @@ recolourColour(
           }
           isDone = true;
         }
-        if (!isDone) {
-          std::vector<Vec3<double>> colors;
-          colors.resize(0);
-          colors.resize(nNN);
-          for (int i = 0; i < nNN; ++i) {
+      }
+
+      if (!isDone) {
+        int nNN = colorsDists2.size();
+        while (nNN > 0 && !isDone) {
+          nNN = colorsDists2.size();
+          if (nNN == 1) {
+            auto temp = colorsDists2[0];
+            colorsDists2.clear();
+            colorsDists2.push_back(temp);
             for (int k = 0; k < 3; ++k) {
-              colors[i][k] = double(colorsDists2[i].color[k]);
+              centroid2[k] = colorsDists2[0].color[k];
             }
+            isDone = true;
           }
-          double maxAttributeDist2 = std::numeric_limits<double>::min();
-          for (int i = 0; i < nNN; ++i) {
-            for (int j = 0; j < nNN; ++j) {
-              const double dist2 = (colors[i] - colors[j]).getNorm2<double>();
-              if (dist2 > maxAttributeDist2) {
-                maxAttributeDist2 = dist2;
+          if (!isDone) {
+            std::vector<Vec3<double>> colors;
+            colors.resize(0);
+            colors.resize(nNN);
+            for (int i = 0; i < nNN; ++i) {
+              for (int k = 0; k < 3; ++k) {
+                colors[i][k] = double(colorsDists2[i].color[k]);
               }
             }
-          }
-          if (maxAttributeDist2 <= maxAttributeDist2Bwd) {
-            for (size_t k = 0; k < 3; ++k) {
-              centroid2[k] = 0;
-            }
-            if (params.useDistWeightedAvgBwd) {
-              double sumWeights{0.0};
-              for (int i = 0; i < colorsDists2.size(); ++i) {
-                const double weight =
-                  1 / (sqrt(colorsDists2[i].dist) + params.distOffsetBwd);
-                for (size_t k = 0; k < 3; ++k) {
-                  centroid2[k] += (colorsDists2[i].color[k] * weight);
+            double maxAttributeDist2 = std::numeric_limits<double>::min();
+            for (int i = 0; i < nNN; ++i) {
+              for (int j = 0; j < nNN; ++j) {
+                const double dist2 =
+                  (colors[i] - colors[j]).getNorm2<double>();
+                if (dist2 > maxAttributeDist2) {
+                  maxAttributeDist2 = dist2;
                 }
-                sumWeights += weight;
               }
-              centroid2 /= sumWeights;
-            } else {
-              for (auto& coldist : colorsDists2) {
-                for (int k = 0; k < 3; ++k) {
-                  centroid2[k] += coldist.color[k];
+            }
+            if (maxAttributeDist2 <= maxAttributeDist2Bwd) {
+              for (size_t k = 0; k < 3; ++k) {
+                centroid2[k] = 0;
+              }
+              if (params.useDistWeightedAvgBwd) {
+                double sumWeights{0.0};
+                for (int i = 0; i < colorsDists2.size(); ++i) {
+                  const double weight =
+                    1 / (sqrt(colorsDists2[i].dist) + params.distOffsetBwd);
+                  for (size_t k = 0; k < 3; ++k) {
+                    centroid2[k] += (colorsDists2[i].color[k] * weight);
+                  }
+                  sumWeights += weight;
                 }
+                centroid2 /= sumWeights;
+              } else {
+                for (auto& coldist : colorsDists2) {
+                  for (int k = 0; k < 3; ++k) {
+                    centroid2[k] += coldist.color[k];
+                  }
+                }
+                centroid2 /= colorsDists2.size();
               }
-              centroid2 /= colorsDists2.size();
+              isDone = true;
+            } else {
+              colorsDists2.pop_back();
             }
-            isDone = true;
-          } else {
-            colorsDists2.pop_back();
           }
         }
       }
-    }
-    double H = double(colorsDists2.size());
-    double D2 = 0.0;
-    for (const auto color2dist : colorsDists2) {
-      auto color2 = color2dist.color;
-      for (size_t k = 0; k < 3; ++k) {
-        const double d2 = centroid2[k] - color2[k];
-        D2 += d2 * d2;
-      }
-    }
-    const double r = double(pointCountTarget) / double(pointCountSource);
-    const double delta2 = (centroid2 - centroid1).getNorm2<double>();
-    const double eps = 0.000001;
-
-    const bool fixWeight = 1;  // m42538
-    if (!(fixWeight || delta2 > eps)) {
-      // centroid2 == centroid1
-      target.setColor(index, color1);
-    } else {
-      // centroid2 != centroid1
-      double w = 0.0;
-
-      if (!fixWeight) {
-        const double alpha = D2 / delta2;
-        const double a = H * r - 1.0;
-        const double c = alpha * r - 1.0;
-        if (fabs(a) < eps) {
-          w = -0.5 * c;
-        } else {
-          const double delta = 1.0 - a * c;
-          if (delta >= 0.0) {
-            w = (-1.0 + sqrt(delta)) / a;
-          }
+      double H = double(colorsDists2.size());
+      double D2 = 0.0;
+      for (const auto color2dist : colorsDists2) {
+        auto color2 = color2dist.color;
+        for (size_t k = 0; k < 3; ++k) {
+          const double d2 = centroid2[k] - color2[k];
+          D2 += d2 * d2;
         }
       }
-      const double oneMinusW = 1.0 - w;
-      Vec3<double> color0;
-      for (size_t k = 0; k < 3; ++k) {
-        color0[k] = PCCClip(
-          round(w * centroid1[k] + oneMinusW * centroid2[k]), 0.0, clipMax[k]);
-      }
-      const double rSource = 1.0 / double(pointCountSource);
-      const double rTarget = 1.0 / double(pointCountTarget);
-      double minError = std::numeric_limits<double>::max();
-      Vec3<double> bestColor(color0);
-      Vec3<double> color;
-      for (int32_t s1 = -params.searchRange; s1 <= params.searchRange; ++s1) {
-        color[0] = PCCClip(color0[0] + s1, 0.0, clipMax[0]);
-        for (int32_t s2 = -params.searchRange; s2 <= params.searchRange;
-             ++s2) {
-          color[1] = PCCClip(color0[1] + s2, 0.0, clipMax[1]);
-          for (int32_t s3 = -params.searchRange; s3 <= params.searchRange;
-               ++s3) {
-            color[2] = PCCClip(color0[2] + s3, 0.0, clipMax[2]);
-
-            double e1 = 0.0;
-            for (size_t k = 0; k < 3; ++k) {
-              const double d = color[k] - color1[k];
-              e1 += d * d;
+      const double r = double(pointCountTarget) / double(pointCountSource);
+      const double delta2 = (centroid2 - centroid1).getNorm2<double>();
+      const double eps = 0.000001;
+
+      const bool fixWeight = 1;  // m42538
+      if (!(fixWeight || delta2 > eps)) {
+        // centroid2 == centroid1
+        target.setColor(index, color1);
+      } else {
+        // centroid2 != centroid1
+        double w = 0.0;
+
+        if (!fixWeight) {
+          const double alpha = D2 / delta2;
+          const double a = H * r - 1.0;
+          const double c = alpha * r - 1.0;
+          if (fabs(a) < eps) {
+            w = -0.5 * c;
+          } else {
+            const double delta = 1.0 - a * c;
+            if (delta >= 0.0) {
+              w = (-1.0 + sqrt(delta)) / a;
             }
-            e1 *= rTarget;
-
-            double e2 = 0.0;
-            for (const auto color2dist : colorsDists2) {
-              auto color2 = color2dist.color;
+          }
+        }
+        const double oneMinusW = 1.0 - w;
+        Vec3<double> color0;
+        for (size_t k = 0; k < 3; ++k) {
+          color0[k] = PCCClip(
+            round(w * centroid1[k] + oneMinusW * centroid2[k]), 0.0,
+            clipMax[k]);
+        }
+        const double rSource = 1.0 / double(pointCountSource);
+        const double rTarget = 1.0 / double(pointCountTarget);
+        double minError = std::numeric_limits<double>::max();
+        Vec3<double> bestColor(color0);
+        Vec3<double> color;
+        for (int32_t s1 = -params.searchRange; s1 <= params.searchRange;
+             ++s1) {
+          color[0] = PCCClip(color0[0] + s1, 0.0, clipMax[0]);
+          for (int32_t s2 = -params.searchRange; s2 <= params.searchRange;
+               ++s2) {
+            color[1] = PCCClip(color0[1] + s2, 0.0, clipMax[1]);
+            for (int32_t s3 = -params.searchRange; s3 <= params.searchRange;
+                 ++s3) {
+              color[2] = PCCClip(color0[2] + s3, 0.0, clipMax[2]);
+
+              double e1 = 0.0;
               for (size_t k = 0; k < 3; ++k) {
-                const double d = color[k] - color2[k];
-                e2 += d * d;
+                const double d = color[k] - color1[k];
+                e1 += d * d;
               }
-            }
-            e2 *= rSource;
+              e1 *= rTarget;
 
-            const double error = std::max(e1, e2);
-            if (error < minError) {
-              minError = error;
-              bestColor = color;
+              double e2 = 0.0;
+              for (const auto color2dist : colorsDists2) {
+                auto color2 = color2dist.color;
+                for (size_t k = 0; k < 3; ++k) {
+                  const double d = color[k] - color2[k];
+                  e2 += d * d;
+                }
+              }
+              e2 *= rSource;
+
+              const double error = std::max(e1, e2);
+              if (error < minError) {
+                minError = error;
+                bestColor = color;
+              }
             }
           }
         }
+        target.setColor(
+          index,
+          Vec3<attr_t>(
+            attr_t(bestColor[0]), attr_t(bestColor[1]), attr_t(bestColor[2])));
       }
-      target.setColor(
-        index,
-        Vec3<attr_t>(
-          attr_t(bestColor[0]), attr_t(bestColor[1]), attr_t(bestColor[2])));
     }
-  }
+  });
+
   return true;
 }
 
@@ -552,33 +738,20 @@ recolourReflectance(
   const AttributeDescription& attrDesc,
   const RecolourParams& cfg,
   const PCCPointSet3& source,
-  double sourceToTargetScaleFactor,
-  Vec3<double> targetToSourceOffset,
+  const RecolourNeighbours& nbrs,
   PCCPointSet3& target)
 {
-  double targetToSourceScaleFactor = 1.0 / sourceToTargetScaleFactor;
-
   const size_t pointCountSource = source.getPointCount();
   const size_t pointCountTarget = target.getPointCount();
   if (!pointCountSource || !pointCountTarget || !source.hasReflectances()) {
     return false;
   }
-  KDTreeVectorOfVectorsAdaptor<PCCPointSet3, double> kdtreeTarget(
-    3, target, 10);
-  KDTreeVectorOfVectorsAdaptor<PCCPointSet3, double> kdtreeSource(
-    3, source, 10);
   target.addReflectances();
   std::vector<attr_t> refinedReflectances1;
   refinedReflectances1.resize(pointCountTarget);
 
   double clipMax = (1 << attrDesc.attr_bitdepth) - 1;
 
-  double maxGeometryDist2Fwd = (cfg.maxGeometryDist2Fwd < 512)
-    ? cfg.maxGeometryDist2Fwd
-    : std::numeric_limits<double>::max();
-  double maxGeometryDist2Bwd = (cfg.maxGeometryDist2Bwd < 512)
-    ? cfg.maxGeometryDist2Bwd
-    : std::numeric_limits<double>::max();
   double maxAttributeDist2Fwd = (cfg.maxAttributeDist2Fwd < 512)
     ? cfg.maxAttributeDist2Fwd
     : std::numeric_limits<double>::max();
@@ -587,264 +760,215 @@ recolourReflectance(
     : std::numeric_limits<double>::max();
 
   // Forward direction
-  const int num_resultsFwd = cfg.numNeighboursFwd;
-  nanoflann::KNNResultSet<double> resultSetFwd(num_resultsFwd);
-  std::vector<size_t> indicesFwd(num_resultsFwd);
-  std::vector<double> sqrDistFwd(num_resultsFwd);
-  for (size_t index = 0; index < pointCountTarget; ++index) {
-    resultSetFwd.init(&indicesFwd[0], &sqrDistFwd[0]);
-
-    Vec3<double> posInSrc =
-      target[index] * targetToSourceScaleFactor + targetToSourceOffset;
-
-    kdtreeSource.index->findNeighbors(
-      resultSetFwd, &posInSrc[0], nanoflann::SearchParams(10));
-
-    while (1) {
-      if (indicesFwd.size() == 1)
-        break;
-
-      if (sqrDistFwd[int(resultSetFwd.size()) - 1] <= maxGeometryDist2Fwd)
-        break;
-
-      sqrDistFwd.pop_back();
-      indicesFwd.pop_back();
-    }
-
-    bool isDone = false;
-    if (cfg.skipAvgIfIdenticalSourcePointPresentFwd) {
-      if (sqrDistFwd[0] < 0.0001) {
-        refinedReflectances1[index] = source.getReflectance(indicesFwd[0]);
-        isDone = true;
+  parallelFor(0, pointCountTarget, kRecolourMinGrain, [&](size_t b, size_t e) {
+    std::vector<attr_t> reflectances;
+    for (size_t index = b; index < e; ++index) {
+      const auto* nbrFwd = &nbrs.fwd[index * nbrs.numFwd];
+
+      if (cfg.skipAvgIfIdenticalSourcePointPresentFwd) {
+        if (nbrFwd[0].dist2 < 0.0001) {
+          refinedReflectances1[index] = source.getReflectance(nbrFwd[0].idx);
+          continue;
+        }
       }
-    }
 
-    if (isDone)
-      continue;
-
-    int nNN = indicesFwd.size();
-    while (nNN > 0 && !isDone) {
-      if (nNN == 1) {
-        refinedReflectances1[index] = source.getReflectance(indicesFwd[0]);
-        isDone = true;
-        continue;
-      }
+      bool isDone = false;
+      int nNN = index < nbrs.fwdNearestOnlyIdx ? nbrs.numFwd : 1;
+      while (nNN > 0 && !isDone) {
+        if (nNN == 1) {
+          refinedReflectances1[index] = source.getReflectance(nbrFwd[0].idx);
+          isDone = true;
+          continue;
+        }
 
-      std::vector<attr_t> reflectances;
-      reflectances.resize(0);
-      reflectances.resize(nNN);
-      for (int i = 0; i < nNN; ++i) {
-        reflectances[i] = double(source.getReflectance(indicesFwd[i]));
-      }
-      double maxAttributeDist2 = std::numeric_limits<double>::min();
-      for (int i = 0; i < nNN; ++i) {
-        for (int j = 0; j < nNN; ++j) {
-          const double dist2 = pow(reflectances[i] - reflectances[j], 2);
-          if (dist2 > maxAttributeDist2)
-            maxAttributeDist2 = dist2;
+        reflectances.resize(nNN);
+        for (int i = 0; i < nNN; ++i) {
+          reflectances[i] = double(source.getReflectance(nbrFwd[i].idx));
         }
-      }
-      if (maxAttributeDist2 > maxAttributeDist2Fwd) {
-        --nNN;
-      } else {
-        double refinedReflectance = 0.0;
-        if (cfg.useDistWeightedAvgFwd) {
-          double sumWeights{0.0};
-          for (int i = 0; i < nNN; ++i) {
-            const double weight = 1 / (sqrDistFwd[i] + cfg.distOffsetFwd);
-            refinedReflectance +=
-              source.getReflectance(indicesFwd[i]) * weight;
-            sumWeights += weight;
+        double maxAttributeDist2 = std::numeric_limits<double>::min();
+        for (int i = 0; i < nNN; ++i) {
+          for (int j = 0; j < nNN; ++j) {
+            const double dist2 = pow(reflectances[i] - reflectances[j], 2);
+            if (dist2 > maxAttributeDist2)
+              maxAttributeDist2 = dist2;
           }
-          refinedReflectance /= sumWeights;
+        }
+        if (maxAttributeDist2 > maxAttributeDist2Fwd) {
+          --nNN;
         } else {
-          for (int i = 0; i < nNN; ++i)
-            refinedReflectance += source.getReflectance(indicesFwd[i]);
-          refinedReflectance /= nNN;
+          double refinedReflectance = 0.0;
+          if (cfg.useDistWeightedAvgFwd) {
+            double sumWeights{0.0};
+            for (int i = 0; i < nNN; ++i) {
+              const double weight = 1 / (nbrFwd[i].dist2 + cfg.distOffsetFwd);
+              refinedReflectance +=
+                source.getReflectance(nbrFwd[i].idx) * weight;
+              sumWeights += weight;
+            }
+            refinedReflectance /= sumWeights;
+          } else {
+            for (int i = 0; i < nNN; ++i)
+              refinedReflectance += source.getReflectance(nbrFwd[i].idx);
+            refinedReflectance /= nNN;
+          }
+          refinedReflectances1[index] =
+            attr_t(PCCClip(round(refinedReflectance), 0.0, clipMax));
+          isDone = true;
         }
-        refinedReflectances1[index] =
-          attr_t(PCCClip(round(refinedReflectance), 0.0, clipMax));
-        isDone = true;
       }
     }
-  }
+  });
 
   // Backward direction
-  const size_t num_resultsBwd = cfg.numNeighboursBwd;
-  std::vector<size_t> indicesBwd(num_resultsBwd);
-  std::vector<double> sqrDistBwd(num_resultsBwd);
-  nanoflann::KNNResultSet<double> resultSetBwd(num_resultsBwd);
-
   struct DistReflectance {
     double dist;
     attr_t reflectance;
   };
-  std::vector<std::vector<DistReflectance>> refinedReflectancesDists2;
-  refinedReflectancesDists2.resize(pointCountTarget);
-
-  for (size_t index = 0; index < pointCountSource; ++index) {
-    const attr_t reflectance = source.getReflectance(index);
-    resultSetBwd.init(&indicesBwd[0], &sqrDistBwd[0]);
-
-    Vec3<double> posInTgt =
-      (source[index] - targetToSourceOffset) * sourceToTargetScaleFactor;
 
-    kdtreeTarget.index->findNeighbors(
-      resultSetBwd, &posInTgt[0], nanoflann::SearchParams(10));
-
-    for (int i = 0; i < num_resultsBwd; ++i) {
-      if (sqrDistBwd[i] <= maxGeometryDist2Bwd) {
-        refinedReflectancesDists2[indicesBwd[i]].push_back(
-          DistReflectance{sqrDistBwd[i], reflectance});
+  parallelFor(0, pointCountTarget, kRecolourMinGrain, [&](size_t b, size_t e) {
+    std::vector<DistReflectance> reflectancesDists2;
+    for (size_t index = b; index < e; ++index) {
+      const attr_t reflectance1 = refinedReflectances1[index];
+      reflectancesDists2.clear();
+      for (auto i = nbrs.bwdStart[index]; i < nbrs.bwdStart[index + 1]; i++)
+        reflectancesDists2.push_back(
+          {nbrs.bwd[i].dist2, source.getReflectance(nbrs.bwd[i].idx)});
+
+      if (reflectancesDists2.empty()) {
+        target.setReflectance(index, reflectance1);
+        continue;
       }
-    }
-  }
 
-  for (size_t index = 0; index < pointCountTarget; ++index) {
-    std::sort(
-      refinedReflectancesDists2[index].begin(),
-      refinedReflectancesDists2[index].end(),
-      [](DistReflectance& dc1, DistReflectance& dc2) {
-        return dc1.dist < dc2.dist;
-      });
-  }
-
-  for (size_t index = 0; index < pointCountTarget; ++index) {
-    const attr_t reflectance1 = refinedReflectances1[index];
-    auto& reflectancesDists2 = refinedReflectancesDists2[index];
-    if (reflectancesDists2.empty()) {
-      target.setReflectance(index, reflectance1);
-      continue;
-    }
-
-    bool isDone = false;
-    const double centroid1 = reflectance1;
-    double centroid2 = 0.0;
-    if (cfg.skipAvgIfIdenticalSourcePointPresentBwd) {
-      if (reflectancesDists2[0].dist < 0.0001) {
-        auto temp = reflectancesDists2[0];
-        reflectancesDists2.clear();
-        reflectancesDists2.push_back(temp);
-        centroid2 = reflectancesDists2[0].reflectance;
-        isDone = true;
-      }
-    }
-    if (!isDone) {
-      int nNN = reflectancesDists2.size();
-      while (nNN > 0 && !isDone) {
-        nNN = reflectancesDists2.size();
-        if (nNN == 1) {
+      bool isDone = false;
+      const double centroid1 = reflectance1;
+      double centroid2 = 0.0;
+      if (cfg.skipAvgIfIdenticalSourcePointPresentBwd) {
+        if (reflectancesDists2[0].dist < 0.0001) {
           auto temp = reflectancesDists2[0];
           reflectancesDists2.clear();
           reflectancesDists2.push_back(temp);
           centroid2 = reflectancesDists2[0].reflectance;
           isDone = true;
         }
-        if (!isDone) {
-          std::vector<double> reflectances;
-          reflectances.resize(0);
-          reflectances.resize(nNN);
-          for (int i = 0; i < nNN; ++i) {
-            reflectances[i] = double(reflectancesDists2[i].reflectance);
+      }
+      if (!isDone) {
+        int nNN = reflectancesDists2.size();
+        while (nNN > 0 && !isDone) {
+          nNN = reflectancesDists2.size();
+          if (nNN == 1) {
+            auto temp = reflectancesDists2[0];
+            reflectancesDists2.clear();
+            reflectancesDists2.push_back(temp);
+            centroid2 = reflectancesDists2[0].reflectance;
+            isDone = true;
           }
-          double maxAttributeDist2 = std::numeric_limits<double>::min();
-          for (int i = 0; i < nNN; ++i) {
-            for (int j = 0; j < nNN; ++j) {
-              const double dist2 = pow(reflectances[i] - reflectances[j], 2);
-              if (dist2 > maxAttributeDist2) {
-                maxAttributeDist2 = dist2;
+          if (!isDone) {
+            std::vector<double> reflectances;
+            reflectances.resize(0);
+            reflectances.resize(nNN);
+            for (int i = 0; i < nNN; ++i) {
+              reflectances[i] = double(reflectancesDists2[i].reflectance);
+            }
+            double maxAttributeDist2 = std::numeric_limits<double>::min();
+            for (int i = 0; i < nNN; ++i) {
+              for (int j = 0; j < nNN; ++j) {
+                const double dist2 = pow(reflectances[i] - reflectances[j], 2);
+                if (dist2 > maxAttributeDist2) {
+                  maxAttributeDist2 = dist2;
+                }
               }
             }
-          }
-          if (maxAttributeDist2 <= maxAttributeDist2Bwd) {
-            centroid2 = 0;
-            if (cfg.useDistWeightedAvgBwd) {
-              double sumWeights{0.0};
-              for (int i = 0; i < reflectancesDists2.size(); ++i) {
-                const double weight =
-                  1 / (sqrt(reflectancesDists2[i].dist) + cfg.distOffsetBwd);
-                centroid2 += (reflectancesDists2[i].reflectance * weight);
-                sumWeights += weight;
+            if (maxAttributeDist2 <= maxAttributeDist2Bwd) {
+              centroid2 = 0;
+              if (cfg.useDistWeightedAvgBwd) {
+                double sumWeights{0.0};
+                for (int i = 0; i < reflectancesDists2.size(); ++i) {
+                  const double weight =
+                    1 / (sqrt(reflectancesDists2[i].dist) + cfg.distOffsetBwd);
+                  centroid2 += (reflectancesDists2[i].reflectance * weight);
+                  sumWeights += weight;
+                }
+                centroid2 /= sumWeights;
+              } else {
+                for (auto& refdist : reflectancesDists2) {
+                  centroid2 += refdist.reflectance;
+                }
+                centroid2 /= reflectancesDists2.size();
               }
-              centroid2 /= sumWeights;
+              isDone = true;
             } else {
-              for (auto& refdist : reflectancesDists2) {
-                centroid2 += refdist.reflectance;
-              }
-              centroid2 /= reflectancesDists2.size();
+              reflectancesDists2.pop_back();
             }
-            isDone = true;
-          } else {
-            reflectancesDists2.pop_back();
           }
         }
       }
-    }
-    double H = double(reflectancesDists2.size());
-    double D2 = 0.0;
-    for (const auto reflectance2dist : reflectancesDists2) {
-      auto reflectance2 = reflectance2dist.reflectance;
-      const double d2 = centroid2 - reflectance2;
-      D2 += d2 * d2;
-    }
-    const double r = double(pointCountTarget) / double(pointCountSource);
-    const double delta2 = pow(centroid2 - centroid1, 2);
-    const double eps = 0.000001;
-
-    const bool fixWeight = 1;  // m42538
-    if (!(fixWeight || delta2 > eps)) {
-      // centroid2 == centroid1
-      target.setReflectance(index, reflectance1);
-    } else {
-      // centroid2 != centroid1
-      double w = 0.0;
-
-      if (!fixWeight) {
-        const double alpha = D2 / delta2;
-        const double a = H * r - 1.0;
-        const double c = alpha * r - 1.0;
-        if (fabs(a) < eps) {
-          w = -0.5 * c;
-        } else {
-          const double delta = 1.0 - a * c;
-          if (delta >= 0.0) {
-            w = (-1.0 + sqrt(delta)) / a;
-          }
-        }
+      double H = double(reflectancesDists2.size());
+      double D2 = 0.0;
+      for (const auto reflectance2dist : reflectancesDists2) {
+        auto reflectance2 = reflectance2dist.reflectance;
+        const double d2 = centroid2 - reflectance2;
+        D2 += d2 * d2;
       }
-      const double oneMinusW = 1.0 - w;
-      double reflectance0;
-      reflectance0 =
-        PCCClip(round(w * centroid1 + oneMinusW * centroid2), 0.0, clipMax);
-      const double rSource = 1.0 / double(pointCountSource);
-      const double rTarget = 1.0 / double(pointCountTarget);
-      double minError = std::numeric_limits<double>::max();
-      double bestReflectance = reflectance0;
-      double reflectance;
-      for (int32_t s1 = -cfg.searchRange; s1 <= cfg.searchRange; ++s1) {
-        reflectance = PCCClip(reflectance0 + s1, 0.0, clipMax);
-        double e1 = 0.0;
-        const double d = reflectance - reflectance1;
-        e1 += d * d;
-        e1 *= rTarget;
-
-        double e2 = 0.0;
-        for (const auto reflectance2dist : reflectancesDists2) {
-          auto reflectance2 = reflectance2dist.reflectance;
-          const double d = reflectance - reflectance2;
-          e2 += d * d;
+      const double r = double(pointCountTarget) / double(pointCountSource);
+      const double delta2 = pow(centroid2 - centroid1, 2);
+      const double eps = 0.000001;
+
+      const bool fixWeight = 1;  // m42538
+      if (!(fixWeight || delta2 > eps)) {
+        // centroid2 == centroid1
+        target.setReflectance(index, reflectance1);
+      } else {
+        // centroid2 != centroid1
+        double w = 0.0;
+
+        if (!fixWeight) {
+          const double alpha = D2 / delta2;
+          const double a = H * r - 1.0;
+          const double c = alpha * r - 1.0;
+          if (fabs(a) < eps) {
+            w = -0.5 * c;
+          } else {
+            const double delta = 1.0 - a * c;
+            if (delta >= 0.0) {
+              w = (-1.0 + sqrt(delta)) / a;
+            }
+          }
         }
-        e2 *= rSource;
+        const double oneMinusW = 1.0 - w;
+        double reflectance0;
+        reflectance0 =
+          PCCClip(round(w * centroid1 + oneMinusW * centroid2), 0.0, clipMax);
+        const double rSource = 1.0 / double(pointCountSource);
+        const double rTarget = 1.0 / double(pointCountTarget);
+        double minError = std::numeric_limits<double>::max();
+        double bestReflectance = reflectance0;
+        double reflectance;
+        for (int32_t s1 = -cfg.searchRange; s1 <= cfg.searchRange; ++s1) {
+          reflectance = PCCClip(reflectance0 + s1, 0.0, clipMax);
+          double e1 = 0.0;
+          const double d = reflectance - reflectance1;
+          e1 += d * d;
+          e1 *= rTarget;
+
+          double e2 = 0.0;
+          for (const auto reflectance2dist : reflectancesDists2) {
+            auto reflectance2 = reflectance2dist.reflectance;
+            const double d = reflectance - reflectance2;
+            e2 += d * d;
+          }
+          e2 *= rSource;
 
-        const double error = std::max(e1, e2);
-        if (error < minError) {
-          minError = error;
-          bestReflectance = reflectance;
+          const double error = std::max(e1, e2);
+          if (error < minError) {
+            minError = error;
+            bestReflectance = reflectance;
+          }
         }
+        target.setReflectance(index, attr_t(bestReflectance));
       }
-      target.setReflectance(index, attr_t(bestReflectance));
     }
-  }
+  });
+
   return true;
 }
 
@@ -858,7 +982,7 @@ recolourReflectance(
 
 int
 recolour(
-  const AttributeDescription& desc,
+  const std::vector<AttributeDescription>& descs,
   const RecolourParams& cfg,
   const PCCPointSet3& source,
   float sourceToTargetScaleFactor,
@@ -866,30 +990,37 @@ recolour(
   Vec3<int> offset,
   PCCPointSet3* target)
 {
+  if (descs.empty())
+    return 0;
+
   Vec3<double> combinedOffset;
   for (int k = 0; k < 3; k++)
     combinedOffset[k] =
       targetToSourceOffset[k] + double(offset[k]) / sourceToTargetScaleFactor;
 
-  // todo(df): fix the incorrect assumption here that 3-component
-  // attributes are colour (and that single components are reflectance)
-  if (desc.attributeLabel == KnownAttributeLabel::kColour) {
-    bool ok = recolourColour(
-      desc, cfg, source, sourceToTargetScaleFactor, combinedOffset, *target);
+  // The neighbourhoods are common to all attributes
+  RecolourNeighbours nbrs = findRecolourNeighbours(
+    cfg, source, sourceToTargetScaleFactor, combinedOffset, *target);
+
+  for (const auto& desc : descs) {
+    // todo(df): fix the incorrect assumption here that 3-component
+    // attributes are colour (and that single components are reflectance)
+    if (desc.attributeLabel == KnownAttributeLabel::kColour) {
+      bool ok = recolourColour(desc, cfg, source, nbrs, *target);
 
-    if (!ok) {
-      std::cout << "Error: can't transfer colors!" << std::endl;
-      return -1;
+      if (!ok) {
+        std::cout << "Error: can't transfer colors!" << std::endl;
+        return -1;
+      }
     }
-  }
 
-  if (desc.attributeLabel == KnownAttributeLabel::kReflectance) {
-    bool ok = recolourReflectance(
-      desc, cfg, source, sourceToTargetScaleFactor, combinedOffset, *target);
+    if (desc.attributeLabel == KnownAttributeLabel::kReflectance) {
+      bool ok = recolourReflectance(desc, cfg, source, nbrs, *target);
 
-    if (!ok) {
-      std::cout << "Error: can't transfer reflectance!" << std::endl;
-      return -1;
+      if (!ok) {
+        std::cout << "Error: can't transfer reflectance!" << std::endl;
+        return -1;
+      }
     }
   }
 
@@ -898,6 +1029,92 @@ recolour(
 
 //============================================================================
 
+bool
+recolourExact(
+  const std::vector<AttributeDescription>& descs,
+  const PCCPointSet3& source,
+  Vec3<int> targetToSourceOffset,
+  Vec3<int> offset,
+  PCCPointSet3* target)
+{
+  const size_t pointCountSource = source.getPointCount();
+  const size_t pointCountTarget = target->getPointCount();
+  if (!pointCountSource || !pointCountTarget)
+    return false;
+
+  bool hasColour = false;
+  bool hasReflectance = false;
+  for (const auto& desc : descs) {
+    hasColour |= desc.attributeLabel == KnownAttributeLabel::kColour;
+    hasReflectance |= desc.attributeLabel == KnownAttributeLabel::kReflectance;
+  }
+
+  if ((hasColour && !source.hasColors())
+      || (hasReflectance && !source.hasReflectances()))
+    return false;
+
+  // The target points in position order permit the co-located target point
+  // of each source point to be found.
+  std::vector<std::pair<point_t, uint32_t>> targetPos(pointCountTarget);
+  for (size_t i = 0; i < pointCountTarget; i++)
+    targetPos[i] = {(*target)[i], uint32_t(i)};
+  std::sort(targetPos.begin(), targetPos.end());
+
+  // Accumulate the attributes of the co-located source points
+  std::vector<uint32_t> counts(pointCountTarget);
+  std::vector<Vec3<int64_t>> sumColour(hasColour ? pointCountTarget : 0);
+  std::vector<int64_t> sumRefl(hasReflectance ? pointCountTarget : 0);
+
+  const point_t sourceOffset = targetToSourceOffset + offset;
+  for (size_t i = 0; i < pointCountSource; i++) {
+    const point_t pos = source[i] - sourceOffset;
+    auto it = std::lower_bound(
+      targetPos.begin(), targetPos.end(), std::make_pair(pos, uint32_t(0)));
+
+    if (it == targetPos.end() || it->first != pos)
+      return false;
+
+    const uint32_t idx = it->second;
+    counts[idx]++;
+
+    if (hasColour) {
+      const auto colour = source.getColor(i);
+      for (int k = 0; k < 3; k++)
+        sumColour[idx][k] += colour[k];
+    }
+
+    if (hasReflectance)
+      sumRefl[idx] += source.getReflectance(i);
+  }
+
+  for (auto count : counts) {
+    if (!count)
+      return false;
+  }
+
+  // Assign the mean attributes, rounding to nearest
+  if (hasColour) {
+    target->addColors();
+    for (size_t i = 0; i < pointCountTarget; i++) {
+      Vec3<attr_t> colour;
+      for (int k = 0; k < 3; k++)
+        colour[k] = attr_t((sumColour[i][k] + counts[i] / 2) / counts[i]);
+      target->setColor(i, colour);
+    }
+  }
+
+  if (hasReflectance) {
+    target->addReflectances();
+    for (size_t i = 0; i < pointCountTarget; i++)
+      target->setReflectance(
+        i, attr_t((sumRefl[i] + counts[i] / 2) / counts[i]));
+  }
+
+  return true;
+}
+
+//============================================================================
+
 void
 convertGbrToYCgCoR(int bitDepth, PCCPointSet3& cloud)
 {
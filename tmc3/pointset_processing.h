@@ -35,7 +35,9 @@
 
 #pragma once
 
+#include <cstdint>
 #include <map>
+#include <vector>
 
 #include "PCCPointSet.h"
 #include "hls.h"
@@ -69,9 +71,11 @@ struct RecolourParams {
 //
 // The destination and source point clouds may be the same object.
 //
+// Returns the bounding box of the quantised points.
+//
 // NB: attributes are not processed.
 
-void quantizePositionsUniq(
+Box3<int32_t> quantizePositionsUniq(
   const float scaleFactor,
   const Vec3<int> offset,
   const Box3<int> clamp,
@@ -85,21 +89,85 @@ void quantizePositionsUniq(
 // by a multiplicitive @scaleFactor with rounding.
 //
 // The destination and source point clouds may be the same object.
+// Returns the bounding box of the quantised points.
 //
 // NB: attributes are preserved
 
-void quantizePositions(
+Box3<int32_t> quantizePositions(
   const float scaleFactor,
   const Vec3<int> offset,
   const Box3<int> clamp,
   const PCCPointSet3& src,
   PCCPointSet3* dst);
 
+//============================================================================
+// Translate the positions of each point in @cloud by -@offset, returning
+// the bounding box of the result.
+
+Box3<int32_t> translatePositions(const Vec3<int> offset, PCCPointSet3* cloud);
+
+//============================================================================
+// Partition the points of a merged multi-frame @cloud into @frames according
+// to the frame index of each point.  The frame with index i is stored in
+// (*frames)[i]; frames without points are empty.  The partitioned frames
+// have no frame index attribute.
+
+void splitFrames(const PCCPointSet3& cloud, std::vector<PCCPointSet3>* frames);
+
+//============================================================================
+// Append the points of @frame to @merged, setting their frame index to
+// @frameIdx.
+
+void
+appendFrame(const PCCPointSet3& frame, int frameIdx, PCCPointSet3* merged);
+
 //============================================================================
 // Clamp point co-ordinates in @cloud to @bbox, preserving attributes.
 
 void clampVolume(Box3<int32_t> bbox, PCCPointSet3* cloud);
 
+//============================================================================
+// The nearest neighbour relationships between the points of a target point
+// cloud and a source/reference point cloud used by recolouring.  These are
+// independent of the attribute being recoloured.
+
+struct RecolourNeighbours {
+  struct Neighbour {
+    double dist2;
+    uint32_t idx;
+  };
+
+  // Forward direction: for each target point, the numFwd nearest source
+  // points in order of increasing distance.
+  int numFwd;
+  std::vector<Neighbour> fwd;
+
+  // Target points from this index onwards only use their nearest forward
+  // neighbour.
+  size_t fwdNearestOnlyIdx;
+
+  // Backward direction: for each target point i, the source points that
+  // have i amongst their numNeighboursBwd nearest target points, ordered by
+  // distance, in bwd[bwdStart[i] .. bwdStart[i + 1]).
+  std::vector<uint32_t> bwdStart;
+  std::vector<Neighbour> bwd;
+};
+
+//----------------------------------------------------------------------------
+// Find the forward and backward neighbours used to recolour target from
+// source.
+//
+// Differences in the scale and translation of the target and source point
+// clouds, is handled according to:
+//    posInTgt = (posInSrc - targetToSourceOffset) * sourceToTargetScaleFactor
+
+RecolourNeighbours findRecolourNeighbours(
+  const RecolourParams& cfg,
+  const PCCPointSet3& source,
+  double sourceToTargetScaleFactor,
+  Vec3<double> targetToSourceOffset,
+  const PCCPointSet3& target);
+
 //============================================================================
 // Determine colour attribute values from a reference/source point cloud.
 // For each point of the target p_t:
@@ -117,16 +185,13 @@ void clampVolume(Box3<int32_t> bbox, PCCPointSet3* cloud);
 // weighted average with the number of points of each set as the weights)
 // of \bar{Ψ}̅_1 and \bar{Ψ}̅_2 and transfer it to p_t.
 //
-// Differences in the scale and translation of the target and source point
-// clouds, is handled according to:
-//    posInTgt = (posInSrc - targetToSourceOffset) * sourceToTargetScaleFactor
+// The neighbourhoods are determined by findRecolourNeighbours().
 
 bool recolourColour(
   const AttributeDescription& desc,
   const RecolourParams& params,
   const PCCPointSet3& source,
-  double sourceToTargetScaleFactor,
-  point_t targetToSourceOffset,
+  const RecolourNeighbours& nbrs,
   PCCPointSet3& target);
 
 //============================================================================
@@ -146,16 +211,13 @@ bool recolourColour(
 // weighted average with the number of points of each set as the weights)
 // of \bar{Ψ}̅_1 and \bar{Ψ}̅_2 and transfer it to p_t.
 //
-// Differences in the scale and translation of the target and source point
-// clouds, is handled according to:
-//    posInTgt = (posInSrc - targetToSourceOffset) * sourceToTargetScaleFactor
+// The neighbourhoods are determined by findRecolourNeighbours().
 
 bool recolourReflectance(
   const AttributeDescription& desc,
   const RecolourParams& cfg,
   const PCCPointSet3& source,
-  double sourceToTargetScaleFactor,
-  point_t targetToSourceOffset,
+  const RecolourNeighbours& nbrs,
   PCCPointSet3& target);
 
 //============================================================================
@@ -167,7 +229,7 @@ bool recolourReflectance(
 //     (posInSrc - targetToSourceOffset) * sourceToTargetScaleFactor - offset
 
 int recolour(
-  const AttributeDescription& desc,
+  const std::vector<AttributeDescription>& descs,
   const RecolourParams& cfg,
   const PCCPointSet3& source,
   float sourceToTargetScaleFactor,
@@ -175,6 +237,23 @@ int recolour(
   Vec3<int> offset,
   PCCPointSet3* target);
 
+//============================================================================
+// Transfer attributes from a source point cloud to a target point cloud
+// with identical (unscaled) geometry, such as when the geometry is coded
+// losslessly: each target point is assigned the (rounded) mean attribute
+// values of the source points at the same position, ie:
+//   posInTgt = posInSrc - targetToSourceOffset - offset
+//
+// Returns false, leaving target unmodified, if any source point has no
+// co-located target point or vice versa.
+
+bool recolourExact(
+  const std::vector<AttributeDescription>& descs,
+  const PCCPointSet3& source,
+  Vec3<int> targetToSourceOffset,
+  Vec3<int> offset,
+  PCCPointSet3* target);
+
 //============================================================================
 
 void convertGbrToYCbCrBt709(PCCPointSet3&);
@@ -0,0 +1,443 @@
+/* The copyright in this software is being made available under the BSD
+ * Licence, included below.  This software may be subject to other third
+ * party and contributor rights, including patent rights, and no such
+ * rights are granted under this licence.
+ *
+ * Copyright (c) 2020, ISO/IEC
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * * Redistributions of source code must retain the above copyright
+ *   notice, this list of conditions and the following disclaimer.
+ *
+ * * Redistributions in binary form must reproduce the above copyright
+ *   notice, this list of conditions and the following disclaimer in the
+ *   documentation and/or other materials provided with the distribution.
+ *
+ * * Neither the name of the ISO/IEC nor the names of its contributors
+ *   may be used to endorse or promote products derived from this
+ *   software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "rawcloud.h"
+
+#include "osspecific.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <fstream>
+#include <istream>
+#include <ostream>
+#include <functional>
+#include <limits>
+
+namespace pcc {
+
+//============================================================================
+
+static_assert(sizeof(point_t) == 3 * sizeof(int32_t), "unexpected padding");
+static_assert(
+  sizeof(Vec3<attr_t>) == 3 * sizeof(attr_t), "unexpected padding");
+static_assert(sizeof(rawcloud::Header) == 24, "unexpected padding");
+
+//============================================================================
+// The byte offset of each array in a file with the given header.
+
+struct RawCloudLayout {
+  size_t positions;
+  size_t colours;
+  size_t reflectances;
+  size_t frameidx;
+  size_t fileSize;
+};
+
+//----------------------------------------------------------------------------
+
+static size_t
+alignOffset(size_t offset)
+{
+  const size_t align = rawcloud::kAlignment;
+  return (offset + align - 1) / align * align;
+}
+
+//----------------------------------------------------------------------------
+
+static RawCloudLayout
+rawCloudLayout(const rawcloud::Header& hdr)
+{
+  using namespace rawcloud;
+  const size_t count = size_t(hdr.pointCount);
+
+  RawCloudLayout layout;
+  size_t end = sizeof(Header);
+
+  layout.positions = alignOffset(end);
+  end = layout.positions + count * sizeof(point_t);
+
+  layout.colours = alignOffset(end);
+  if (hdr.flags & kHasColours)
+    end = layout.colours + count * sizeof(Vec3<attr_t>);
+
+  layout.reflectances = alignOffset(end);
+  if (hdr.flags & kHasReflectances)
+    end = layout.reflectances + count * sizeof(attr_t);
+
+  layout.frameidx = alignOffset(end);
+  if (hdr.flags & kHasFrameIndex)
+    end = layout.frameidx + count * sizeof(uint8_t);
+
+  // NB: the file is not padded after the last array
+  layout.fileSize = end;
+  return layout;
+}
+
+//============================================================================
+
+bool
+rawcloud::isRawCloudPath(const std::string& fileName)
+{
+  const size_t len = sizeof(kFileSuffix) - 1;
+  return fileName.size() >= len
+    && !fileName.compare(fileName.size() - len, len, kFileSuffix);
+}
+
+//----------------------------------------------------------------------------
+
+bool
+rawcloud::write(
+  const PCCPointSet3& cloud,
+  double positionScale,
+  Vec3<int32_t> positionOffset,
+  std::ostream& fout)
+{
+  if (positionScale != std::floor(positionScale))
+    return false;
+
+  const size_t pointCount = cloud.getPointCount();
+
+  Header hdr;
+  std::memcpy(hdr.magic, kMagic, sizeof(kMagic));
+  hdr.version = kVersion;
+  hdr.byteOrderMark = kByteOrderMark;
+  hdr.flags = 0;
+  hdr.flags |= cloud.hasColors() ? kHasColours : 0;
+  hdr.flags |= cloud.hasReflectances() ? kHasReflectances : 0;
+  hdr.flags |= cloud.hasFrameIndex() ? kHasFrameIndex : 0;
+  hdr.pointCount = pointCount;
+
+  const RawCloudLayout layout = rawCloudLayout(hdr);
+
+  // Each array is staged through a buffer of converted values, written
+  // in blocks, following any padding required for alignment.
+  const size_t kBlockPoints = 65536;
+  std::vector<char> block;
+  size_t offset = 0;
+
+  auto writeArray = [&](size_t arrayOffset, size_t valueSize,
+                        const std::function<void(size_t, char*)>& getValue) {
+    block.assign(arrayOffset - offset, 0);
+    fout.write(block.data(), block.size());
+    for (size_t i = 0; i < pointCount; i += kBlockPoints) {
+      const size_t end = std::min(pointCount, i + kBlockPoints);
+      block.resize((end - i) * valueSize);
+      for (size_t j = i; j < end; j++)
+        getValue(j, &block[(j - i) * valueSize]);
+      fout.write(block.data(), block.size());
+    }
+    offset = arrayOffset + pointCount * valueSize;
+  };
+
+  fout.write(reinterpret_cast<const char*>(&hdr), sizeof(hdr));
+  offset = sizeof(hdr);
+
+  writeArray(layout.positions, sizeof(point_t), [&](size_t i, char* dst) {
+    point_t pos;
+    for (int k = 0; k < 3; k++)
+      pos[k] = int32_t(cloud[i][k] * positionScale + positionOffset[k]);
+    std::memcpy(dst, &pos, sizeof(pos));
+  });
+
+  if (cloud.hasColors()) {
+    writeArray(layout.colours, sizeof(Vec3<attr_t>), [&](size_t i, char* dst) {
+      const Vec3<attr_t> colour = cloud.getColor(i);
+      std::memcpy(dst, &colour, sizeof(colour));
+    });
+  }
+
+  if (cloud.hasReflectances()) {
+    writeArray(layout.reflectances, sizeof(attr_t), [&](size_t i, char* dst) {
+      const attr_t reflectance = cloud.getReflectance(i);
+      std::memcpy(dst, &reflectance, sizeof(reflectance));
+    });
+  }
+
+  if (cloud.hasFrameIndex()) {
+    writeArray(layout.frameidx, sizeof(uint8_t), [&](size_t i, char* dst) {
+      *dst = char(cloud.getFrameIndex(i));
+    });
+  }
+
+  return bool(fout);
+}
+
+//----------------------------------------------------------------------------
+
+bool
+rawcloud::write(
+  const PCCPointSet3& cloud,
+  double positionScale,
+  Vec3<int32_t> positionOffset,
+  const std::string& fileName)
+{
+  std::ofstream fout(fileName, std::ios::binary);
+  if (!fout.is_open())
+    return false;
+
+  if (!write(cloud, positionScale, positionOffset, fout))
+    return false;
+
+  fout.close();
+  return bool(fout);
+}
+
+//----------------------------------------------------------------------------
+
+// Determine if @a hdr describes a record that can be read
+
+static bool
+isValidHeader(const rawcloud::Header& hdr)
+{
+  using namespace rawcloud;
+
+  if (std::memcmp(hdr.magic, kMagic, sizeof(kMagic)))
+    return false;
+
+  if (hdr.version != kVersion || hdr.byteOrderMark != kByteOrderMark)
+    return false;
+
+  // reject counts whose layout cannot be represented
+  const uint64_t maxPoints =
+    std::numeric_limits<size_t>::max() / (4 * sizeof(point_t));
+  return hdr.pointCount <= maxPoints;
+}
+
+//----------------------------------------------------------------------------
+
+// Validate @a hdr and populate @a cloud accordingly, using readArray to
+// copy each array of the record (given its offset and size) into place.
+//
+// The cloud is grown by at most @a blockPoints at a time as positions are
+// read, such that a corrupt point count cannot cause an allocation much
+// larger than the available data.
+
+static bool
+readRawCloud(
+  const rawcloud::Header& hdr,
+  size_t blockPoints,
+  PCCPointSet3& cloud,
+  const std::function<bool(void*, size_t, size_t)>& readArray)
+{
+  using namespace rawcloud;
+
+  if (!isValidHeader(hdr))
+    return false;
+
+  const RawCloudLayout layout = rawCloudLayout(hdr);
+  const size_t pointCount = size_t(hdr.pointCount);
+
+  cloud.clear();
+  cloud.addRemoveAttributes(
+    hdr.flags & kHasColours, hdr.flags & kHasReflectances);
+  if (hdr.flags & kHasFrameIndex)
+    cloud.addFrameIndex();
+  else
+    cloud.removeFrameIndex();
+
+  bool ok = true;
+  for (size_t i = 0; ok && i < pointCount; i += blockPoints) {
+    const size_t count = std::min(blockPoints, pointCount - i);
+    cloud.resize(i + count);
+    ok = readArray(
+      &cloud[i], layout.positions + i * sizeof(point_t),
+      count * sizeof(point_t));
+  }
+
+  if (!pointCount || !ok)
+    return ok;
+
+  if (ok && cloud.hasColors())
+    ok = readArray(
+      &cloud.getColor(0), layout.colours, pointCount * sizeof(Vec3<attr_t>));
+
+  if (ok && cloud.hasReflectances())
+    ok = readArray(
+      &cloud.getReflectance(0), layout.reflectances,
+      pointCount * sizeof(attr_t));
+
+  if (ok && cloud.hasFrameIndex())
+    ok = readArray(
+      &cloud.getFrameIndex(0), layout.frameidx,
+      pointCount * sizeof(uint8_t));
+
+  return ok;
+}
+
+//----------------------------------------------------------------------------
+
+bool
+rawcloud::read(const std::string& fileName, PCCPointSet3& cloud)
+{
+  MappedFile file;
+  if (!file.open(fileName.c_str()) || file.size() < sizeof(Header))
+    return false;
+
+  Header hdr;
+  std::memcpy(&hdr, file.data(), sizeof(hdr));
+
+  // the file must contain every array
+  if (!isValidHeader(hdr) || file.size() < rawCloudLayout(hdr).fileSize)
+    return false;
+
+  const size_t pointCount = size_t(hdr.pointCount);
+  auto readArray = [&](void* dst, size_t offset, size_t size) {
+    std::memcpy(dst, file.data() + offset, size);
+    return true;
+  };
+
+  return readRawCloud(hdr, std::max(pointCount, size_t(1)), cloud, readArray);
+}
+
+//----------------------------------------------------------------------------
+
+bool
+rawcloud::read(std::istream& is, PCCPointSet3& cloud)
+{
+  Header hdr;
+  if (!is.read(reinterpret_cast<char*>(&hdr), sizeof(hdr)))
+    return false;
+
+  // NB: the length of a stream is unknown in advance
+  const size_t kBlockPoints = 1 << 20;
+
+  size_t pos = sizeof(hdr);
+  auto readArray = [&](void* dst, size_t offset, size_t size) {
+    is.ignore(offset - pos);
+    is.read(static_cast<char*>(dst), size);
+    pos = offset + size;
+    return bool(is);
+  };
+
+  return readRawCloud(hdr, kBlockPoints, cloud, readArray);
+}
+
+//============================================================================
+
+bool
+rawcloud::BlockReader::open(const std::string& fileName)
+{
+  _nextPoint = 0;
+  _file.open(fileName, std::ios::binary);
+  if (!_file.read(reinterpret_cast<char*>(&_hdr), sizeof(_hdr)))
+    return false;
+
+  if (!isValidHeader(_hdr))
+    return false;
+
+  // the file must contain every array
+  _file.seekg(0, std::ios::end);
+  return _file && size_t(_file.tellg()) >= rawCloudLayout(_hdr).fileSize;
+}
+
+//----------------------------------------------------------------------------
+
+bool
+rawcloud::BlockReader::read(size_t maxPoints, PCCPointSet3* block)
+{
+  const size_t count = std::min(maxPoints, pointCount() - _nextPoint);
+  if (!count)
+    return false;
+
+  block->clear();
+  block->addRemoveAttributes(
+    _hdr.flags & kHasColours, _hdr.flags & kHasReflectances);
+  if (_hdr.flags & kHasFrameIndex)
+    block->addFrameIndex();
+  else
+    block->removeFrameIndex();
+  block->resize(count);
+
+  // Each array is read from the position of the first point in the block
+  auto readArray = [&](void* dst, size_t offset, size_t valueSize) {
+    _file.seekg(offset + _nextPoint * valueSize);
+    _file.read(static_cast<char*>(dst), count * valueSize);
+  };
+
+  const RawCloudLayout layout = rawCloudLayout(_hdr);
+  readArray(&(*block)[0], layout.positions, sizeof(point_t));
+
+  if (block->hasColors())
+    readArray(&block->getColor(0), layout.colours, sizeof(Vec3<attr_t>));
+
+  if (block->hasReflectances())
+    readArray(
+      &block->getReflectance(0), layout.reflectances, sizeof(attr_t));
+
+  if (block->hasFrameIndex())
+    readArray(&block->getFrameIndex(0), layout.frameidx, sizeof(uint8_t));
+
+  _nextPoint += count;
+  return bool(_file);
+}
+
+//============================================================================
+
+bool
+readPointCloud(
+  const std::string& fileName,
+  const ply::PropertyNameMap& propertyNames,
+  PCCPointSet3& cloud)
+{
+  if (rawcloud::isRawCloudPath(fileName))
+    return rawcloud::read(fileName, cloud);
+
+  return ply::read(fileName, propertyNames, cloud);
+}
+
+//----------------------------------------------------------------------------
+
+bool
+writePointCloud(
+  const PCCPointSet3& cloud,
+  const ply::PropertyNameMap& propertyNames,
+  double positionScale,
+  Vec3<int32_t> positionOffset,
+  const std::string& fileName,
+  bool asAscii,
+  bool compactPositions)
+{
+  if (rawcloud::isRawCloudPath(fileName))
+    return rawcloud::write(cloud, positionScale, positionOffset, fileName);
+
+  return ply::write(
+    cloud, propertyNames, positionScale, positionOffset, fileName, asAscii,
+    compactPositions);
+}
+
+//============================================================================
+
+}  // namespace pcc
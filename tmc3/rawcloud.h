@@ -0,0 +1,172 @@
+/* The copyright in this software is being made available under the BSD
+ * Licence, included below.  This software may be subject to other third
+ * party and contributor rights, including patent rights, and no such
+ * rights are granted under this licence.
+ *
+ * Copyright (c) 2020, ISO/IEC
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * * Redistributions of source code must retain the above copyright
+ *   notice, this list of conditions and the following disclaimer.
+ *
+ * * Redistributions in binary form must reproduce the above copyright
+ *   notice, this list of conditions and the following disclaimer in the
+ *   documentation and/or other materials provided with the distribution.
+ *
+ * * Neither the name of the ISO/IEC nor the names of its contributors
+ *   may be used to endorse or promote products derived from this
+ *   software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#pragma once
+
+#include <fstream>
+#include <istream>
+#include <ostream>
+#include <string>
+
+#include "PCCMath.h"
+#include "PCCPointSet.h"
+#include "ply.h"
+
+namespace pcc {
+namespace rawcloud {
+
+  //============================================================================
+  // A native columnar point cloud format, intended as a cache of parsed
+  // source data.  The file is a fixed size header followed by one array
+  // per present component, each beginning at a multiple of kAlignment bytes
+  // and laid out exactly as the corresponding PCCPointSet3 storage:
+  //
+  //   positions     pointCount * int32_t[3]
+  //   colours       pointCount * uint16_t[3]  (if kHasColours)
+  //   reflectances  pointCount * uint16_t     (if kHasReflectances)
+  //   frameidx      pointCount * uint8_t      (if kHasFrameIndex)
+  //
+  // All values are in the byte order of the writer; files with a
+  // different byte order are rejected.
+
+  const char kMagic[4] = {'P', 'C', 'R', 'W'};
+  const uint32_t kVersion = 1;
+  const uint32_t kByteOrderMark = 0x01020304;
+  const size_t kAlignment = 64;
+
+  enum Flags : uint32_t
+  {
+    kHasColours = 1 << 0,
+    kHasReflectances = 1 << 1,
+    kHasFrameIndex = 1 << 2,
+  };
+
+  struct Header {
+    char magic[4];
+    uint32_t version;
+    uint32_t byteOrderMark;
+    uint32_t flags;
+    uint64_t pointCount;
+  };
+
+  //============================================================================
+  // The file name suffix identifying the format.
+
+  const char kFileSuffix[] = ".pcraw";
+
+  // Determine if @a fileName names a file in the native format.
+  bool isRawCloudPath(const std::string& fileName);
+
+  //============================================================================
+
+  ///
+  // Write @a cloud to a native format file called @a fileName.
+  // Each point position, pt, is converted prior to writing by:
+  //  pt' = pt * positionScale + offset
+  //
+  // Since positions are stored as integers, it is an error if
+  // @a positionScale is not integral.
+  bool write(
+    const PCCPointSet3& cloud,
+    double positionScale,
+    Vec3<int32_t> positionOffset,
+    const std::string& fileName);
+
+  ///
+  // Read the native format file @a fileName into @a cloud.
+  bool read(const std::string& fileName, PCCPointSet3& cloud);
+
+  ///
+  // Write/read a single native format record to/from a stream.  The
+  // alignment of each array is relative to the start of the record,
+  // permitting a sequence of frames to be carried by a pipe.
+  bool write(
+    const PCCPointSet3& cloud,
+    double positionScale,
+    Vec3<int32_t> positionOffset,
+    std::ostream& os);
+
+  bool read(std::istream& is, PCCPointSet3& cloud);
+
+  //============================================================================
+  // Incremental reader of a native format file, permitting a point cloud
+  // larger than memory to be processed in blocks of points.
+
+  class BlockReader {
+  public:
+    bool open(const std::string& fileName);
+
+    size_t pointCount() const { return size_t(_hdr.pointCount); }
+
+    // Read (at most) @a maxPoints points following those previously read
+    // into @a block.  Returns false after the last point or upon error.
+    bool read(size_t maxPoints, PCCPointSet3* block);
+
+    // Continue reading from the first point.
+    void rewind() { _nextPoint = 0; }
+
+  private:
+    std::ifstream _file;
+    Header _hdr;
+    size_t _nextPoint;
+  };
+
+  //============================================================================
+
+}  // namespace rawcloud
+
+//============================================================================
+// Read/write a point cloud in either the native or ply format according to
+// the file name suffix.  The arguments are as per ply::read/ply::write;
+// @a propertyNames, @a asAscii and @a compactPositions are ignored by the
+// native format.
+
+bool readPointCloud(
+  const std::string& fileName,
+  const ply::PropertyNameMap& propertyNames,
+  PCCPointSet3& cloud);
+
+bool writePointCloud(
+  const PCCPointSet3& cloud,
+  const ply::PropertyNameMap& propertyNames,
+  double positionScale,
+  Vec3<int32_t> positionOffset,
+  const std::string& fileName,
+  bool asAscii,
+  bool compactPositions);
+
+//============================================================================
+
+}  // namespace pcc
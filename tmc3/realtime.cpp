@@ -0,0 +1,172 @@
+/* The copyright in this software is being made available under the BSD
+ * Licence, included below.  This software may be subject to other third
+ * party and contributor rights, including patent rights, and no such
+ * rights are granted under this licence.
+ *
+ * Copyright (c) 2020, ISO/IEC
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * * Redistributions of source code must retain the above copyright
+ *   notice, this list of conditions and the following disclaimer.
+ *
+ * * Redistributions in binary form must reproduce the above copyright
+ *   notice, this list of conditions and the following disclaimer in the
+ *   documentation and/or other materials provided with the distribution.
+ *
+ * * Neither the name of the ISO/IEC nor the names of its contributors
+ *   may be used to endorse or promote products derived from this
+ *   software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "realtime.h"
+
+#include <algorithm>
+
+namespace pcc {
+
+//============================================================================
+
+const int RealtimeController::kMaxLevel;
+
+//----------------------------------------------------------------------------
+
+RealtimeController::RealtimeController(
+  const RealtimeParams& rt, const EncoderParams& params)
+  : _rt(rt), _base(params), _level(0)
+{}
+
+//----------------------------------------------------------------------------
+
+void
+RealtimeController::configure(EncoderParams* params) const
+{
+  // limit a count, where negative values indicate no limit
+  auto limit = [](int value, int cap) {
+    return value < 0 ? cap : std::min(value, cap);
+  };
+
+  // Each level starts from the base configuration so that decreasing the
+  // level restores previously disabled tools.
+  auto& recolour = params->recolour;
+  recolour.numNeighboursFwd = _base.recolour.numNeighboursFwd;
+  recolour.numNeighboursBwd = _base.recolour.numNeighboursBwd;
+  params->attrEnc = _base.attrEnc;
+  params->gps.geom_planar_mode_enabled_flag =
+    _base.gps.geom_planar_mode_enabled_flag;
+  params->gps.inferred_direct_coding_mode_enabled_flag =
+    _base.gps.inferred_direct_coding_mode_enabled_flag;
+  params->partition.sliceMaxPoints = _base.partition.sliceMaxPoints;
+  params->partition.sliceMinPoints = _base.partition.sliceMinPoints;
+
+  for (int i = 0; i < params->aps.size(); i++) {
+    params->aps[i].search_range = _base.aps[i].search_range;
+    params->aps[i].num_pred_nearest_neighbours =
+      _base.aps[i].num_pred_nearest_neighbours;
+  }
+
+  if (_level >= 1) {
+    auto& attrEnc = params->attrEnc;
+    attrEnc.predModeMaxCandidates = limit(attrEnc.predModeMaxCandidates, 1);
+    recolour.numNeighboursFwd = std::min(recolour.numNeighboursFwd, 4);
+  }
+
+  if (_level >= 2) {
+    params->attrEnc.predModeMaxCandidates = 0;
+    recolour.numNeighboursFwd = std::min(recolour.numNeighboursFwd, 1);
+    recolour.numNeighboursBwd = std::min(recolour.numNeighboursBwd, 1);
+  }
+
+  // NB: the search range is signalled and must be at least one
+  int searchRangeShift = _level >= 3 ? 2 : _level >= 2 ? 1 : 0;
+  for (auto& aps : params->aps) {
+    aps.search_range = std::max(1, aps.search_range >> searchRangeShift);
+    if (_level >= 4)
+      aps.num_pred_nearest_neighbours =
+        std::min(aps.num_pred_nearest_neighbours, 2);
+  }
+
+  if (_level >= 3) {
+    params->gps.geom_planar_mode_enabled_flag = false;
+    params->gps.inferred_direct_coding_mode_enabled_flag = false;
+  }
+
+  if (_level >= 4) {
+    auto& partition = params->partition;
+    partition.sliceMaxPoints = std::max(1, partition.sliceMaxPoints / 2);
+    partition.sliceMinPoints =
+      std::min(partition.sliceMinPoints, partition.sliceMaxPoints / 2);
+  }
+}
+
+//----------------------------------------------------------------------------
+
+void
+RealtimeController::update(std::chrono::nanoseconds frameTime)
+{
+  using namespace std::chrono;
+  double frameTimeMs = duration_cast<duration<double, std::milli>>(frameTime)
+                         .count();
+  double ratio = frameTimeMs / _rt.frameLatencyMs;
+
+  // React quickly to missed deadlines, but only relax once there is
+  // sufficient headroom to avoid oscillating between levels.
+  if (ratio > 1.5)
+    _level += 2;
+  else if (ratio > 1.)
+    _level += 1;
+  else if (ratio < 0.6)
+    _level -= 1;
+
+  _level = std::max(0, std::min(kMaxLevel, _level));
+}
+
+//----------------------------------------------------------------------------
+
+void
+RealtimeController::report(
+  std::ostream& os,
+  const EncoderParams& params,
+  std::chrono::nanoseconds frameTime) const
+{
+  using namespace std::chrono;
+  auto frameTimeMs = duration_cast<milliseconds>(frameTime).count();
+
+  os << "Realtime frame time " << frameTimeMs << " ms (target "
+     << _rt.frameLatencyMs << " ms)"
+     << ", level " << _level << ":"
+     << " planar=" << params.gps.geom_planar_mode_enabled_flag
+     << " idcm=" << params.gps.inferred_direct_coding_mode_enabled_flag
+     << " sliceMaxPoints=" << params.partition.sliceMaxPoints
+     << " recolourNeighbours=" << params.recolour.numNeighboursFwd << ","
+     << params.recolour.numNeighboursBwd
+     << " predModeMaxCandidates=" << params.attrEnc.predModeMaxCandidates;
+
+  for (const auto& aps : params.aps) {
+    if (!aps.lodParametersPresent())
+      continue;
+    os << " [aps" << aps.aps_attr_parameter_set_id
+       << " searchRange=" << aps.search_range
+       << " numNeighbours=" << aps.num_pred_nearest_neighbours << "]";
+  }
+
+  os << '\n';
+}
+
+//============================================================================
+
+}  // namespace pcc
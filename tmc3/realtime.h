@@ -0,0 +1,99 @@
+/* The copyright in this software is being made available under the BSD
+ * Licence, included below.  This software may be subject to other third
+ * party and contributor rights, including patent rights, and no such
+ * rights are granted under this licence.
+ *
+ * Copyright (c) 2020, ISO/IEC
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * * Redistributions of source code must retain the above copyright
+ *   notice, this list of conditions and the following disclaimer.
+ *
+ * * Redistributions in binary form must reproduce the above copyright
+ *   notice, this list of conditions and the following disclaimer in the
+ *   documentation and/or other materials provided with the distribution.
+ *
+ * * Neither the name of the ISO/IEC nor the names of its contributors
+ *   may be used to endorse or promote products derived from this
+ *   software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#pragma once
+
+#include <chrono>
+#include <ostream>
+
+#include "PCCTMC3Encoder.h"
+
+namespace pcc {
+
+//============================================================================
+
+struct RealtimeParams {
+  // Target encoding latency of each frame in milliseconds (0 => disabled)
+  double frameLatencyMs;
+};
+
+//============================================================================
+// Adapts non-normative encoder choices and signalled coding tools between
+// frames so that the per-frame encoding time meets a target latency.
+//
+// The adaptation is expressed as a complexity level, each level reducing
+// encoder effort relative to the previous:
+//  - 1: limit the prediction mode search, four recolouring neighbours
+//  - 2: no prediction mode search, single neighbour recolouring,
+//       halved LoD neighbour search range
+//  - 3: quartered search range, planar mode and IDCM disabled
+//  - 4: at most two prediction neighbours, halved maximum slice size
+
+class RealtimeController {
+public:
+  static const int kMaxLevel = 4;
+
+  // NB: params is the configuration used for level 0.
+  RealtimeController(const RealtimeParams& rt, const EncoderParams& params);
+
+  bool enabled() const { return _rt.frameLatencyMs > 0; }
+
+  int level() const { return _level; }
+
+  // Configure params according to the current complexity level.
+  void configure(EncoderParams* params) const;
+
+  // Select the complexity level for the next frame, given the encoding
+  // time of the current one.
+  void update(std::chrono::nanoseconds frameTime);
+
+  // Report the parameters chosen by the controller for a frame.
+  void report(
+    std::ostream& os,
+    const EncoderParams& params,
+    std::chrono::nanoseconds frameTime) const;
+
+private:
+  RealtimeParams _rt;
+
+  // Configuration that is modified by each level
+  EncoderParams _base;
+
+  int _level;
+};
+
+//============================================================================
+
+}  // namespace pcc
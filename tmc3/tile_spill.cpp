@@ -0,0 +1,235 @@
+/* The copyright in this software is being made available under the BSD
+ * Licence, included below.  This software may be subject to other third
+ * party and contributor rights, including patent rights, and no such
+ * rights are granted under this licence.
+ *
+ * Copyright (c) 2020, ISO/IEC
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * * Redistributions of source code must retain the above copyright
+ *   notice, this list of conditions and the following disclaimer.
+ *
+ * * Redistributions in binary form must reproduce the above copyright
+ *   notice, this list of conditions and the following disclaimer in the
+ *   documentation and/or other materials provided with the distribution.
+ *
+ * * Neither the name of the ISO/IEC nor the names of its contributors
+ *   may be used to endorse or promote products derived from this
+ *   software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "tile_spill.h"
+
+#include "partitioning.h"
+#include "pointset_processing.h"
+
+#include <cmath>
+#include <cstdio>
+#include <fstream>
+#include <map>
+
+namespace pcc {
+
+//============================================================================
+// Source points are read in blocks of kReadBlockPoints.  Each tile's points
+// are written to its spill file in blocks of kSpillBlockPoints, all pending
+// points being written should more than kMaxPendingPoints accumulate.
+
+static const size_t kReadBlockPoints = 1 << 20;
+static const size_t kSpillBlockPoints = 1 << 16;
+static const size_t kMaxPendingPoints = 1 << 24;
+
+//============================================================================
+
+bool
+TileSpill::partition(
+  rawcloud::BlockReader& src, const SequenceParameterSet& sps, int tileSize)
+{
+  clear();
+
+  // Tiles (and their bounding boxes) indexed by tile morton code
+  std::map<uint64_t, Tile> tiles;
+  std::map<uint64_t, Box3<int32_t>> tileBoxes;
+
+  // The quantization clamping box as used by the encoder
+  Box3<int32_t> clampBox{{0, 0, 0}, sps.seq_bounding_box_whd};
+  for (int k = 0; k < 3; k++)
+    clampBox.max[k] =
+      int(ceil(clampBox.max[k] * sps.seq_source_geom_scale_factor)) - 1;
+
+  Box3<int32_t> inverseClampBox{{0, 0, 0}, {INT32_MAX, INT32_MAX, INT32_MAX}};
+
+  PCCPointSet3 block;
+  PCCPointSet3 tilePositions;
+  size_t numPending = 0;
+  while (src.read(kReadBlockPoints, &block)) {
+    // Tiles are determined by the quantized and inverse quantized position
+    quantizePositions(
+      sps.seq_source_geom_scale_factor, sps.seq_bounding_box_xyz0, clampBox,
+      block, &tilePositions);
+    quantizePositions(
+      1.0 / sps.seq_source_geom_scale_factor, 0, inverseClampBox,
+      tilePositions, &tilePositions);
+
+    for (size_t i = 0; i < block.getPointCount(); i++) {
+      const point_t& pos = tilePositions[i];
+      uint64_t mortonCode = tileMortonCode(pos, tileSize);
+
+      auto it = tiles.find(mortonCode);
+      if (it == tiles.end()) {
+        it = tiles.emplace(mortonCode, Tile()).first;
+        it->second.fileName = _pathPrefix + std::to_string(_tiles.size());
+        it->second.pointCount = 0;
+        tileBoxes[mortonCode] = {pos, pos};
+
+        // track the spill file for removal should partitioning fail
+        _tiles.emplace_back();
+        _tiles.back().fileName = it->second.fileName;
+      }
+
+      Tile& tile = it->second;
+      if (!tile.pointCount)
+        tile.pending.addRemoveAttributes(
+          block.hasColors(), block.hasReflectances());
+
+      Box3<int32_t>& bbox = tileBoxes[mortonCode];
+      for (int k = 0; k < 3; k++) {
+        bbox.min[k] = std::min(bbox.min[k], pos[k]);
+        bbox.max[k] = std::max(bbox.max[k], pos[k]);
+      }
+
+      size_t idx = tile.pending.getPointCount();
+      tile.pending.resize(idx + 1);
+      tile.pending[idx] = block[i];
+      if (block.hasColors())
+        tile.pending.setColor(idx, block.getColor(i));
+      if (block.hasReflectances())
+        tile.pending.setReflectance(idx, block.getReflectance(i));
+      tile.pointCount++;
+      numPending++;
+
+      if (idx + 1 >= kSpillBlockPoints) {
+        numPending -= tile.pending.getPointCount();
+        if (!flush(&tile))
+          return false;
+      }
+    }
+
+    if (numPending > kMaxPendingPoints) {
+      for (auto& entry : tiles)
+        if (!flush(&entry.second))
+          return false;
+      numPending = 0;
+    }
+  }
+
+  for (auto& entry : tiles)
+    if (!flush(&entry.second))
+      return false;
+
+  // Number the tiles in order of their morton codes, as per tilePartition
+  _tiles.clear();
+  _tileInventory.tiles.clear();
+  for (auto& entry : tiles) {
+    _tiles.emplace_back();
+    _tiles.back().fileName = entry.second.fileName;
+    _tiles.back().pointCount = entry.second.pointCount;
+
+    const Box3<int32_t>& bbox = tileBoxes[entry.first];
+    _tileInventory.tiles.emplace_back();
+    auto& tileIvt = _tileInventory.tiles.back();
+    for (int k = 0; k < 3; k++) {
+      tileIvt.tile_bounding_box_whd[k] = bbox.max[k] - bbox.min[k];
+      tileIvt.tile_bounding_box_xyz0[k] =
+        bbox.min[k] - sps.seq_bounding_box_xyz0[k];
+    }
+  }
+
+  return true;
+}
+
+//----------------------------------------------------------------------------
+
+bool
+TileSpill::flush(Tile* tile)
+{
+  if (!tile->pending.getPointCount())
+    return true;
+
+  // Each block is appended to the spill file as a native format record.
+  // NB: the first block replaces any file left by a previous invocation.
+  bool isFirstBlock = tile->pending.getPointCount() == tile->pointCount;
+  std::ofstream fout(
+    tile->fileName,
+    std::ios::binary | (isFirstBlock ? std::ios::trunc : std::ios::app));
+  if (!fout.is_open())
+    return false;
+
+  if (!rawcloud::write(tile->pending, 1, 0, fout))
+    return false;
+
+  // release the storage of the written points
+  PCCPointSet3 empty;
+  empty.addRemoveAttributes(
+    tile->pending.hasColors(), tile->pending.hasReflectances());
+  std::swap(tile->pending, empty);
+  return true;
+}
+
+//----------------------------------------------------------------------------
+
+bool
+TileSpill::loadTile(int tileId, PCCPointSet3* cloud) const
+{
+  const Tile& tile = _tiles[tileId];
+  std::ifstream fin(tile.fileName, std::ios::binary);
+  if (!fin.is_open())
+    return false;
+
+  cloud->clear();
+
+  PCCPointSet3 block;
+  while (fin.peek() != EOF) {
+    if (!rawcloud::read(fin, block))
+      return false;
+
+    if (!cloud->getPointCount()) {
+      cloud->addRemoveAttributes(block.hasColors(), block.hasReflectances());
+      cloud->reserve(tile.pointCount);
+    }
+    cloud->append(block);
+  }
+
+  return cloud->getPointCount() == tile.pointCount;
+}
+
+//----------------------------------------------------------------------------
+
+void
+TileSpill::clear()
+{
+  for (const auto& tile : _tiles)
+    std::remove(tile.fileName.c_str());
+
+  _tiles.clear();
+  _tileInventory.tiles.clear();
+}
+
+//============================================================================
+
+}  // namespace pcc
@@ -0,0 +1,105 @@
+/* The copyright in this software is being made available under the BSD
+ * Licence, included below.  This software may be subject to other third
+ * party and contributor rights, including patent rights, and no such
+ * rights are granted under this licence.
+ *
+ * Copyright (c) 2020, ISO/IEC
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * * Redistributions of source code must retain the above copyright
+ *   notice, this list of conditions and the following disclaimer.
+ *
+ * * Redistributions in binary form must reproduce the above copyright
+ *   notice, this list of conditions and the following disclaimer in the
+ *   documentation and/or other materials provided with the distribution.
+ *
+ * * Neither the name of the ISO/IEC nor the names of its contributors
+ *   may be used to endorse or promote products derived from this
+ *   software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#pragma once
+
+#include <string>
+#include <vector>
+
+#include "PCCMath.h"
+#include "PCCPointSet.h"
+#include "hls.h"
+#include "rawcloud.h"
+
+namespace pcc {
+
+//============================================================================
+// Partitions a source point cloud into tiles without requiring the whole
+// cloud to be resident in memory.  The source is read once in blocks, the
+// points of each tile being appended to a per-tile spill file, from which
+// tiles may subsequently be loaded one at a time.
+//
+// Tiles are identical to those determined by tilePartition from the
+// quantized and inverse quantized source, and are numbered likewise.
+
+class TileSpill {
+public:
+  // Spill files are named by appending a number to @a pathPrefix
+  TileSpill(const std::string& pathPrefix) : _pathPrefix(pathPrefix) {}
+
+  TileSpill(const TileSpill&) = delete;
+  TileSpill& operator=(const TileSpill&) = delete;
+
+  // NB: any spill files are removed
+  ~TileSpill() { clear(); }
+
+  // Distribute the points of @a src into tiles of @a tileSize using the
+  // position quantization and bounding box of @a sps, determining the
+  // tile inventory.
+  bool partition(
+    rawcloud::BlockReader& src, const SequenceParameterSet& sps, int tileSize);
+
+  int numTiles() const { return int(_tiles.size()); }
+
+  const TileInventory& tileInventory() const { return _tileInventory; }
+
+  // Read the source points of tile @a tileId, in source order
+  bool loadTile(int tileId, PCCPointSet3* cloud) const;
+
+  // Remove all spill files
+  void clear();
+
+private:
+  struct Tile {
+    std::string fileName;
+    size_t pointCount;
+
+    // Points yet to be written to the spill file
+    PCCPointSet3 pending;
+  };
+
+  static bool flush(Tile* tile);
+
+  std::string _pathPrefix;
+
+  // Tiles, in order of tile id once partitioned
+  std::vector<Tile> _tiles;
+
+  TileInventory _tileInventory;
+};
+
+//============================================================================
+
+}  // namespace pcc
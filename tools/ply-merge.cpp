@@ -39,6 +39,7 @@
 #include "PCCMisc.h"
 #include "PCCPointSet.h"
 #include "ply.h"
+#include "rawcloud.h"
 #include "program_options_lite.h"
 #include "version.h"
 
@@ -52,6 +53,7 @@ struct Options;
 bool parseParameters(int argc, char* argv[], Options& opts);
 void runMerge(const Options& opts);
 void runSplit(const Options& opts);
+void runConvert(const Options& opts);
 
 //============================================================================
 
@@ -59,12 +61,16 @@ struct Options {
   enum class Mode
   {
     Merge,
-    Split
+    Split,
+    Convert
   } mode;
 
   // output mode for ply writing (binary or ascii)
   bool outputBinaryPly;
 
+  // write ply positions using the most compact exact type
+  bool outputCompactPlyPositions;
+
   // path (using %d to indicate frame number) of input files
   std::string srcPath;
 
@@ -95,6 +101,8 @@ operator>>(std::istream& in, Options::Mode& val)
     val = Options::Mode::Merge;
   else if (word == "split")
     val = Options::Mode::Split;
+  else if (word == "convert")
+    val = Options::Mode::Convert;
   else
     throw std::exception();
   return in;
@@ -108,6 +116,7 @@ operator<<(std::ostream& out, const Options::Mode& val)
   switch (val) {
   case Options::Mode::Merge: out << "merge"; break;
   case Options::Mode::Split: out << "split"; break;
+  case Options::Mode::Convert: out << "convert"; break;
   }
   return out;
 }
@@ -128,10 +137,12 @@ main(int argc, char* argv[])
     switch (opts.mode) {
     case Options::Mode::Merge: runMerge(opts); break;
     case Options::Mode::Split: runSplit(opts); break;
+    case Options::Mode::Convert: runConvert(opts); break;
     }
   }
   catch (const exception& e) {
     cerr << "Error:" << e.what() << endl;
+    return 1;
   }
 
   return 0;
@@ -161,7 +172,8 @@ parseParameters(int argc, char* argv[], Options& params)
   ("mode", params.mode, Options::Mode::Merge,
     "The combine/split mode:\n"
     "  split: extract n ply files from one\n"
-    "  merge: combine n ply files into one")
+    "  merge: combine n ply files into one\n"
+    "  convert: rewrite each file in the format of outPath")
 
   ("srcPath",
     params.srcPath, {},
@@ -175,6 +187,11 @@ parseParameters(int argc, char* argv[], Options& params)
     params.outputBinaryPly, false,
     "Output ply files using binary (or otherwise ascii) format")
 
+  ("outputCompactPlyPositions",
+    params.outputCompactPlyPositions, false,
+    "Output ply positions using the most compact exact type (int32, "
+    "float or float64), rather than always as floating point")
+
   ("firstFrameNum",
     params.firstFrameNum, 0,
     "Number of first frame of input sequence (used in %d interpolation)")
@@ -236,7 +253,7 @@ runMerge(const Options& opts)
       srcClouds.emplace_back();
       auto& srcCloud = srcClouds.back();
       if (
-        !ply::read(srcName, propNames, srcCloud)
+        !readPointCloud(srcName, propNames, srcCloud)
         || srcCloud.getPointCount() == 0) {
         throw runtime_error("failed to read input file: " + srcName);
       }
@@ -273,7 +290,9 @@ runMerge(const Options& opts)
     }
 
     string outName{expandNum(opts.outPath, outFrameNum)};
-    if (!ply::write(outCloud, propNames, 1, 0, outName, !opts.outputBinaryPly))
+    if (!writePointCloud(
+          outCloud, propNames, 1, 0, outName, !opts.outputBinaryPly,
+          opts.outputCompactPlyPositions))
       throw runtime_error("failed to write output file: " + outName);
     cout << outName << endl;
   }
@@ -297,7 +316,7 @@ runSplit(const Options& opts)
 
     PCCPointSet3 srcCloud;
     if (
-      !ply::read(srcName, propNames, srcCloud)
+      !readPointCloud(srcName, propNames, srcCloud)
       || srcCloud.getPointCount() == 0) {
       throw runtime_error("failed to read input file: " + srcName);
     }
@@ -341,8 +360,9 @@ runSplit(const Options& opts)
 
       string outName{expandNum(opts.outPath, outFrameNum)};
       if (outCloud.getPointCount() > 0)
-        if (!ply::write(
-              outCloud, propNames, 1, 0, outName, !opts.outputBinaryPly))
+        if (!writePointCloud(
+              outCloud, propNames, 1, 0, outName, !opts.outputBinaryPly,
+              opts.outputCompactPlyPositions))
           throw runtime_error("failed to write output file: " + outName);
       cout << outName << endl;
 
@@ -352,3 +372,32 @@ runSplit(const Options& opts)
     } while (frameIdx != INT_MAX);
   }
 }
+
+//---------------------------------------------------------------------------
+// Read each frame, writing it in the format determined by the output path.
+//
+
+void
+runConvert(const Options& opts)
+{
+  ply::PropertyNameMap propNames;
+  propNames.position = {"x", "y", "z"};
+
+  int outFrameNum = opts.firstOutputFrameNum;
+  int srcFrameNum = opts.firstFrameNum;
+
+  for (int i = 0; i < opts.frameCount; i++, srcFrameNum++, outFrameNum++) {
+    string srcName{expandNum(opts.srcPath, srcFrameNum)};
+
+    PCCPointSet3 cloud;
+    if (!readPointCloud(srcName, propNames, cloud))
+      throw runtime_error("failed to read input file: " + srcName);
+
+    string outName{expandNum(opts.outPath, outFrameNum)};
+    if (!writePointCloud(
+          cloud, propNames, 1, 0, outName, !opts.outputBinaryPly,
+          opts.outputCompactPlyPositions))
+      throw runtime_error("failed to write output file: " + outName);
+    cout << outName << endl;
+  }
+}